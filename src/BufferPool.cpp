@@ -0,0 +1,28 @@
+#include <cstring>
+#include "BufferPool.hpp"
+
+
+BufferPool::BufferPool() {
+}
+
+BufferPool::~BufferPool() {
+}
+
+uint8_t * BufferPool::allocate() {
+	if (this->first == nullptr) {
+		// allocate a new slab and add its buffers to the free list
+		uint8_t * slab = new uint8_t[BUFFER_SIZE * SLAB_COUNT];
+		this->slabs.emplace_back(slab);
+		for (int i = 0; i < SLAB_COUNT; ++i) {
+			free(slab + i * BUFFER_SIZE);
+		}
+	}
+	uint8_t * buffer = this->first;
+	std::memcpy(&this->first, buffer, sizeof(uint8_t *));
+	return buffer;
+}
+
+void BufferPool::free(uint8_t * buffer) {
+	std::memcpy(buffer, &this->first, sizeof(uint8_t *));
+	this->first = buffer;
+}
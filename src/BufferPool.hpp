@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "Object.hpp"
+
+
+///
+/// Pool of fixed size buffers that are allocated in slabs. Used for receiving so that idle connections do not occupy
+/// a receive buffer. Only use from one event loop
+class BufferPool : public Object {
+public:
+	enum {
+		// size of one buffer
+		BUFFER_SIZE = 4096,
+		
+		// number of buffers in a slab
+		SLAB_COUNT = 16
+	};
+
+	BufferPool();
+	~BufferPool() override;
+
+	///
+	/// get a buffer of size BUFFER_SIZE
+	uint8_t * allocate();
+	
+	///
+	/// return a buffer to the pool
+	void free(uint8_t * buffer);
+
+protected:
+
+	// free buffers, the first bytes of a free buffer contain the pointer to the next free buffer
+	uint8_t * first = nullptr;
+	
+	std::vector<std::unique_ptr<uint8_t[]>> slabs;
+};
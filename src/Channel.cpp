@@ -1,117 +1,462 @@
+#include <assert.h>
+#include <sys/sendfile.h>
+#include <unistd.h> // pread
+#include <algorithm>
+#include <cerrno>
 #include <iostream>
+#include <iterator>
 #include "Channel.hpp"
 
 
 Channel::Channel(asio::io_service & loop, int timeout)
-		: socket(loop), timer(loop), timeout(timeout), txPending(0) {
+		: socket(loop), timeout(timeout), txPending(0) {
 }
 
 Channel::~Channel() {
+	// an open channel keeps itself alive, therefore it has already left the timer wheel in close() on its own event
+	// loop
+	assert(this->wheelSlot < 0);
 }
 
 void Channel::sendData(uint8_t const * data, size_t length) {
-	// add reference to this object until async_wait completes
-	addReference();
+	if (length == 0)
+		return;
+
+	// coalesce with the last queued buffer if we own it, a file entry holds no data
+	if (!this->txQueue.empty() && this->txQueue.back().borrowed == nullptr && !this->txQueue.back().file) {
+		this->txQueue.back().data.append((char const *)data, length);
+	} else {
+		this->txQueue.push_back({std::string((char const *)data, length), nullptr, 0, nullptr, nullptr, 0});
+		++this->txPending;
+	}
 	
-	// restart timeout timer
-	this->timer.expires_from_now(std::chrono::milliseconds(this->timeout));
-	this->timer.async_wait([this] (error_code error) {
-				if (!error) {
-					onTimeout();
-				}
+	// start writing if no write is in flight
+	if (this->txWriting.empty())
+		flush();
+}
 
-				// remove reference to this object
-				removeReference();
-			});
+void Channel::sendData(std::string && data) {
+	if (data.empty())
+		return;
+	this->txQueue.push_back({std::move(data), nullptr, 0, nullptr, nullptr, 0});
+	++this->txPending;
 	
-	// add reference to this object until async_write completes
-	addReference();
+	// start writing if no write is in flight
+	if (this->txWriting.empty())
+		flush();
+}
 
-	// send data
-	uint8_t * buffer = new uint8_t[length];
-	std::copy(data, data + length, buffer);
+void Channel::sendStatic(uint8_t const * data, size_t length) {
+	if (length == 0)
+		return;
+	this->txQueue.push_back({std::string(), data, length, nullptr, nullptr, 0});
 	++this->txPending;
-	asio::async_write(
-			this->socket,
-			asio::buffer(buffer, length),
-			[this, buffer] (error_code error, size_t writtenCount) {
-				delete [] buffer;
-				--this->txPending;
-				if (error)
-					onError(error);
-				
-				// notify when new data is needed to be sent
-				if (this->txPending == 0)
-					onReadyToSend();
 
-				// remove reference to this object
-				removeReference();
-			});
+	// start writing if no write is in flight
+	if (this->txWriting.empty())
+		flush();
+}
+
+void Channel::sendShared(ptr<Object> owner, uint8_t const * data, size_t length) {
+	if (length == 0)
+		return;
+	this->txQueue.push_back({std::string(), data, length, std::move(owner), nullptr, 0});
+	++this->txPending;
+
+	// start writing if no write is in flight
+	if (this->txWriting.empty())
+		flush();
+}
+
+void Channel::sendFile(ptr<File> file, int64_t offset, size_t length) {
+	if (length == 0)
+		return;
+	this->txQueue.push_back({std::string(), nullptr, length, nullptr, std::move(file), offset});
+	++this->txPending;
+
+	// start writing if no write is in flight
+	if (this->txWriting.empty())
+		flush();
+}
+
+std::string Channel::newBuffer() {
+	if (this->txFree.empty())
+		return std::string();
+	std::string buffer = std::move(this->txFree.back());
+	this->txFree.pop_back();
+	return buffer;
+}
+
+void Channel::setTimeout(int timeout) {
+	if (this->wheel) {
+		this->wheel->remove(this);
+		this->timeout = timeout;
+		if (timeout > 0 && this->socket.is_open())
+			this->wheel->add(this);
+	} else {
+		this->timeout = timeout;
+	}
 }
 
 void Channel::shutdown() {
-	this->socket.shutdown(asio::socket_base::shutdown_type::shutdown_send);
+	// only once, e.g. when both a closing response and a closing network request it
+	if (this->txClosed)
+		return;
+	this->txClosed = true;
+	
+#ifdef WITH_TLS
+	if (this->tls) {
+		// send close_notify, then close when the other side answers with its close_notify or closes the connection
+		addReference();
+		this->tls->async_shutdown(makeHandler(this->handlerMemory, [this] (error_code error) {
+			if (!isCanceled(error))
+				close();
+			
+			// remove reference to this object
+			removeReference();
+		}));
+		return;
+	}
+#endif
+	error_code error;
+	this->socket.shutdown(asio::socket_base::shutdown_type::shutdown_send, error);
+}
+
+void Channel::shutdownWhenSent() {
+	if (this->txQueue.empty() && this->txWriting.empty()) {
+		shutdown();
+		return;
+	}
+	
+	// written() shuts down when the queue is empty
+	this->txShutdown = true;
 }
 
 void Channel::close() {
 	if (this->socket.is_open()) {
-		// cancel timeout timer
-		this->timer.cancel();
+		// remove from timer wheel
+		if (this->wheel)
+			this->wheel->remove(this);
 		
+#ifdef WITH_TLS
+		// mark the session as properly shut down, otherwise OpenSSL removes it from the session cache
+		if (this->tls)
+			SSL_set_shutdown(this->tls->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+#endif
+
 		// close socket (also cancels pending read/write requests)
 		error_code error;
 		this->socket.close(error);
 		if (error)
 			onError(error);
 		
+		// remove connection from the count of the server
+		if (this->server) {
+			--this->server->connectionCount;
+			this->server = nullptr;
+		}
+		
 		// remove reference for the open socket, may delete this object
 		removeReference();
 	}
 }
 
+bool Channel::isIdle() {
+	return false;
+}
+
+void Channel::connect(asio::generic::stream_protocol::endpoint const & endpoint, ptr<TimerWheel> wheel,
+	ptr<BufferPool> pool)
+{
+	// add a reference that keeps the channel alive until it is closed
+	addReference();
+	this->socket.async_connect(endpoint, makeHandler(this->handlerMemory, [this, wheel, pool] (error_code error) {
+		if (error) {
+			// keep alive while removing the reference for the connection and notifying the error
+			ptr<Channel> channel = this;
+			if (this->socket.is_open())
+				close();
+			else
+				removeReference();
+			onError(error);
+		} else {
+			start(wheel, pool);
+		}
+	}));
+}
+
+void Channel::start(ptr<TimerWheel> wheel, ptr<BufferPool> pool) {
+	this->wheel = wheel;
+	if (wheel && this->timeout > 0)
+		wheel->add(this);
+	this->rxPool = pool ? pool : ptr<BufferPool>(new BufferPool());
+	
+	// receive with non-blocking reads after waiting for available data
+	error_code error;
+	this->socket.non_blocking(true, error);
+
+#ifdef WITH_TLS
+	if (this->tlsContext) {
+		handshake();
+		return;
+	}
+#endif
+
+	// notify established connection
+	onConnect();
+
+	// start receiving
+	receive();
+}
+
+#ifdef WITH_TLS
+void Channel::handshake() {
+	this->tls.reset(new asio::ssl::stream<asio::generic::stream_protocol::socket &>(this->socket,
+		this->tlsContext->context));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	// add reference to this object until async_handshake completes
+	addReference();
+	this->tls->async_handshake(asio::ssl::stream_base::server, makeHandler(this->handlerMemory,
+		[this, start] (error_code error)
+	{
+		if (error) {
+			if (!isCanceled(error)) {
+				this->tlsContext->addFailure();
+				onError(error);
+				close();
+			}
+		} else {
+			touch();
+			int64_t microseconds = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - start).count();
+			this->tlsContext->addHandshake(SSL_session_reused(this->tls->native_handle()) != 0, microseconds);
+
+			// notify established connection
+			onConnect();
+
+			// start receiving
+			receive();
+		}
+
+		// remove reference to this object
+		removeReference();
+	}));
+}
+#endif
+
 void Channel::onReadyToSend() {
 }
 
 void Channel::receive() {
-	// add reference to this object until async_wait completes
+	// add reference to this object until async_read_some completes
 	addReference();
+	this->rxActive = true;
+
+#ifdef WITH_TLS
+	if (this->tls) {
+		// the stream may already hold decrypted data, therefore read directly into a buffer of the pool
+		uint8_t * buffer = this->rxPool->allocate();
+		this->tls->async_read_some(
+				asio::buffer(buffer, BufferPool::BUFFER_SIZE),
+				makeHandler(this->handlerMemory, [this, buffer] (error_code error, size_t readCount) {
+					this->rxActive = false;
+					received(error, buffer, readCount);
+				}));
+		return;
+	}
+#endif
 
-	// restart timeout timer
-	this->timer.expires_from_now(std::chrono::milliseconds(this->timeout));
-	this->timer.async_wait([this] (error_code error) {
+	// wait until data is available without occupying a receive buffer
+	this->socket.async_read_some(
+			asio::null_buffers(),
+			makeHandler(this->handlerMemory, [this] (error_code error, size_t) {
+				this->rxActive = false;
+				uint8_t * buffer = nullptr;
+				size_t readCount = 0;
 				if (!error) {
-					onTimeout();
+					// take a buffer from the pool and read available data (socket is non-blocking)
+					buffer = this->rxPool->allocate();
+					readCount = this->socket.read_some(asio::buffer(buffer, BufferPool::BUFFER_SIZE), error);
 				}
+				received(error, buffer, readCount);
+			}));
+}
 
-				// remove reference to this object
-				removeReference();
-			});
+void Channel::received(error_code error, uint8_t * buffer, size_t readCount) {
+	if (error) {
+		if (error == asio::error::would_block || error == asio::error::try_again) {
+			// spurious wakeup: wait again
+			receive();
+		} else if (isCanceled(error)) {
+			//std::cout << "canceled" << std::endl;
+		} else if (isEof(error)) {
+			onShutdown();
+		} else {
+			onError(error);
+		}
+	} else {
+		touch();
+		onData(buffer, readCount);
 
-	// add reference to this object until async_read_some completes
+		// continue receiving unless paused or closed by onData()
+		if (!this->rxPaused && this->socket.is_open())
+			receive();
+	}
+	
+	// return buffer to the pool
+	if (buffer != nullptr)
+		this->rxPool->free(buffer);
+
+	// remove reference to this object
+	removeReference();
+}
+
+void Channel::flush() {
+	touch();
+
+	TxBuffer & front = this->txQueue.front();
+	if (front.file) {
+#ifdef WITH_TLS
+		if (this->tls) {
+			// read the next part of the file and write it like other data
+			std::string part = newBuffer();
+			part.resize(std::min(front.length, size_t(FILE_PART_LENGTH)));
+			ssize_t n = ::pread(front.file->fd, &part[0], part.length(), front.fileOffset);
+			if (n <= 0) {
+				// file got truncated or can't be read
+				onError(error_code(n < 0 ? errno : EIO, std::system_category()));
+				close();
+				return;
+			}
+			part.resize(size_t(n));
+			front.fileOffset += n;
+			front.length -= size_t(n);
+			if (front.length == 0) {
+				front = {std::move(part), nullptr, 0, nullptr, nullptr, 0};
+			} else {
+				this->txQueue.insert(this->txQueue.begin(), {std::move(part), nullptr, 0, nullptr, nullptr, 0});
+				++this->txPending;
+			}
+		} else
+#endif
+		{
+			// send the file on its own
+			this->txWriting.push_back(std::move(front));
+			this->txQueue.erase(this->txQueue.begin());
+			writeFile();
+			return;
+		}
+	}
+
+	// take all queued buffers up to the next file
+	auto end = std::find_if(this->txQueue.begin(), this->txQueue.end(), [] (TxBuffer const & buffer) {
+		return bool(buffer.file);
+	});
+	if (end == this->txQueue.end()) {
+		std::swap(this->txQueue, this->txWriting);
+	} else {
+		std::move(this->txQueue.begin(), end, std::back_inserter(this->txWriting));
+		this->txQueue.erase(this->txQueue.begin(), end);
+	}
+	this->txBuffers.clear();
+	for (TxBuffer const & buffer : this->txWriting) {
+		if (buffer.borrowed != nullptr)
+			this->txBuffers.push_back(asio::buffer(buffer.borrowed, buffer.length));
+		else
+			this->txBuffers.push_back(asio::buffer(buffer.data));
+	}
+
+	// add reference to this object until async_write completes
 	addReference();
 
-	// receive data
-	this->socket.async_read_some(
-			asio::buffer(this->rxBuffer, sizeof(this->rxBuffer)),
-			[this] (error_code error, size_t readCount) {
-				if (error) {
-					if (isCanceled(error)) {
-						//std::cout << "canceled" << std::endl;
-					} else if (isEof(error)) {
-						onShutdown();
-					} else {
-						onError(error);
-					}
-				} else {
-					// continue receiving
-					receive();
-
-					onData(this->rxBuffer, readCount);
-				}
+	// send all buffers with one gather write (TLS encrypts them in turn)
+	auto handler = makeHandler(this->handlerMemory, [this] (error_code error, size_t writtenCount) {
+		written(error);
+
+		// remove reference to this object
+		removeReference();
+	});
+#ifdef WITH_TLS
+	if (this->tls) {
+		asio::async_write(*this->tls, TxBufferSequence{&this->txBuffers}, handler);
+		return;
+	}
+#endif
+	asio::async_write(this->socket, TxBufferSequence{&this->txBuffers}, handler);
+}
+
+void Channel::writeFile() {
+	touch();
+	TxBuffer & buffer = this->txWriting.front();
+	
+	// the kernel copies from the page cache to the socket until the socket buffer is full
+	error_code error;
+	this->socket.native_non_blocking(true, error);
+	while (!error && buffer.length > 0) {
+		off_t offset = off_t(buffer.fileOffset);
+		ssize_t n = ::sendfile(this->socket.native_handle(), buffer.file->fd, &offset, buffer.length);
+		if (n > 0) {
+			buffer.fileOffset = offset;
+			buffer.length -= size_t(n);
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			// wait until the socket is writable again
+			addReference();
+			this->socket.async_write_some(asio::null_buffers(), makeHandler(this->handlerMemory,
+				[this] (error_code error, size_t)
+			{
+				if (error)
+					written(error);
+				else
+					writeFile();
 
 				// remove reference to this object
 				removeReference();
-			});
+			}));
+			return;
+		} else if (n < 0 && errno != EINTR) {
+			error = error_code(errno, std::system_category());
+		} else if (n == 0) {
+			// file got truncated
+			error = error_code(EIO, std::system_category());
+		}
+	}
+	written(error);
+}
+
+void Channel::written(error_code error) {
+	this->txPending -= int(this->txWriting.size());
+	touch();
+	
+	// keep written buffers for reuse
+	for (TxBuffer & buffer : this->txWriting) {
+		if (buffer.data.capacity() > std::string().capacity() && this->txFree.size() < MAX_FREE_BUFFERS) {
+			buffer.data.clear();
+			this->txFree.push_back(std::move(buffer.data));
+		}
+	}
+	this->txWriting.clear();
+	if (error) {
+		onError(error);
+	} else if (!this->txQueue.empty()) {
+		// send buffers that were queued in the meantime
+		flush();
+	} else if (this->txShutdown) {
+		// all data is written, the other side gets eof (after close_notify in case of TLS)
+		this->txShutdown = false;
+		shutdown();
+	} else {
+		// notify when new data is needed to be sent
+		onReadyToSend();
+	}
+}
+
+void Channel::resumeReceive() {
+	if (this->rxPaused) {
+		this->rxPaused = false;
+		if (!this->rxActive && this->socket.is_open())
+			receive();
+	}
 }
 
 void Channel::onShutdown() {
@@ -3,41 +3,118 @@
 #include <string>
 #include <vector>
 #include <system_error>
+#include "BufferPool.hpp"
+#include "File.hpp"
+#include "HandlerMemory.hpp"
 #include "Server.hpp"
+#include "TimerWheel.hpp"
+#ifdef WITH_TLS
+#include <memory>
+#include "TlsContext.hpp"
+#endif
 
 
 ///
-/// TCP communication channel with inactivity timeout
+/// Stream communication channel (TCP or UNIX domain socket) with inactivity timeout
 class Channel : public Object {
 	friend class Server;
+	friend class TimerWheel;
 public:
 	///
 	/// Constructor
 	/// @param loop event loop for asynchronous io
-	/// @param timeout inactivity timeout in milliseconds after which onTimeout() gets called
+	/// @param timeout inactivity timeout in milliseconds after which onTimeout() gets called (when the channel was
+	/// started with a timer wheel)
 	Channel(asio::io_service & loop, int timeout);
 
 	~Channel() override;
 	
 	///
-	/// send data, only call from the event loop thread
+	/// connect to a server and start the channel when the connection is established (client mode)
+	/// @param endpoint ipv4 or ipv6 address (asio::ip::tcp::endpoint) or path (asio::local::stream_protocol::endpoint)
+	/// @param wheel timer wheel for the inactivity timeout, no timeout if null
+	/// @param pool pool of receive buffers shared by the channels of the event loop, the channel creates its own if null
+	void connect(asio::generic::stream_protocol::endpoint const & endpoint, ptr<TimerWheel> wheel,
+		ptr<BufferPool> pool);
+
+	///
+	/// send data, only call from the event loop thread. The data gets copied, consecutive calls while a write is in
+	/// flight are coalesced into one buffer
 	virtual void sendData(uint8_t const * data, size_t length);
 	
 	///
 	/// send string as data
 	void sendData(std::string const & data) {sendData((uint8_t const *)data.data(), data.length());}
+
+	///
+	/// send string as data, takes ownership of the string without copying
+	void sendData(std::string && data);
+
+	///
+	/// send data without copying, the data has to stay valid until the channel is deleted (e.g. static data)
+	void sendStatic(uint8_t const * data, size_t length);
+
+	///
+	/// send data without copying, the owner is referenced until the data was written (e.g. a shared immutable buffer)
+	void sendShared(ptr<Object> owner, uint8_t const * data, size_t length);
+
+	///
+	/// send a range of a file without copying it into user space (sendfile), on TLS connections the file is read in
+	/// parts as the data gets encrypted
+	void sendFile(ptr<File> file, int64_t offset, size_t length);
+
+	///
+	/// get an empty buffer for building data to send with sendData(std::move(buffer)). The buffer is recycled from
+	/// previous writes so that it typically does not need to allocate memory
+	std::string newBuffer();
 	
+	///
+	/// set the inactivity timeout, e.g. to disable it for long-lived streams
+	/// @param timeout inactivity timeout in milliseconds, no timeout if zero
+	void setTimeout(int timeout);
+
 	///
 	/// shutdown the connection which triggers onShutdown() on the other side
-	/// (lowlevel: we call shutdown() for write which causes socket on other side to signal eof)
+	/// (lowlevel: we call shutdown() for write which causes socket on other side to signal eof). A TLS connection sends
+	/// close_notify instead and gets closed when the other side has answered it
 	void shutdown();
+
+	///
+	/// shutdown the connection after all queued data was written, e.g. after the last frame of a response. Data that
+	/// gets sent in the meantime is still written before the shutdown
+	void shutdownWhenSent();
 	
 	///
 	/// close the channel. default implementation also deletes this channel
 	virtual void close();
 
+	///
+	/// returns true if the channel can be closed without losing data, e.g. an idle keep-alive connection. Idle channels
+	/// get closed when a server reaches its connection limit. default implementation returns false
+	virtual bool isIdle();
+
 protected:
 
+	///
+	/// start the channel after the connection was established: add it to the timer wheel, call onConnect() and start
+	/// receiving
+	/// @param wheel timer wheel for the inactivity timeout, no timeout if null
+	/// @param pool pool of receive buffers shared by the channels of the event loop, the channel creates its own if null
+	void start(ptr<TimerWheel> wheel, ptr<BufferPool> pool);
+
+#ifdef WITH_TLS
+	///
+	/// perform the server side TLS handshake, then call onConnect() and start receiving
+	void handshake();
+#endif
+
+	///
+	/// note activity on the channel which restarts the inactivity timeout
+	void touch() {
+		if (this->wheel)
+			this->lastActivity = this->wheel->now();
+	}
+
 	///
 	/// called when a client or server connection was established. Receiving is already enabled
 	virtual void onConnect() = 0;
@@ -49,6 +126,30 @@ protected:
 	
 	void receive();
 	
+	///
+	/// handle the result of a read, the buffer is returned to the pool
+	void received(error_code error, uint8_t * buffer, size_t readCount);
+
+	///
+	/// stop receiving data after the current onData() returns, e.g. when too many requests are pending
+	void pauseReceive() {this->rxPaused = true;}
+	
+	///
+	/// continue receiving data after pauseReceive()
+	void resumeReceive();
+	
+	///
+	/// write all queued buffers up to the next file with one gather write
+	void flush();
+
+	///
+	/// send the file at the head of the write queue with sendfile() until the socket would block
+	void writeFile();
+
+	///
+	/// handle the completion of a write, continue with queued buffers or call onReadyToSend()
+	void written(error_code error);
+
 	///
 	/// called when new data arrived
 	virtual void onData(uint8_t const * data, size_t length) = 0;
@@ -67,9 +168,74 @@ protected:
 	virtual void onError(std::error_code error) = 0;
 
 
-	asio::ip::tcp::socket socket;
-	asio::steady_timer timer;
+	// buffer in the send queue, either owned data, borrowed data that stays valid (optionally kept alive by owner) or
+	// length bytes of a file starting at fileOffset
+	struct TxBuffer {
+		std::string data;
+		uint8_t const * borrowed;
+		size_t length;
+		ptr<Object> owner;
+		ptr<File> file;
+		int64_t fileOffset;
+	};
+
+	// memory for the asynchronous operations, declared before the socket so that it outlives them
+	HandlerMemory handlerMemory;
+
+	// stream socket of any protocol, e.g. TCP or UNIX domain
+	asio::generic::stream_protocol::socket socket;
+
+#ifdef WITH_TLS
+	// TLS configuration if the server accepts TLS connections and TLS stream on top of the socket
+	ptr<TlsContext> tlsContext;
+	std::unique_ptr<asio::ssl::stream<asio::generic::stream_protocol::socket &>> tls;
+#endif
+	
+	// server that accepted the connection, counts the open connections
+	ptr<Server> server;
+	
+	// inactivity timeout
+	ptr<TimerWheel> wheel;
 	int timeout;
+	uint32_t lastActivity = 0;
+	int wheelSlot = -1;
+	Channel * wheelPrev = nullptr;
+	Channel * wheelNext = nullptr;
+	
+	// number of buffers that are queued or currently being written
 	int txPending;
-	uint8_t rxBuffer[4096];
+	
+	// buffers queued while a write is in flight and buffers of the write in flight
+	std::vector<TxBuffer> txQueue;
+	std::vector<TxBuffer> txWriting;
+	std::vector<asio::const_buffer> txBuffers;
+	
+	///
+	/// Buffer sequence that refers to txBuffers. asio copies the buffer sequence of a write operation whenever it moves
+	/// the operation, copies of this don't allocate
+	struct TxBufferSequence {
+		using value_type = asio::const_buffer;
+		using const_iterator = std::vector<asio::const_buffer>::const_iterator;
+		
+		const_iterator begin() const {return this->buffers->begin();}
+		const_iterator end() const {return this->buffers->end();}
+		
+		std::vector<asio::const_buffer> const * buffers;
+	};
+	
+	// shutdown requested by shutdownWhenSent() that waits for the queued buffers and shutdown was done
+	bool txShutdown = false;
+	bool txClosed = false;
+	
+	// written buffers for reuse by newBuffer()
+	enum {MAX_FREE_BUFFERS = 4};
+	
+	// size of the parts a file is read in when it can't be sent with sendfile()
+	enum {FILE_PART_LENGTH = 16384};
+	std::vector<std::string> txFree;
+	
+	// receive state, a buffer is taken from the pool only while received data is available
+	ptr<BufferPool> rxPool;
+	bool rxActive = false;
+	bool rxPaused = false;
 };
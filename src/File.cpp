@@ -0,0 +1,7 @@
+#include <unistd.h> // close
+#include "File.hpp"
+
+
+File::~File() {
+	::close(this->fd);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "Object.hpp"
+
+
+///
+/// Open file that is shared by a cache and the send queues of channels. The file descriptor is closed when the last
+/// reference is gone, therefore a file that gets replaced on disk can still be sent until the end
+class File : public Object {
+public:
+	///
+	/// Constructor
+	/// @param fd file descriptor, gets owned by this object
+	File(int fd) : fd(fd) {}
+
+	~File() override;
+
+	int fd;
+};
@@ -1,150 +1,971 @@
 #include <stdlib.h> // strtol
+#include <strings.h> // strncasecmp
+#include <netinet/in.h> // sockaddr_in
+#include <algorithm>
+#include <set>
+#include "cast.hpp"
 #include "Gateway.hpp"
+#include "http/FormParser.hpp"
+#include "http/JsonParser.hpp"
+#include "http/JsonWriter.hpp"
+#include "http/Query.hpp"
 
 
-namespace {
-	
-	// decode query string
-	std::string decodeQuery(std::string const & s, size_t start, size_t end) {
-		std::string r;
-		for (size_t i = start; i < end; ++i) {
-			char ch = s[i];
-			if (ch == '+') {
-				ch = ' ';
-			} else if (ch == '%') {
-				// check if two characters follow
-				if (i + 2 >= end)
+// compare case insensitive
+static bool equals(string_view a, string_view b) {
+	return a.length() == b.length() && strncasecmp(a.data(), b.data(), a.length()) == 0;
+}
+
+// quality in thousandths of a media type in an Accept header, the most specific matching media range counts
+static int getQuality(string_view accept, string_view type) {
+	int quality = 0;
+	int specificity = -1;
+	size_t position = 0;
+	while (position < accept.length()) {
+		size_t end = std::min(accept.find(',', position), accept.length());
+		
+		// "application/json", " text/*;q=0.5" or "*/*"
+		size_t i = position;
+		while (i < end && accept[i] == ' ')
+			++i;
+		size_t j = i;
+		while (j < end && accept[j] != ';' && accept[j] != ' ')
+			++j;
+		string_view range = accept.substr(i, j - i);
+		int s = -1;
+		if (equals(range, type))
+			s = 2;
+		else if (range.length() >= 2 && range[range.length() - 1] == '*' && range[range.length() - 2] == '/'
+			&& equals(range.substr(0, range.length() - 1), type.substr(0, range.length() - 1)))
+			s = range.length() == 3 && range[0] == '*' ? 0 : 1;
+		if (s > specificity) {
+			// weight "q=1", "q=0.8" or "q=0.125", default is 1
+			specificity = s;
+			quality = 1000;
+			for (size_t k = j; k + 1 < end; ++k) {
+				if (accept[k] == 'q' && accept[k + 1] == '=') {
+					quality = 0;
+					int scale = 1000;
+					for (k += 2; k < end && accept[k] != ';' && accept[k] != ' '; ++k) {
+						char ch = accept[k];
+						if (ch == '.') {
+							scale = 100;
+						} else if (ch >= '0' && ch <= '9') {
+							quality += (ch - '0') * scale;
+							if (scale < 1000)
+								scale /= 10;
+						}
+					}
 					break;
-				
-				// convert next two characters to hex
-				ch = 0;
-				for (int j = 1; j < 3; ++j) {
-					ch <<= 4;
-					char hex = s[i + j];
-					if (hex >= '0' && hex <= '9')
-						ch += hex - '0';
-					else if (hex >= 'a' && hex <= 'f')
-						ch += hex - 'a' + 10;
-					else if (hex >= 'A' && hex <= 'F')
-						ch += hex - 'A' + 10;
 				}
-				i += 2;
 			}
-			r += ch;
 		}
-		return r;
+		position = end + 1;
 	}
-	
-	// encode query string
-	std::string encodeQuery(std::string const & s) {
-		std::string r;
-		for (unsigned char ch : s) {
-			if (ch == '-' || ch == '.' || ch == '_' || ch == '~'
-					|| (ch >= 'A' && ch <= 'Z')
-					|| (ch >= 'a' && ch <= 'z')
-					|| (ch >= '0' && ch <= '9')) {
-				// not reserved character
-				r += ch;
-			} else if (ch == ' ') {
-				// space
-				r += '+';
-			} else {
-				// hex escape
-				static char const hex[] = "0123456789ABCDEF";
-				r += '%';
-				r += hex[ch >> 4];
-				r += hex[ch & 15];
+	return quality;
+}
+
+// check if the client prefers JSON to form, e.g. "Accept: application/json". Form is the default if both are equal
+static bool acceptsJson(string_view accept) {
+	return getQuality(accept, "application/json") > getQuality(accept, "application/x-www-form-urlencoded");
+}
+
+// check if a content type is JSON, e.g. "application/json; charset=utf-8" or "application/merge-patch+json"
+static bool isJson(string_view contentType) {
+	size_t end = std::min(contentType.find(';'), contentType.length());
+	while (end > 0 && contentType[end - 1] == ' ')
+		--end;
+	return end >= 5 && (contentType[end - 5] == '/' || contentType[end - 5] == '+')
+		&& strncasecmp(contentType.data() + end - 4, "json", 4) == 0;
+}
+
+
+// Watcher
+
+Gateway::Watcher::~Watcher() {
+}
+
+void Gateway::Watcher::onChanged(uint32_t nodeId, Parameters const & parameters) {
+	// continue on the event loop of the gateway
+	ptr<Gateway> gateway = this->gateway;
+	gateway->socket.get_io_service().post([gateway, nodeId, parameters] () {
+		gateway->onChanged(nodeId, parameters);
+	});
+}
+
+void Gateway::Watcher::onClose() {
+	// continue on the event loop of the gateway
+	ptr<Gateway> gateway = this->gateway;
+	gateway->socket.get_io_service().post([gateway] () {
+		gateway->onNetworkClose();
+	});
+}
+
+
+// NodesSource
+
+Gateway::NodesSource::~NodesSource() {
+}
+
+bool Gateway::NodesSource::read(std::string & buffer, size_t maxLength) {
+	size_t start = buffer.length();
+	if (this->json && this->index == 0)
+		buffer += '[';
+	while (this->index < this->nodes.size()) {
+		auto const & node = this->nodes[this->index];
+		std::string const & data = this->json ? node.second->json : node.second->data;
+		
+		// stop if the line does not fit, but append at least one line
+		if (buffer.length() > start && buffer.length() - start + data.length() + 20 > maxLength)
+			break;
+		if (this->json) {
+			// copy the members of the pre-rendered object after the node id
+			if (this->index > 0)
+				buffer += ',';
+			buffer += "{\"node\":";
+			append(buffer, node.first);
+			if (data.length() > 2)
+				buffer += ',';
+			buffer.append(data, 1, std::string::npos);
+		} else {
+			buffer += "node=";
+			append(buffer, node.first);
+			if (!data.empty()) {
+				buffer += '&';
+				buffer += data;
 			}
+			buffer += '\n';
 		}
-		return r;
+		++this->index;
 	}
+	if (this->index < this->nodes.size())
+		return true;
+	if (this->json)
+		buffer += ']';
+	return false;
+}
+
+
+// Upload
+
+Gateway::Upload::Upload(asio::io_service & loop)
+		: timer(loop) {
+}
+
+Gateway::Upload::~Upload() {
 }
 
+
+// Gateway
+
 Gateway::~Gateway() {
 }
 
-void Gateway::onRequest(Method method, std::string url, Headers headers) {
-	Url u(url);
+void Gateway::onConnect() {
+	HttpChannel::onConnect();
+	
+	// use the ip address of the client as key for rate limiting, all clients on a unix domain socket share one key
+	error_code error;
+	asio::generic::stream_protocol::endpoint endpoint = this->socket.remote_endpoint(error);
+	if (!error) {
+		sockaddr const * address = endpoint.data();
+		if (address->sa_family == AF_INET)
+			this->client.assign((char const *)&((sockaddr_in const *)address)->sin_addr, 4);
+		else if (address->sa_family == AF_INET6)
+			this->client.assign((char const *)&((sockaddr_in6 const *)address)->sin6_addr, 16);
+	}
+}
+
+void Gateway::onRequest(Request const & request) {
+	// find handler
+	RouteParameters parameters;
+	Handler const * handler = getRouter().find(request.method, request.path, parameters);
+	if (handler == nullptr) {
+		if (this->files && (request.method == Method::GET || request.method == Method::HEAD))
+			handleFile(request);
+		else
+			sendNotFound(getRequestId(), isKeepAlive());
+		return;
+	}
+	(this->**handler)(request, parameters);
+}
+
+void Gateway::onBody(uint8_t const * data, size_t length) {
+	// decode the body part by part, fields arrive in onField() and onRecord()
+	if (this->bodyParser && !this->bodyParser->parse(data, length)) {
+		// invalid body, too many fields or a batch failed: discard the rest of the body
+		this->bodyParser.reset();
+		if (this->upload->status == 200)
+			this->upload->status = 400;
+	}
+}
+
+void Gateway::onEnd() {
+	if (!this->upload)
+		return;
+	if (this->bodyParser && !this->bodyParser->finish() && this->upload->status == 200)
+		this->upload->status = 400;
+	this->bodyParser.reset();
+	ptr<Upload> upload = this->upload;
+	this->upload = nullptr;
+	
+	if (upload->nodeId && upload->status == 200) {
+		// single node: set the parameters of query and body with one command
+		handleNode(Method::POST, *upload->nodeId, upload->record, 0, std::string(), false);
+	} else {
+		// send the last batch, the response is sent when all batches have returned
+		sendUpload(upload);
+		upload->ended = true;
+		endUpload(upload);
+	}
+}
+
+void Gateway::onAbort() {
+	// the client reset the stream of an upload: continue receiving the other streams
+	if (this->upload && this->upload->paused) {
+		this->upload->paused = false;
+		resumeBody();
+	}
+	abortUpload();
+}
+
+bool Gateway::onField(string_view key, string_view value) {
+	Parameters & record = this->upload->record;
+	record.parameters[key.str()].assign(value.data(), value.length());
+	if (record.parameters.size() > MAX_RECORD_FIELDS) {
+		this->upload->status = 413;
+		return false;
+	}
+	return true;
+}
+
+bool Gateway::onRecord() {
+	ptr<Upload> const & upload = this->upload;
+	
+	// stop parsing when a batch was not admitted
+	if (upload->status != 200)
+		return false;
+	
+	// single node: all records add to the parameters of the node
+	if (upload->nodeId)
+		return true;
+	
+	Parameters & record = upload->record;
+	optional<uint16_t> nodeId = record.getWord("node");
+	if (!nodeId) {
+		// empty records are ignored
+		if (record.parameters.empty())
+			return true;
+		upload->status = 400;
+		return false;
+	}
+	record.parameters.erase("node");
+	upload->sets.emplace_back(*nodeId, std::move(record));
+	record.parameters.clear();
+	
+	if (upload->sets.size() >= MAX_BATCH)
+		sendUpload(upload);
+	return true;
+}
+
+void Gateway::onMessage(uint8_t const * data, size_t length, bool binary) {
+	// message is a query string "node=4&position.blinds=50", without further parameters the state is requested
+	Parameters parameters;
+	parseQuery(string_view((char const *)data, length), parameters);
+	optional<uint16_t> nodeId = parameters.getWord("node");
+	if (!nodeId)
+		return;
+	parameters.parameters.erase("node");
+	uint32_t id = *nodeId;
+	
+	// add reference to this object until the network has been accessed
+	addReference();
+	
+	// access the network on its own event loop
+	ptr<ZWaveNetwork> network = this->network;
+	network->loop.dispatch([this, network, id, parameters] () {
+		Parameters tracked;
+		bool get = parameters.parameters.empty();
+		int status = 200;
+		int retryAfter = 0;
+		bool found;
+		if (get) {
+			found = network->get(id, tracked);
+		} else {
+			// send parameters to node if admitted
+			status = admit(1, retryAfter);
+			found = status == 200 && network->sendSet(id, parameters);
+		}
+		
+		// continue on the event loop of this channel, changes caused by a set arrive via onChanged()
+		this->socket.get_io_service().dispatch([this, id, get, status, retryAfter, found, tracked] () {
+			if (this->socket.is_open()) {
+				if (status != 200 && this->webSocketOpen) {
+					// rejected by admission control: tell the client when to retry like the Retry-After header
+					std::string message = "node=";
+					append(message, id);
+					message += "&status=";
+					append(message, status);
+					message += "&retryAfter=";
+					append(message, retryAfter);
+					sendMessage(message);
+				} else if (get && found) {
+					onChanged(id, tracked);
+				}
+			}
+			
+			// remove reference to this object
+			removeReference();
+		});
+	});
+}
+
+void Gateway::close() {
+	// stop event stream, WebSocket and long-poll requests
+	this->events = false;
+	this->webSocketOpen = false;
+	this->waits.clear();
+	unwatch();
+	abortUpload();
+	
+	HttpChannel::close();
+}
+
+Router<Gateway::Handler> const & Gateway::getRouter() {
+	static Router<Handler> const router = [] () {
+		Router<Handler> r;
+		r.add(Method::GET, "/node/:id", &Gateway::routeNode);
+		r.add(Method::POST, "/node/:id", &Gateway::routeNode);
+		r.add(Method::GET, "/nodes", &Gateway::routeNodes);
+		r.add(Method::POST, "/nodes", &Gateway::routeSetNodes);
+		r.add(Method::GET, "/events", &Gateway::routeEvents);
+		r.add(Method::GET, "/ws", &Gateway::routeWebSocket);
+#ifdef WITH_TLS
+		r.add(Method::GET, "/tls", &Gateway::routeTls);
+#endif
+		return r;
+	}();
+	return router;
+}
+
+void Gateway::routeNode(Request const & request, RouteParameters const & parameters) {
+	optional<uint32_t> nodeId = cast<uint32_t>(parameters[0]);
+	if (parameters[0].empty() || !nodeId) {
+		sendNotFound(getRequestId(), isKeepAlive());
+		return;
+	}
+
+	// parse query
+	Parameters p;
+	parseQuery(request.query, p);
+	
+	// get optional wait time for long-poll, it is not a parameter of the node
+	int wait = 0;
+	if (optional<uint16_t> w = p.getWord("wait"))
+		wait = std::min(int(*w), int(MAX_WAIT));
+	p.parameters.erase("wait");
+	
+	// parameters to set may also be in the body
+	if (request.method == Method::POST) {
+		handleUpload(*nodeId, std::move(p), request.getHeader(Header::CONTENT_TYPE));
+		return;
+	}
+	
+	handleNode(request.method, *nodeId, p, wait, request.getHeader(Header::IF_NONE_MATCH).str(),
+		acceptsJson(request.getHeader(Header::ACCEPT)));
+}
+
+void Gateway::routeNodes(Request const & request, RouteParameters const & parameters) {
+	Parameters p;
+	parseQuery(request.query, p);
+	handleNodes(p.parameters["fields"], acceptsJson(request.getHeader(Header::ACCEPT)));
+}
+
+void Gateway::routeSetNodes(Request const & request, RouteParameters const & parameters) {
+	handleUpload(nullptr, Parameters(), request.getHeader(Header::CONTENT_TYPE));
+}
+
+void Gateway::routeEvents(Request const & request, RouteParameters const & parameters) {
+	// the data of the events is JSON if the client accepts it besides text/event-stream
+	handleEvents(acceptsJson(request.getHeader(Header::ACCEPT)));
+}
 
-	// parse path
-	std::string path = u.getPath();
+void Gateway::routeWebSocket(Request const & request, RouteParameters const & parameters) {
+	handleWebSocket(request);
+}
+
+#ifdef WITH_TLS
+void Gateway::routeTls(Request const & request, RouteParameters const & parameters) {
+	// handshake statistics of the server that accepted this connection, only available over TLS
+	if (!this->tlsContext) {
+		sendNotFound(getRequestId(), isKeepAlive());
+		return;
+	}
+	std::string data;
+	this->tlsContext->getStats(data);
+
+	uint32_t requestId = getRequestId();
+	Response response(*this, 200, "OK");
+	response.addHeaders(Gateway::defaultHeaders);
+	if (!isKeepAlive())
+		response.addClose();
+	response.addContent("text/plain", data.length());
+	sendResponse(response);
+	sendBody(requestId, std::move(data));
+	endResponse(requestId);
+}
+#endif
+
+void Gateway::handleNode(Method method, uint32_t nodeId, Parameters const & parameters, int wait,
+	std::string const & ifNoneMatch, bool json)
+{
+	bool keepAlive = isKeepAlive();
+	uint32_t requestId = getRequestId();
+	
+	// long-poll: listen for changes before the state is read so that a change in between is not lost
+	if (wait > 0)
+		addWait(requestId, nodeId, keepAlive, json, wait);
 	
-	std::string prefix("/node/");
-	if (!path.compare(0, prefix.size(), prefix)) {
-		int nodeId = atoi(path.data() + prefix.size());
+	// add reference to this object until the network has been accessed
+	addReference();
 	
+	// access the network on its own event loop
+	ptr<ZWaveNetwork> network = this->network;
+	ptr<StateCache> cache = this->cache;
+	network->loop.dispatch([this, network, cache, method, nodeId, parameters, wait, ifNoneMatch, json, keepAlive,
+		requestId] ()
+	{
+		ptr<StateCache::Body> body;
+		bool found = false;
+		bool open = network->isOpen();
+		int status = 200;
+		int retryAfter = 0;
 		if (method == Method::POST) {
-			// parse query
-			Parameters parameters;
-			std::string query = u.getQuery();
-			size_t argStartPos = 0;
-			while (argStartPos < query.length()) {
-				// get an argument
-				size_t argEndPos = query.find('&', argStartPos);
-				if (argEndPos == std::string::npos)
-					argEndPos = query.length();
-
-				// split argument into key and value
-				size_t eqPos = query.find('=', argStartPos);
-				if (eqPos != std::string::npos && eqPos < argEndPos) {
-					std::string key = query.substr(argStartPos, eqPos - argStartPos);
-					std::string value = decodeQuery(query, eqPos + 1, argEndPos);
-
-					parameters.parameters[key] = value;
+			// send parameters to node if admitted
+			status = admit(1, retryAfter);
+			found = status == 200 && network->sendSet(nodeId, parameters);
+		} else {
+			// get pre-rendered state of node
+			body = cache->getNode(nodeId);
+			found = body != nullptr;
+		}
+	
+		// continue on the event loop of this channel
+		this->socket.get_io_service().dispatch([this, method, nodeId, open, status, retryAfter, found, body, wait,
+			ifNoneMatch, json, keepAlive, requestId] ()
+		{
+			if (this->socket.is_open()) {
+				// close the connection after the response when the network was handed over to a new process
+				if (wait > 0) {
+					// long-poll: keep waiting for a change unless the node is unknown, the network was handed over or
+					// the client has an older version. The wait may already have been answered by a change
+					std::string const * etag = found ? (json ? &body->jsonEtag : &body->etag) : nullptr;
+					bool outdated = etag && !ifNoneMatch.empty() && ifNoneMatch != "*"
+						&& ifNoneMatch.find(*etag) == std::string::npos;
+					if ((!found || !open || outdated) && removeWait(requestId)) {
+						if (found)
+							sendNode(requestId, keepAlive && open, json, body, ifNoneMatch);
+						else
+							sendNotFound(requestId, keepAlive && open);
+					}
+				} else if (status != 200) {
+					sendRetryLater(requestId, keepAlive && open, status, retryAfter);
+				} else if (!found) {
+					sendNotFound(requestId, keepAlive && open);
+				} else if (method == Method::POST) {
+					sendEmpty(requestId, keepAlive, 200, "OK");
+				} else {
+					sendNode(requestId, keepAlive && open, json, body, ifNoneMatch);
 				}
-				
-				argStartPos = argEndPos + 1;
 			}
 			
-			// send parameters to node
-			if (this->network->sendSet(nodeId, parameters)) {
-				// send response
-				Response response(200, "OK");
+			// remove reference to this object
+			removeReference();
+		});
+	});
+}
+
+void Gateway::handleNodes(std::string const & fields, bool json) {
+	bool keepAlive = isKeepAlive();
+	uint32_t requestId = getRequestId();
+	
+	// split field names
+	std::set<std::string> fieldSet;
+	size_t start = 0;
+	while (start < fields.length()) {
+		size_t end = fields.find(',', start);
+		if (end == std::string::npos)
+			end = fields.length();
+		fieldSet.insert(fields.substr(start, end - start));
+		start = end + 1;
+	}
+	
+	// add reference to this object until the cache has been accessed
+	addReference();
+	
+	// access the cache on the event loop of the network
+	ptr<StateCache> cache = this->cache;
+	ptr<ZWaveNetwork> network = this->network;
+	this->network->loop.dispatch([this, network, cache, fieldSet, json, keepAlive, requestId] () {
+		// close the connection after the response when the network was handed over to a new process
+		bool close = !keepAlive || !network->isOpen();
+		
+		// all nodes: stream from a snapshot of the pre-rendered bodies, otherwise render the requested fields
+		ptr<NodesSource> source;
+		std::string data;
+		if (fieldSet.empty()) {
+			source = new NodesSource();
+			source->json = json;
+			cache->getNodes(source->nodes);
+		} else {
+			cache->getDocument(data, fieldSet, json);
+		}
+	
+		// continue on the event loop of this channel
+		this->socket.get_io_service().dispatch([this, source, data, json, close, requestId] () mutable {
+			if (this->socket.is_open()) {
+				Response response(*this, requestId, 200, "OK");
 				response.addHeaders(Gateway::defaultHeaders);
-				if (!isKeepAlive())
+				if (close)
 					response.addClose();
-				sendResponse(response);
-				return;
-			}
-		} else if (method == Method::GET) {
-			// get tracked parameters from node
-			Parameters parameters;
-			if (this->network->get(nodeId, parameters)) {
-				// build response body
-				std::string data;
-				for (std::pair<std::string, std::string> p : parameters.parameters) {
-					if (!data.empty())
-						data += '&';
-					data += p.first;
-					data += '=';
-					data += encodeQuery(p.second);
+				response.addHeaders("Vary: Accept\r\n");
+				char const * contentType = json ? "application/json" : "text/plain";
+				if (source) {
+					response.addHeader("Content-Type", contentType);
+					sendStream(response, source);
+				} else {
+					response.addContent(contentType, data.length());
+					sendResponse(response);
+					sendBody(requestId, std::move(data));
+					endResponse(requestId);
 				}
-				
-				// send response
-				Response response(200, "OK");
-				response.addHeaders(Gateway::defaultHeaders);
-				if (!isKeepAlive())
-					response.addClose();
-				response.addContent("application/x-www-form-urlencoded", data.length());
-				sendResponse(response);
-				sendData(data);
+			}
+			
+			// remove reference to this object
+			removeReference();
+		});
+	});
+}
+
+void Gateway::handleUpload(optional<uint32_t> nodeId, Parameters && parameters, string_view contentType) {
+	ptr<Upload> upload = new Upload(this->network->loop);
+	upload->requestId = getRequestId();
+	upload->keepAlive = isKeepAlive();
+	upload->nodeId = nodeId;
+	upload->record = std::move(parameters);
+	this->upload = upload;
+	
+	// the body is decoded as it arrives in onBody()
+	if (isJson(contentType))
+		this->bodyParser.reset(new JsonParser(*this));
+	else
+		this->bodyParser.reset(new FormParser(*this));
+}
+
+void Gateway::sendUpload(ptr<Upload> upload) {
+	std::vector<std::pair<uint32_t, Parameters>> sets;
+	std::swap(sets, upload->sets);
+	if (sets.empty() || upload->status != 200)
+		return;
+	++upload->pending;
+	
+	// add reference to this object until the batch has returned from the network
+	addReference();
+	
+	// access the network on its own event loop, the batch waits behind the batches that are not admitted yet
+	ptr<ZWaveNetwork> network = this->network;
+	network->loop.dispatch([this, upload, sets] () mutable {
+		upload->batches.push_back(std::move(sets));
+		if (upload->batches.size() == 1)
+			admitBatches(upload);
+	});
+	
+	// bound the memory of large bodies: stop receiving while too many batches wait for the network
+	if (upload->pending >= MAX_PENDING_BATCHES && !upload->paused) {
+		upload->paused = true;
+		pauseBody();
+	}
+}
+
+void Gateway::admitBatches(ptr<Upload> const & upload) {
+	ptr<ZWaveNetwork> const & network = this->network;
+	while (!upload->batches.empty()) {
+		bool open = network->isOpen();
+		int retryAfter = 0;
+		int status = upload->refused;
+		if (status == 200) {
+			// each record of the batch is charged to the rate limit of the client
+			status = admit(int(upload->batches.front().size()), retryAfter);
+			if ((status == 503 && open) || status == 429) {
+				// too many commands wait for the serial link or the client has no tokens left: try again later, receiving
+				// of the body gets paused while the batches wait
+				upload->timer.expires_from_now(status == 429 ? std::chrono::milliseconds(retryAfter * 1000)
+					: std::chrono::milliseconds(UPLOAD_RETRY_INTERVAL));
+				upload->timer.async_wait([this, upload] (error_code error) {
+					// cancelled when the upload was aborted, the remaining batches are dropped in abortUpload()
+					if (error == asio::error::operation_aborted)
+						return;
+					admitBatches(upload);
+				});
 				return;
 			}
+			upload->refused = status;
 		}
+		bool found = true;
+		if (status == 200) {
+			for (auto const & set : upload->batches.front()) {
+				found &= network->sendSet(set.first, set.second);
+			}
+		}
+		upload->batches.pop_front();
+		
+		// continue on the event loop of this channel
+		this->socket.get_io_service().dispatch([this, upload, open, status, retryAfter, found] () {
+			--upload->pending;
+			if (status != 200 && upload->status == 200) {
+				upload->status = status;
+				upload->retryAfter = retryAfter;
+			}
+			upload->found &= found;
+			upload->open &= open;
+			if (this->socket.is_open()) {
+				if (upload->paused && upload->pending < MAX_PENDING_BATCHES) {
+					upload->paused = false;
+					resumeBody();
+				}
+				endUpload(upload);
+			}
+			
+			// remove reference to this object
+			removeReference();
+		});
 	}
+}
+
+void Gateway::endUpload(ptr<Upload> const & upload) {
+	if (!upload->ended || upload->pending > 0)
+		return;
+	
+	// close the connection after the response when the network was handed over to a new process
+	if (upload->status == 400)
+		sendEmpty(upload->requestId, upload->keepAlive, 400, "Bad Request");
+	else if (upload->status == 413)
+		sendEmpty(upload->requestId, upload->keepAlive, 413, "Payload Too Large");
+	else if (upload->status != 200)
+		sendRetryLater(upload->requestId, upload->keepAlive && upload->open, upload->status, upload->retryAfter);
+	else if (upload->found)
+		sendEmpty(upload->requestId, upload->keepAlive, 200, "OK");
+	else
+		sendNotFound(upload->requestId, upload->keepAlive);
+}
 
-	Response response(404, "Not Found");
+void Gateway::abortUpload() {
+	this->bodyParser.reset();
+	ptr<Upload> upload = this->upload;
+	if (!upload)
+		return;
+	this->upload = nullptr;
+	
+	// add reference to this object until the upload has been stopped
+	addReference();
+	
+	// stop waiting for admission and drop the batches that were not sent yet, they still return to remove their
+	// reference to this object
+	this->network->loop.dispatch([this, upload] () {
+		upload->timer.cancel();
+		upload->refused = 503;
+		admitBatches(upload);
+		
+		// remove reference to this object on its own event loop
+		this->socket.get_io_service().post([this] () {
+			removeReference();
+		});
+	});
+}
+
+void Gateway::handleFile(Request const & request) {
+	uint32_t requestId = getRequestId();
+	ptr<StaticFiles::Representation> file = this->files->find(request.path,
+		request.getHeader(Header::ACCEPT_ENCODING));
+	if (!file) {
+		sendNotFound(requestId, isKeepAlive());
+		return;
+	}
+	string_view ifNoneMatch = request.getHeader(Header::IF_NONE_MATCH);
+	bool modified = ifNoneMatch.empty()
+		|| (ifNoneMatch != "*" && ifNoneMatch.str().find(file->etag) == std::string::npos);
+	
+	Response response(*this, requestId, modified ? 200 : 304, modified ? "OK" : "Not Modified");
 	response.addHeaders(Gateway::defaultHeaders);
 	if (!isKeepAlive())
 		response.addClose();
+	response.addHeaders(file->headers.c_str());
+	if (modified)
+		response.addHeaders(file->contentHeaders.c_str());
 	sendResponse(response);
+	
+	// send from the page cache without copying
+	if (modified && request.method != Method::HEAD)
+		sendFile(requestId, file->file, 0, file->length);
+	endResponse(requestId);
 }
 
-void Gateway::onBody(uint8_t const * data, size_t length) {
+void Gateway::handleEvents(bool json) {
+	uint32_t requestId = getRequestId();
+	if (this->events) {
+		// only one event stream per HTTP/2 connection, HTTP/1 connections don't parse requests behind the stream
+		sendEmpty(requestId, false, 409, "Conflict");
+		return;
+	}
+	
+	// event stream is open until the connection gets closed, therefore no inactivity timeout. Responses to following
+	// HTTP/1 requests would have to wait for the end of the stream
+	setTimeout(0);
+	ignoreRequests();
+	this->events = true;
+	this->eventsJson = json;
+	this->eventsRequestId = requestId;
+	watch();
+	
+	Response response(*this, requestId, 200, "OK");
+	response.addHeaders(Gateway::defaultHeaders);
+	response.addHeaders("Content-Type: text/event-stream\r\nCache-Control: no-cache\r\n");
+	sendResponse(response);
 }
 
-void Gateway::onEnd() {
-	//close();
+void Gateway::handleWebSocket(Request const & request) {
+	// an invalid upgrade request was already answered
+	if (!acceptWebSocket(request))
+		return;
+	
+	// WebSocket is open until the connection gets closed, therefore no inactivity timeout
+	setTimeout(0);
+	this->webSocketOpen = true;
+	watch();
+}
+
+void Gateway::onChanged(uint32_t nodeId, Parameters const & parameters) {
+	if (!this->socket.is_open())
+		return;
+	
+	// send event
+	if (this->events) {
+		std::string data = newBuffer();
+		if (this->eventsJson) {
+			// write into the send buffer without building a document
+			data += "data: ";
+			JsonWriter writer(data);
+			writer.beginObject();
+			writer.key("node");
+			writer.number(nodeId);
+			writer.members(parameters);
+			writer.endObject();
+		} else {
+			data += "data: node=";
+			append(data, nodeId);
+			encodeParameters(data, parameters);
+		}
+		data += "\n\n";
+		sendBody(this->eventsRequestId, std::move(data));
+	}
+	
+	// send WebSocket message
+	if (this->webSocketOpen) {
+		std::string message = "node=";
+		append(message, nodeId);
+		encodeParameters(message, parameters);
+		sendMessage(message);
+	}
+	
+	// respond to long-poll requests that wait for this node
+	for (auto it = this->waits.begin(); it != this->waits.end();) {
+		if (it->nodeId == nodeId) {
+			sendParameters(it->requestId, it->keepAlive, it->json, parameters);
+			it = this->waits.erase(it);
+		} else {
+			++it;
+		}
+	}
+	
+	if (!this->events && !this->webSocketOpen && this->waits.empty())
+		unwatch();
+}
+
+int Gateway::admit(int count, int & retryAfter) {
+	retryAfter = 1;
+	
+	// network was handed over to a new process or the commands don't fit into the queue of the serial link
+	if (!this->network->isOpen() || this->network->isSaturated(count))
+		return 503;
+	
+	// client exceeds its rate
+	if (this->limiter && !this->limiter->acquire(this->client, count, retryAfter))
+		return 429;
+	return 200;
+}
+
+void Gateway::onNetworkClose() {
+	if (!this->socket.is_open() || (!this->events && !this->webSocketOpen && this->waits.empty()))
+		return;
+	
+	// respond to long-poll requests with no content
+	for (Wait & wait : this->waits) {
+		sendEmpty(wait.requestId, false, 204, "No Content");
+	}
+	this->waits.clear();
+	
+	// end event stream
+	if (this->events) {
+		this->events = false;
+		endResponse(this->eventsRequestId);
+	}
+	
+	// close WebSocket with "going away"
+	if (this->webSocketOpen) {
+		this->webSocketOpen = false;
+		uint8_t const status[] = {0x03, 0xe9};
+		sendFrame(WS_CLOSE, status, sizeof(status));
+	}
+	
+	unwatch();
+	
+	// shut down once the responses and frames above were written
+	shutdownWhenSent();
+}
+
+void Gateway::addWait(uint32_t requestId, uint32_t nodeId, bool keepAlive, bool json, int wait) {
+	this->waits.push_back({requestId, nodeId, keepAlive, json,
+			std::unique_ptr<asio::steady_timer>(new asio::steady_timer(this->socket.get_io_service()))});
+	watch();
+	
+	// add reference to this object until async_wait completes
+	addReference();
+	
+	asio::steady_timer & timer = *this->waits.back().timer;
+	timer.expires_from_now(std::chrono::milliseconds(wait));
+	timer.async_wait([this, requestId, keepAlive] (error_code error) {
+		// no change: respond with no content
+		if (!error && removeWait(requestId))
+			sendEmpty(requestId, keepAlive, 204, "No Content");
+		
+		// remove reference to this object
+		removeReference();
+	});
+}
+
+bool Gateway::removeWait(uint32_t requestId) {
+	for (auto it = this->waits.begin(); it != this->waits.end(); ++it) {
+		if (it->requestId == requestId) {
+			this->waits.erase(it);
+			if (!this->events && !this->webSocketOpen && this->waits.empty())
+				unwatch();
+			return true;
+		}
+	}
+	return false;
+}
+
+void Gateway::watch() {
+	if (!this->watching) {
+		this->watching = true;
+		
+		// add reference to this object while the watcher is registered
+		addReference();
+		ptr<ZWaveNetwork> network = this->network;
+		ptr<Watcher> watcher = this->watcher;
+		network->loop.dispatch([network, watcher] () {
+			network->addListener(watcher);
+		});
+	}
+}
+
+void Gateway::unwatch() {
+	if (this->watching) {
+		this->watching = false;
+		ptr<ZWaveNetwork> network = this->network;
+		ptr<Watcher> watcher = this->watcher;
+		network->loop.dispatch([network, watcher] () {
+			network->removeListener(watcher);
+			
+			// remove reference to the gateway after the watcher is unregistered
+			watcher->gateway->removeReference();
+		});
+	}
+}
+
+void Gateway::sendParameters(uint32_t requestId, bool keepAlive, bool json, Parameters const & parameters) {
+	// build response body in a send buffer
+	std::string data = newBuffer();
+	if (json) {
+		JsonWriter writer(data);
+		writer.beginObject();
+		writer.members(parameters);
+		writer.endObject();
+	} else {
+		encodeParameters(data, parameters);
+	}
+	
+	// send response
+	Response response(*this, requestId, 200, "OK");
+	response.addHeaders(Gateway::defaultHeaders);
+	if (!keepAlive)
+		response.addClose();
+	response.addHeaders("Vary: Accept\r\n");
+	response.addContent(json ? "application/json" : "application/x-www-form-urlencoded", data.length());
+	sendResponse(response);
+	sendBody(requestId, std::move(data));
+	endResponse(requestId);
+}
+
+void Gateway::sendNode(uint32_t requestId, bool keepAlive, bool json, ptr<StateCache::Body> body,
+	std::string const & ifNoneMatch)
+{
+	std::string const & etag = json ? body->jsonEtag : body->etag;
+	if (!ifNoneMatch.empty() && (ifNoneMatch == "*" || ifNoneMatch.find(etag) != std::string::npos)) {
+		// client has the current state
+		Response response(*this, requestId, 304, "Not Modified");
+		response.addHeaders(Gateway::defaultHeaders);
+		if (!keepAlive)
+			response.addClose();
+		response.addHeader("ETag", etag);
+		response.addHeaders("Vary: Accept\r\n");
+		sendResponse(response);
+		endResponse(requestId);
+		return;
+	}
+	
+	// send pre-rendered headers and body without copying the body
+	Response response(*this, requestId, 200, "OK");
+	response.addHeaders(Gateway::defaultHeaders);
+	if (!keepAlive)
+		response.addClose();
+	std::string const & data = json ? body->json : body->data;
+	response.addHeaders(json ? body->jsonHeaders.c_str() : body->headers.c_str());
+	sendResponse(response);
+	sendBody(requestId, body, (uint8_t const *)data.data(), data.length());
+	endResponse(requestId);
+}
+
+void Gateway::sendEmpty(uint32_t requestId, bool keepAlive, int status, char const * message) {
+	Response response(*this, requestId, status, message);
+	response.addHeaders(Gateway::defaultHeaders);
+	if (!keepAlive)
+		response.addClose();
+	if (status != 204)
+		response.addHeaders("Content-Length: 0\r\n");
+	sendResponse(response);
+	endResponse(requestId);
+}
+
+void Gateway::sendRetryLater(uint32_t requestId, bool keepAlive, int status, int retryAfter) {
+	Response response(*this, requestId, status, status == 429 ? "Too Many Requests" : "Service Unavailable");
+	response.addHeaders(Gateway::defaultHeaders);
+	if (!keepAlive)
+		response.addClose();
+	response.addHeader("Retry-After", int64_t(retryAfter));
+	response.addHeaders("Content-Length: 0\r\n");
+	sendResponse(response);
+	endResponse(requestId);
 }
 
-std::map<std::string, std::string> Gateway::defaultHeaders = {{"Server", "huasi"}};
+char const Gateway::defaultHeaders[] = "Server: huasi\r\n";
@@ -1,30 +1,286 @@
 #pragma once
 
+#include <deque>
+#include <list>
+#include <memory>
+#include "http/BodyParser.hpp"
 #include "http/HttpChannel.hpp"
+#include "http/Router.hpp"
+#include "http/StaticFiles.hpp"
+#include "RateLimiter.hpp"
+#include "StateCache.hpp"
 #include "zwave/ZWaveNetwork.hpp"
 #include "ptr.hpp"
 
 
 ///
 /// HTTP to ZWave gateway
-class Gateway : public HttpChannel {
+class Gateway : public HttpChannel, protected BodyParser::Listener {
 public:
 	
 	///
 	/// Constructor
 	/// @param loop event loop for asynchronous io
 	/// @param network a ZWave network to control over HTTP
-	Gateway(asio::io_service & loop, ptr<ZWaveNetwork> network)
-			: HttpChannel(loop, 30000), network(network) {
+	/// @param cache state of all nodes of the network
+	/// @param limiter optional rate limit per client for commands to the network, used on the event loop of the network
+	Gateway(asio::io_service & loop, ptr<ZWaveNetwork> network, ptr<StateCache> cache,
+			ptr<RateLimiter> limiter = nullptr)
+			: HttpChannel(loop, 30000), network(network), cache(cache), limiter(limiter), watcher(new Watcher(this)) {
+		captureHeader(Header::ACCEPT);
+		captureHeader(Header::ACCEPT_ENCODING);
+		captureHeader(Header::CONTENT_TYPE);
+		captureHeader(Header::IF_NONE_MATCH);
+		captureHeader(Header::SEC_WEBSOCKET_KEY);
+		captureHeader(Header::SEC_WEBSOCKET_VERSION);
 	}
 
 	~Gateway() override;
 
-	void onRequest(Method method, std::string url, Headers headers) override;
+	void onRequest(Request const & request) override;
 	void onBody(uint8_t const * data, size_t length) override;
 	void onEnd() override;
+	void onAbort() override;
+	void onMessage(uint8_t const * data, size_t length, bool binary) override;
+	void close() override;
 	
 	
 	ptr<ZWaveNetwork> network;
-	static std::map<std::string, std::string> defaultHeaders;
+	ptr<StateCache> cache;
+	ptr<RateLimiter> limiter;
+	
+	// optional static files (e.g. a web UI) that are served for GET and HEAD requests that match no route
+	ptr<StaticFiles> files;
+	
+	// precomputed headers that are added to every response
+	static char const defaultHeaders[];
+
+protected:
+
+	enum {
+		// maximum time in milliseconds a long-poll request waits for a change (less than the inactivity timeout)
+		MAX_WAIT = 20000,
+		
+		// maximum number of fields of a record in a request body
+		MAX_RECORD_FIELDS = 32,
+		
+		// number of records of a request body that are sent to the network together, each record is charged to the rate
+		// limit of the client, therefore this should not exceed the burst size of the rate limiter
+		MAX_BATCH = 16,
+		
+		// number of batches on the way to the network after which receiving of the body is paused
+		MAX_PENDING_BATCHES = 4,
+		
+		// time in milliseconds after which a batch is admitted again when too many commands waited for the serial link.
+		// When the client exceeded its rate, the batch is admitted again after the retry time of the rate limiter
+		UPLOAD_RETRY_INTERVAL = 200
+	};
+
+	///
+	/// Listener for changes of the network, forwards them to the event loop of the gateway
+	class Watcher : public Network::Listener {
+	public:
+		Watcher(Gateway * gateway) : gateway(gateway) {}
+		~Watcher() override;
+		void onChanged(uint32_t nodeId, Parameters const & parameters) override;
+		void onClose() override;
+
+		Gateway * gateway;
+	};
+
+	///
+	/// Streams the state of all nodes, one line per node or a JSON array
+	class NodesSource : public Source {
+	public:
+		~NodesSource() override;
+		bool read(std::string & buffer, size_t maxLength) override;
+		
+		// snapshot of the state of all nodes
+		std::vector<std::pair<uint32_t, ptr<StateCache::Body>>> nodes;
+		size_t index = 0;
+		bool json = false;
+	};
+
+	///
+	/// Set request with a body (POST /node/:id or POST /nodes). The records are sent to the network in batches while
+	/// the body is being received, therefore the memory does not depend on the size of the body
+	class Upload : public Object {
+	public:
+		Upload(asio::io_service & loop);
+		~Upload() override;
+		
+		uint32_t requestId;
+		bool keepAlive;
+		
+		// node of POST /node/:id whose parameters are merged from all records, otherwise each record has a node field
+		optional<uint32_t> nodeId;
+		
+		// record that is being parsed
+		Parameters record;
+		
+		// records of the next batch
+		std::vector<std::pair<uint32_t, Parameters>> sets;
+		
+		// number of batches on the way to the network and whether receiving is paused until they return
+		int pending = 0;
+		bool paused = false;
+		
+		// end of body was received
+		bool ended = false;
+		
+		// combined result, the first status other than 200 is kept and following batches are dropped
+		int status = 200;
+		int retryAfter = 0;
+		bool found = true;
+		bool open = true;
+		
+		// state on the event loop of the network: batches that wait for admission and the status of a refused batch that
+		// also drops the following batches
+		std::deque<std::vector<std::pair<uint32_t, Parameters>>> batches;
+		int refused = 200;
+		asio::steady_timer timer;
+	};
+
+	///
+	/// Long-poll request that waits for a change of a node
+	struct Wait {
+		uint32_t requestId;
+		uint32_t nodeId;
+		bool keepAlive;
+		bool json;
+		std::unique_ptr<asio::steady_timer> timer;
+	};
+
+	void onConnect() override;
+
+	bool onField(string_view key, string_view value) override;
+	bool onRecord() override;
+
+	///
+	/// Admission control for commands to the network, call on the event loop of the network
+	/// @param count number of commands that need room in the queue of the network and are charged to the rate limit of
+	/// the client
+	/// @param retryAfter receives the number of seconds after which the client should retry if not admitted
+	/// @return 200 if admitted, 429 if the client exceeds its rate or 503 if the network is saturated or closed
+	int admit(int count, int & retryAfter);
+
+	///
+	/// Handler for a route, gets the query and path parameters of the request
+	using Handler = void (Gateway::*)(Request const & request, RouteParameters const & parameters);
+
+	///
+	/// Route table, built on first use
+	static Router<Handler> const & getRouter();
+
+	void routeNode(Request const & request, RouteParameters const & parameters);
+	void routeNodes(Request const & request, RouteParameters const & parameters);
+	void routeSetNodes(Request const & request, RouteParameters const & parameters);
+	void routeEvents(Request const & request, RouteParameters const & parameters);
+	void routeWebSocket(Request const & request, RouteParameters const & parameters);
+#ifdef WITH_TLS
+	void routeTls(Request const & request, RouteParameters const & parameters);
+#endif
+
+	///
+	/// Get state of a node or set parameters of a node
+	/// @param ifNoneMatch entity tag of the If-None-Match header, state is only sent if it does not match
+	/// @param json send the state as JSON instead of form
+	void handleNode(Method method, uint32_t nodeId, Parameters const & parameters, int wait,
+		std::string const & ifNoneMatch, bool json);
+
+	///
+	/// Get state of all nodes
+	/// @param fields comma separated names of parameters to include, all parameters if empty
+	/// @param json send a JSON array instead of one line per node
+	void handleNodes(std::string const & fields, bool json);
+
+	///
+	/// Start receiving a body with parameters to set, form (one line per record) or JSON (object or array of objects)
+	/// @param nodeId node of POST /node/:id, otherwise each record contains a node field ("node=4&position.blinds=50")
+	/// @param parameters parameters of the query that the body adds to
+	void handleUpload(optional<uint32_t> nodeId, Parameters && parameters, string_view contentType);
+	
+	///
+	/// Send the complete records of the upload to the network
+	void sendUpload(ptr<Upload> upload);
+	
+	///
+	/// Send the waiting batches of an upload to the network in their order, call on the event loop of the network. The
+	/// batches wait while the serial link is saturated instead of failing the upload
+	void admitBatches(ptr<Upload> const & upload);
+	
+	///
+	/// Respond to the upload when the body has ended and all batches have returned from the network
+	void endUpload(ptr<Upload> const & upload);
+
+	///
+	/// Stop the current upload when the connection gets closed or the request was aborted, the batches that were not
+	/// sent yet are dropped
+	void abortUpload();
+
+	///
+	/// Send a static file or 304 Not Modified if the client has the current version
+	void handleFile(Request const & request);
+
+	///
+	/// Start event stream of changes
+	/// @param json data of the events is JSON instead of form
+	void handleEvents(bool json);
+
+	///
+	/// Accept WebSocket connection that receives changes and commands
+	void handleWebSocket(Request const & request);
+
+	///
+	/// Tracked parameters of a node have changed, called on the event loop of the gateway
+	void onChanged(uint32_t nodeId, Parameters const & parameters);
+
+	///
+	/// The network was closed (handed over to a new process), called on the event loop of the gateway. Finishes
+	/// long-poll requests, the event stream and the WebSocket so that the client reconnects to the new process
+	void onNetworkClose();
+	
+	///
+	/// Wait for a change of a node (long-poll)
+	void addWait(uint32_t requestId, uint32_t nodeId, bool keepAlive, bool json, int wait);
+
+	///
+	/// Stop waiting for a change of a node
+	/// @return false if the long-poll request was already answered
+	bool removeWait(uint32_t requestId);
+	
+	///
+	/// Start or stop listening for changes of the network
+	void watch();
+	void unwatch();
+	
+	void sendParameters(uint32_t requestId, bool keepAlive, bool json, Parameters const & parameters);
+	void sendNode(uint32_t requestId, bool keepAlive, bool json, ptr<StateCache::Body> body,
+		std::string const & ifNoneMatch);
+	void sendEmpty(uint32_t requestId, bool keepAlive, int status, char const * message);
+	void sendNotFound(uint32_t requestId, bool keepAlive) {sendEmpty(requestId, keepAlive, 404, "Not Found");}
+	void sendRetryLater(uint32_t requestId, bool keepAlive, int status, int retryAfter);
+
+
+	// address of the client for rate limiting
+	std::string client;
+
+	// listener that is registered at the network while watching
+	ptr<Watcher> watcher;
+	bool watching = false;
+	
+	// WebSocket gets changes pushed
+	bool webSocketOpen = false;
+	
+	// event stream
+	bool events = false;
+	bool eventsJson = false;
+	uint32_t eventsRequestId = 0;
+	
+	// long-poll requests
+	std::list<Wait> waits;
+	
+	// set request whose body is being received
+	ptr<Upload> upload;
+	std::unique_ptr<BodyParser> bodyParser;
 };
@@ -0,0 +1,44 @@
+#include <new>
+#include "HandlerMemory.hpp"
+
+
+HandlerMemory::~HandlerMemory() {
+	for (Block & block : this->blocks) {
+		::operator delete(block.pointer);
+	}
+}
+
+void * HandlerMemory::allocate(size_t size) {
+	// use a free block that is large enough, otherwise grow a free block
+	Block * grow = nullptr;
+	for (Block & block : this->blocks) {
+		if (!block.used) {
+			if (block.size >= size) {
+				block.used = true;
+				return block.pointer;
+			}
+			if (grow == nullptr)
+				grow = &block;
+		}
+	}
+	if (grow == nullptr)
+		return ::operator new(size);
+	::operator delete(grow->pointer);
+	grow->pointer = nullptr;
+	grow->size = 0;
+	size_t blockSize = (size + BLOCK_ALIGN - 1) / BLOCK_ALIGN * BLOCK_ALIGN;
+	grow->pointer = ::operator new(blockSize);
+	grow->size = blockSize;
+	grow->used = true;
+	return grow->pointer;
+}
+
+void HandlerMemory::deallocate(void * pointer) {
+	for (Block & block : this->blocks) {
+		if (block.pointer == pointer) {
+			block.used = false;
+			return;
+		}
+	}
+	::operator delete(pointer);
+}
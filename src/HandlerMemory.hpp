@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include "asio/detail/handler_cont_helpers.hpp"
+#include "asio/detail/handler_invoke_helpers.hpp"
+
+
+///
+/// Memory for the asynchronous operations of one object. asio allocates an operation for every asynchronous call and
+/// frees it before the handler gets called, therefore a few recycled blocks are enough for the concurrent read, write
+/// and timer operations of an object. Steady state operation then needs no heap allocation. Falls back to the heap
+/// when all blocks are in use. Only use from one event loop
+class HandlerMemory {
+public:
+	enum {
+		// number of recycled blocks, e.g. read, write, a timer and a canceled timer that has not completed yet
+		BLOCK_COUNT = 6,
+		
+		// block sizes are rounded up to a multiple of this so that slightly larger operations fit
+		BLOCK_ALIGN = 64
+	};
+
+	HandlerMemory() {}
+	HandlerMemory(HandlerMemory const &) = delete;
+	~HandlerMemory();
+
+	void * allocate(size_t size);
+	void deallocate(void * pointer);
+
+protected:
+
+	struct Block {
+		void * pointer = nullptr;
+		size_t size = 0;
+		bool used = false;
+	};
+	Block blocks[BLOCK_COUNT];
+};
+
+///
+/// Handler that allocates its asynchronous operation from a HandlerMemory using the asio_handler_allocate and
+/// asio_handler_deallocate hooks which asio finds by argument dependent lookup
+template <typename Handler>
+class MemoryHandler {
+public:
+	MemoryHandler(HandlerMemory & memory, Handler handler) : memory(memory), handler(std::move(handler)) {}
+
+	template <typename... Arguments>
+	void operator ()(Arguments &&... arguments) {
+		this->handler(std::forward<Arguments>(arguments)...);
+	}
+
+	friend void * asio_handler_allocate(size_t size, MemoryHandler * context) {
+		return context->memory.allocate(size);
+	}
+
+	friend void asio_handler_deallocate(void * pointer, size_t, MemoryHandler * context) {
+		context->memory.deallocate(pointer);
+	}
+
+	// forward the remaining hooks to the wrapped handler so that wrapping doesn't change how it gets scheduled, e.g.
+	// when it is a strand or a composed operation
+	friend bool asio_handler_is_continuation(MemoryHandler * context) {
+		return asio_handler_cont_helpers::is_continuation(context->handler);
+	}
+
+	template <typename Function>
+	friend void asio_handler_invoke(Function & function, MemoryHandler * context) {
+		asio_handler_invoke_helpers::invoke(function, context->handler);
+	}
+
+	template <typename Function>
+	friend void asio_handler_invoke(Function const & function, MemoryHandler * context) {
+		asio_handler_invoke_helpers::invoke(function, context->handler);
+	}
+
+protected:
+
+	HandlerMemory & memory;
+	Handler handler;
+};
+
+///
+/// Wrap a handler so that its operation gets allocated from the given memory, e.g.
+/// socket.async_read_some(buffers, makeHandler(this->handlerMemory, [this] (error_code error, size_t count) {...}));
+template <typename Handler>
+inline MemoryHandler<Handler> makeHandler(HandlerMemory & memory, Handler handler) {
+	return MemoryHandler<Handler>(memory, std::move(handler));
+}
@@ -0,0 +1,190 @@
+#include <errno.h>
+#include <algorithm>
+#include <string.h> // memcpy
+#include <sys/socket.h>
+#include <sys/time.h> // timeval
+#include <sys/un.h>
+#include <unistd.h> // close, unlink
+#include "Handoff.hpp"
+
+
+Handoff::Handoff(asio::io_service & loop, std::string const & path)
+		: path(path), acceptor(loop), socket(loop) {
+}
+
+Handoff::~Handoff() {
+}
+
+bool Handoff::receive(std::vector<int> & sockets, std::string & state) {
+	sockaddr_un address = {};
+	if (this->path.length() >= sizeof(address.sun_path))
+		return false;
+	address.sun_family = AF_UNIX;
+	memcpy(address.sun_path, this->path.data(), this->path.length());
+
+	// connect to the running process, fails if there is none
+	int s = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (s < 0)
+		return false;
+	if (::connect(s, (sockaddr *)&address, sizeof(address)) != 0) {
+		::close(s);
+		return false;
+	}
+	
+	// don't wait forever for a running process that hangs
+	timeval timeout = {RECEIVE_TIMEOUT / 1000, (RECEIVE_TIMEOUT % 1000) * 1000};
+	::setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	// receive until the running process closes the connection, the sockets are attached to the first byte
+	bool first = true;
+	while (true) {
+		char buffer[4096];
+		iovec iov = {buffer, sizeof(buffer)};
+		union {
+			char data[CMSG_SPACE(sizeof(int) * MAX_SOCKETS)];
+			cmsghdr align;
+		} control;
+		msghdr message = {};
+		message.msg_iov = &iov;
+		message.msg_iovlen = 1;
+		message.msg_control = control.data;
+		message.msg_controllen = sizeof(control.data);
+		ssize_t length = ::recvmsg(s, &message, 0);
+		if (length < 0 && errno == EINTR)
+			continue;
+		if (length < 0) {
+			// timeout or error: the state may be incomplete, therefore start without the running process
+			for (int socket : sockets) {
+				::close(socket);
+			}
+			sockets.clear();
+			state.clear();
+			::close(s);
+			return false;
+		}
+		if (length == 0)
+			break;
+
+		for (cmsghdr * c = CMSG_FIRSTHDR(&message); c != nullptr; c = CMSG_NXTHDR(&message, c)) {
+			if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+				int count = int((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+				for (int i = 0; i < count; ++i) {
+					int socket;
+					memcpy(&socket, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+					sockets.push_back(socket);
+				}
+			}
+		}
+
+		// skip the first byte
+		state.append(buffer + (first ? 1 : 0), length - (first ? 1 : 0));
+		first = false;
+	}
+	::close(s);
+	return !first;
+}
+
+void Handoff::listen() {
+	if (!this->acceptor.is_open()) {
+		// remove control socket of the previous process
+		::unlink(this->path.c_str());
+
+		error_code error;
+		asio::local::stream_protocol::endpoint endpoint(this->path);
+		this->acceptor.open(endpoint.protocol(), error);
+		if (!error)
+			this->acceptor.bind(endpoint, error);
+		if (!error)
+			this->acceptor.listen(asio::socket_base::max_connections, error);
+		if (error) {
+			onError(error);
+			return;
+		}
+	}
+
+	// add reference to this object until async_accept completes
+	addReference();
+	this->acceptor.async_accept(
+			this->socket,
+			[this] (error_code error) {
+				if (error) {
+					if (error != asio::error::operation_aborted)
+						onError(error);
+				} else {
+					// stop accepting, only one process can take over
+					close();
+
+					// collect sockets and state and send them to the new process
+					std::vector<int> sockets;
+					std::string state;
+					onHandoff(sockets, state);
+					if (send(sockets, state)) {
+						// the new process waits for the end of the state, therefore it can take over the network
+						// after onHandedOver() has released it
+						onHandedOver();
+						error_code e;
+						this->socket.close(e);
+					} else {
+						// continue and wait for the next attempt
+						error_code e;
+						this->socket.close(e);
+						listen();
+					}
+				}
+
+				// remove reference to this object
+				removeReference();
+			});
+}
+
+void Handoff::close() {
+	error_code error;
+	this->acceptor.close(error);
+}
+
+bool Handoff::send(std::vector<int> const & sockets, std::string const & state) {
+	int s = this->socket.native_handle();
+	error_code error;
+	this->socket.native_non_blocking(false, error);
+
+	// attach the sockets to a single byte that precedes the state
+	char first = 0;
+	iovec iov = {&first, 1};
+	union {
+		char data[CMSG_SPACE(sizeof(int) * MAX_SOCKETS)];
+		cmsghdr align;
+	} control = {};
+	int count = std::min(int(sockets.size()), int(MAX_SOCKETS));
+	msghdr message = {};
+	message.msg_iov = &iov;
+	message.msg_iovlen = 1;
+	if (count > 0) {
+		message.msg_control = control.data;
+		message.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+		cmsghdr * c = CMSG_FIRSTHDR(&message);
+		c->cmsg_level = SOL_SOCKET;
+		c->cmsg_type = SCM_RIGHTS;
+		c->cmsg_len = CMSG_LEN(sizeof(int) * count);
+		memcpy(CMSG_DATA(c), sockets.data(), sizeof(int) * count);
+	}
+	while (::sendmsg(s, &message, MSG_NOSIGNAL) < 0) {
+		if (errno != EINTR) {
+			onError(error_code(errno, std::system_category()));
+			return false;
+		}
+	}
+
+	// send the state
+	size_t position = 0;
+	while (position < state.length()) {
+		ssize_t length = ::send(s, state.data() + position, state.length() - position, MSG_NOSIGNAL);
+		if (length < 0) {
+			if (errno == EINTR)
+				continue;
+			onError(error_code(errno, std::system_category()));
+			return false;
+		}
+		position += length;
+	}
+	return true;
+}
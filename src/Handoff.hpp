@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "asio.hpp"
+#include "Object.hpp"
+
+
+///
+/// Hands the listening sockets and the state of the network over to a new process, e.g. when upgrading the binary.
+/// The running process listens on a UNIX domain control socket. A new process connects to it and receives the
+/// listening sockets via SCM_RIGHTS, followed by the state until the running process closes the connection. In the
+/// meantime new connections wait in the backlog of the listening sockets, therefore the service never goes away
+class Handoff : public Object {
+public:
+	///
+	/// Constructor
+	/// @param loop event loop for the control socket
+	/// @param path path of the control socket
+	Handoff(asio::io_service & loop, std::string const & path);
+
+	~Handoff() override;
+
+	///
+	/// connect to a running process and receive its listening sockets and state. Blocks until the running process
+	/// has closed the connection, therefore call before running the event loop. Gives up when the running process
+	/// sends nothing for RECEIVE_TIMEOUT
+	/// @param sockets receives the native handles of the listening sockets
+	/// @param state receives the state
+	/// @return false if no process is running or the handoff failed, then no sockets are returned
+	bool receive(std::vector<int> & sockets, std::string & state);
+
+	///
+	/// listen on the control socket for a new process
+	void listen();
+
+	///
+	/// close the control socket
+	void close();
+
+protected:
+
+	enum {
+		// maximum number of sockets that can be handed over
+		MAX_SOCKETS = 8,
+		
+		// time in milliseconds that receive() waits for data of the running process, e.g. when it hangs
+		RECEIVE_TIMEOUT = 5000
+	};
+
+	///
+	/// a new process has connected: collect the listening sockets and the state to hand over
+	virtual void onHandoff(std::vector<int> & sockets, std::string & state) = 0;
+
+	///
+	/// the listening sockets and the state were handed over: close the servers and release the network (e.g. the
+	/// serial port), then drain in-flight requests and exit. The new process continues after this returns
+	virtual void onHandedOver() = 0;
+
+	///
+	/// called when an error occurs
+	virtual void onError(error_code error) = 0;
+
+	///
+	/// send the sockets and the state to the new process
+	bool send(std::vector<int> const & sockets, std::string const & state);
+
+
+	std::string path;
+	asio::local::stream_protocol::acceptor acceptor;
+	asio::local::stream_protocol::socket socket;
+};
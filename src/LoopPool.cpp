@@ -0,0 +1,40 @@
+#include "LoopPool.hpp"
+
+
+LoopPool::LoopPool(int count) {
+	for (int i = 0; i < count; ++i) {
+		asio::io_service * loop = new asio::io_service(1);
+		this->loops.emplace_back(loop);
+
+		// keep the event loop running even if it has nothing to do
+		this->works.emplace_back(new asio::io_service::work(*loop));
+	}
+}
+
+LoopPool::~LoopPool() {
+	stop();
+}
+
+void LoopPool::run() {
+	for (std::unique_ptr<asio::io_service> & loop : this->loops) {
+		asio::io_service * l = loop.get();
+		this->threads.emplace_back([l] () {l->run();});
+	}
+}
+
+void LoopPool::stop() {
+	this->works.clear();
+	for (std::unique_ptr<asio::io_service> & loop : this->loops) {
+		loop->stop();
+	}
+	for (std::thread & thread : this->threads) {
+		thread.join();
+	}
+	this->threads.clear();
+}
+
+asio::io_service & LoopPool::next() {
+	asio::io_service & loop = *this->loops[this->nextIndex];
+	this->nextIndex = this->nextIndex + 1 < int(this->loops.size()) ? this->nextIndex + 1 : 0;
+	return loop;
+}
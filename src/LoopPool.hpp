@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <thread>
+#include <vector>
+#include "asio.hpp"
+
+
+///
+/// Pool of event loops where each loop runs in its own thread. Used to distribute connections over multiple cores
+class LoopPool {
+public:
+	///
+	/// Constructor
+	/// @param count number of event loops (typically the number of cores)
+	LoopPool(int count);
+
+	~LoopPool();
+
+	///
+	/// start a thread for each event loop
+	void run();
+
+	///
+	/// stop all event loops and wait until the threads have finished
+	void stop();
+
+	///
+	/// get number of event loops
+	int size() const {return int(this->loops.size());}
+
+	///
+	/// get the next event loop in round-robin order. Only call from one thread (e.g. the thread of the acceptor)
+	asio::io_service & next();
+
+protected:
+
+	std::vector<std::unique_ptr<asio::io_service>> loops;
+	std::vector<std::unique_ptr<asio::io_service::work>> works;
+	std::vector<std::thread> threads;
+	int nextIndex = 0;
+};
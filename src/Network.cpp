@@ -1,5 +1,46 @@
+#include <algorithm>
 #include "Network.hpp"
 
 
+// Listener
+
+Network::Listener::~Listener() {
+}
+
+void Network::Listener::onClose() {
+}
+
+
+// Network
+
 Network::~Network() {
 }
+
+void Network::addListener(ptr<Listener> listener) {
+	this->listeners.push_back(listener);
+}
+
+void Network::removeListener(ptr<Listener> listener) {
+	auto it = std::find(this->listeners.begin(), this->listeners.end(), listener);
+	if (it != this->listeners.end())
+		this->listeners.erase(it);
+}
+
+void Network::notifyChanged(uint32_t nodeId, Parameters const & parameters) {
+	if (parameters.parameters.empty())
+		return;
+	
+	// iterate over a copy as listeners may remove themselves
+	std::vector<ptr<Listener>> listeners = this->listeners;
+	for (ptr<Listener> & listener : listeners) {
+		listener->onChanged(nodeId, parameters);
+	}
+}
+
+void Network::notifyClose() {
+	// iterate over a copy as listeners may remove themselves
+	std::vector<ptr<Listener>> listeners = this->listeners;
+	for (ptr<Listener> & listener : listeners) {
+		listener->onClose();
+	}
+}
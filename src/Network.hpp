@@ -1,7 +1,10 @@
 #pragma once
 
+#include <vector>
+#include "asio.hpp"
 #include "Parameters.hpp"
 #include "Object.hpp"
+#include "ptr.hpp"
 
 
 ///
@@ -9,6 +12,29 @@
 class Network : public Object {
 public:
 
+	///
+	/// Listener that gets notified when tracked parameters of a node change
+	class Listener : public Object {
+	public:
+		~Listener() override;
+
+		///
+		/// called on the event loop of the network when tracked parameters of a node have changed
+		/// @param nodeId id of node
+		/// @param parameters the parameters that have changed
+		virtual void onChanged(uint32_t nodeId, Parameters const & parameters) = 0;
+
+		///
+		/// called on the event loop of the network when the network was closed, e.g. after it was handed over to a
+		/// new process. default implementation does nothing
+		virtual void onClose();
+	};
+
+	///
+	/// Constructor
+	/// @param loop event loop that owns the network
+	Network(asio::io_service & loop) : loop(loop) {}
+
 	~Network() override;
 
 	///
@@ -24,4 +50,34 @@ public:
 	/// @param parameters parameters to get
 	/// @return true if node exists in the ZWave network
 	virtual bool get(uint32_t nodeId, Parameters &parameters) = 0;
+
+	///
+	/// get ids of all nodes in the network
+	/// @param nodeIds ids of nodes in ascending order
+	virtual void getNodeIds(std::vector<uint32_t> & nodeIds) = 0;
+
+	///
+	/// add a listener that gets notified when tracked parameters change. Only call from the event loop of the network
+	void addListener(ptr<Listener> listener);
+
+	///
+	/// remove a listener. Only call from the event loop of the network
+	void removeListener(ptr<Listener> listener);
+
+	///
+	/// notify all listeners that tracked parameters of a node have changed
+	void notifyChanged(uint32_t nodeId, Parameters const & parameters);
+
+	///
+	/// notify all listeners that the network was closed
+	void notifyClose();
+
+
+	// event loop that owns the network. When using multiple event loops, call sendSet() and get() only from this loop,
+	// e.g. using network->loop.dispatch()
+	asio::io_service & loop;
+
+protected:
+
+	std::vector<ptr<Listener>> listeners;
 };
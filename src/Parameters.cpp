@@ -14,7 +14,7 @@ optional<bool> Parameters::getState(std::string const & name) const {
 }
 
 void Parameters::setState(std::string const & name, bool value) {
-	this->parameters[name] = value ? "off" : "on";
+	this->parameters[name] = value ? "on" : "off";
 }
 
 optional<uint8_t> Parameters::getByte(std::string const & name) const {
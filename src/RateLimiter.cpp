@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <cmath>
+#include "RateLimiter.hpp"
+
+
+RateLimiter::RateLimiter(double rate, int burst)
+		: rate(rate), burst(burst) {
+}
+
+RateLimiter::~RateLimiter() {
+}
+
+bool RateLimiter::acquire(std::string const & client, int count, int & retryAfter) {
+	Clock::time_point now = Clock::now();
+	auto it = this->buckets.find(client);
+	if (it == this->buckets.end()) {
+		if (this->buckets.size() >= MAX_CLIENTS)
+			prune(now);
+		it = this->buckets.insert({client, {this->burst, now}}).first;
+	}
+	Bucket & bucket = it->second;
+	
+	// refill the bucket for the time since the last access
+	double elapsed = std::chrono::duration<double>(now - bucket.time).count();
+	bucket.tokens = std::min(bucket.tokens + elapsed * this->rate, this->burst);
+	bucket.time = now;
+	
+	double tokens = count;
+	if (bucket.tokens < tokens) {
+		retryAfter = std::max(int(std::ceil((tokens - bucket.tokens) / this->rate)), 1);
+		return false;
+	}
+	bucket.tokens -= tokens;
+	return true;
+}
+
+void RateLimiter::prune(Clock::time_point now) {
+	for (auto it = this->buckets.begin(); it != this->buckets.end();) {
+		double elapsed = std::chrono::duration<double>(now - it->second.time).count();
+		if (it->second.tokens + elapsed * this->rate >= this->burst)
+			it = this->buckets.erase(it);
+		else
+			++it;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <string>
+#include "Object.hpp"
+
+
+///
+/// Token bucket per client that limits the rate of expensive operations such as commands to the radio. Each client
+/// gets tokens at a fixed rate up to a burst size. Use only on one event loop, e.g. the event loop of the network
+class RateLimiter : public Object {
+public:
+	///
+	/// Constructor
+	/// @param rate number of tokens per second
+	/// @param burst maximum number of tokens a client can save up
+	RateLimiter(double rate, int burst);
+
+	~RateLimiter() override;
+
+	///
+	/// take tokens from the bucket of a client, fails if the bucket holds less than count tokens, therefore a count
+	/// larger than the burst size never succeeds
+	/// @param client client address
+	/// @param count number of tokens
+	/// @param retryAfter receives the number of seconds until enough tokens are available if not successful
+	/// @return true if the tokens were taken
+	bool acquire(std::string const & client, int count, int & retryAfter);
+
+protected:
+
+	enum {
+		// number of clients after which full buckets are removed
+		MAX_CLIENTS = 1024
+	};
+
+	using Clock = std::chrono::steady_clock;
+
+	struct Bucket {
+		double tokens;
+		Clock::time_point time;
+	};
+
+	///
+	/// remove buckets that are full, they are equal to a new bucket
+	void prune(Clock::time_point now);
+
+	double rate;
+	double burst;
+	std::map<std::string, Bucket> buckets;
+};
@@ -1,34 +1,78 @@
 #include <assert.h>
+#include <sys/socket.h> // getsockname
+#include <netinet/in.h> // IPPROTO_TCP
 #include "Channel.hpp"
 #include "ptr.hpp"
 
 
-Server::Server(asio::io_service & loop, asio::ip::tcp::endpoint const & endpoint) : acceptor(loop, endpoint) {
+Server::Server(asio::io_service & loop, asio::generic::stream_protocol::endpoint const & endpoint, LoopPool * pool)
+		: acceptor(loop, endpoint), pool(pool) {
+}
+
+Server::Server(asio::io_service & loop, int socket, LoopPool * pool)
+		: acceptor(loop), pool(pool) {
+	// get the protocol from the address family of the socket
+	sockaddr_storage address = {};
+	socklen_t length = sizeof(address);
+	::getsockname(socket, (sockaddr *)&address, &length);
+	int family = address.ss_family;
+	asio::generic::stream_protocol protocol(family, family == AF_UNIX ? 0 : IPPROTO_TCP);
+	this->acceptor.assign(protocol, socket);
 }
 
 Server::~Server() {
 }
 
 bool Server::listen() {
-	// create a channel
-	ptr<Channel> channel = createChannel(this->acceptor.get_io_service());
+	// create a channel on the next event loop of the pool
+	asio::io_service & loop = this->pool != nullptr ? this->pool->next() : this->acceptor.get_io_service();
+	ptr<Channel> channel = createChannel(loop);
+	
+	// get timer wheel of the event loop
+	ptr<TimerWheel> & wheel = this->wheels[&loop];
+	if (!wheel)
+		wheel = new TimerWheel(loop);
+	
+	// get receive buffer pool of the event loop
+	ptr<BufferPool> & pool = this->pools[&loop];
+	if (!pool)
+		pool = new BufferPool();
 	
 	// add reference to this object until async_accept completes
 	addReference();
 	this->acceptor.async_accept(
 			channel->socket,
-			[this, channel] (error_code error) {
+			makeHandler(this->handlerMemory, [this, channel, wheel, pool] (error_code error) {
+				if (!this->acceptor.is_open()) {
+					// server was closed, e.g. after a handoff: close a connection that was accepted in the meantime
+					// so that the client connects again
+					channel->socket.close(error);
+					removeReference();
+					return;
+				}
 				if (error) {
 					onError(error);
 				} else {
 					// add a reference to the channel that keeps the channel alive until it is closed
 					channel->addReference();
-
-					// notify established connection
-					channel->onConnect();
 					
-					// start receiving
-					channel->receive();
+					// count the connection until the channel is closed
+					channel->server = this;
+#ifdef WITH_TLS
+					channel->tlsContext = this->tlsContext;
+#endif
+					int count = ++this->connectionCount;
+					bool full = this->maxConnections > 0 && count > this->maxConnections;
+
+					// start the channel on its event loop
+					channel->socket.get_io_service().dispatch([channel, wheel, pool, full] () {
+						// shed an idle connection if the limit is reached, otherwise reject the new connection
+						if (full && !wheel->closeIdle()) {
+							channel->close();
+							return;
+						}
+						channel->start(wheel, pool);
+					});
 				}
 				
 				// listen for the next incoming connection
@@ -36,7 +80,7 @@ bool Server::listen() {
 				
 				// remove reference to this object
 				removeReference();
-			});
+			}));
 	return true;
 }
 
@@ -46,3 +90,14 @@ void Server::close() {
 	if (error)
 		onError(error);
 }
+
+void Server::closeIdle() {
+	// the timer wheels are only used on their event loops
+	for (auto & entry : this->wheels) {
+		ptr<TimerWheel> wheel = entry.second;
+		entry.first->post([wheel] () {
+			while (wheel->closeIdle()) {
+			}
+		});
+	}
+}
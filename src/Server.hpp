@@ -1,24 +1,42 @@
 #pragma once
 
+#include <atomic>
+#include <map>
 #include <string>
 #include <system_error>
 #include "asio.hpp"
+#include "BufferPool.hpp"
+#include "HandlerMemory.hpp"
+#include "LoopPool.hpp"
+#include "TimerWheel.hpp"
 #include "Object.hpp"
 #include "ptr.hpp"
+#ifdef WITH_TLS
+#include "TlsContext.hpp"
+#endif
 
 
 class Channel;
 
 ///
-/// tcp server that listens on a socket and uses createChannel() for connecting clients
+/// stream server that listens on a TCP or UNIX domain socket and uses createChannel() for connecting clients
 class Server : public Object {
 	friend class Channel;
 public:
 	///
 	/// creates a new channel
 	/// @param loop an asio event loop
-	/// @param ipv4 or ipv6 address
-	Server(asio::io_service & loop, asio::ip::tcp::endpoint const & endpoint);
+	/// @param endpoint ipv4 or ipv6 address (asio::ip::tcp::endpoint) or path (asio::local::stream_protocol::endpoint)
+	/// @param pool optional pool of event loops, accepted connections are handed over to them in round-robin order
+	Server(asio::io_service & loop, asio::generic::stream_protocol::endpoint const & endpoint,
+		LoopPool * pool = nullptr);
+
+	///
+	/// takes over a socket that is already listening, e.g. one that was handed over by a previous process
+	/// @param loop an asio event loop
+	/// @param socket native handle of a listening TCP or UNIX domain socket
+	/// @param pool optional pool of event loops, accepted connections are handed over to them in round-robin order
+	Server(asio::io_service & loop, int socket, LoopPool * pool = nullptr);
 
 	~Server() override;
 
@@ -30,6 +48,32 @@ public:
 	/// close the server which will cause the destructor to be called at a later time
 	void close();
 
+	///
+	/// close the idle connections (e.g. idle keep-alive connections) on all event loops, e.g. when draining the
+	/// connections after close()
+	void closeIdle();
+
+	///
+	/// get the number of open connections
+	int getConnectionCount() const {return this->connectionCount;}
+
+	///
+	/// limit the number of open connections. When the limit is reached, the least recently active idle connection on
+	/// the event loop of a new connection gets closed, or the new connection if there is none
+	/// @param count maximum number of connections, no limit if zero
+	void setMaxConnections(int count) {this->maxConnections = count;}
+
+#ifdef WITH_TLS
+	///
+	/// accept TLS connections, the channels perform the handshake before onConnect() gets called
+	/// @param context TLS configuration with session cache, may be shared with other servers
+	void setTls(ptr<TlsContext> context) {this->tlsContext = context;}
+#endif
+
+	///
+	/// get the native handle of the listening socket, e.g. for handing it over to a new process
+	int getSocket() {return this->acceptor.native_handle();}
+
 protected:
 
 	///
@@ -45,6 +89,27 @@ protected:
 	//static void on_connect(uv_stream_t *handle, int status);
 	//static void on_closed(uv_handle_t *handle);
 
+	// memory for the asynchronous accept operations
+	HandlerMemory handlerMemory;
+
 	// server socket
-	asio::ip::tcp::acceptor acceptor;
+	asio::basic_socket_acceptor<asio::generic::stream_protocol> acceptor;
+	
+	// event loops for the channels, all channels run on the loop of the acceptor if null
+	LoopPool * pool;
+	
+	// timer wheel for the inactivity timeouts of the channels of each event loop
+	std::map<asio::io_service *, ptr<TimerWheel>> wheels;
+	
+	// receive buffers shared by the channels of each event loop
+	std::map<asio::io_service *, ptr<BufferPool>> pools;
+	
+	// maximum and current number of open connections, the channels decrement the count on their event loops
+	int maxConnections = 0;
+	std::atomic<int> connectionCount{0};
+
+#ifdef WITH_TLS
+	// TLS configuration, plaintext if null
+	ptr<TlsContext> tlsContext;
+#endif
 };
@@ -0,0 +1,158 @@
+#include <ctime>
+#include "StateCache.hpp"
+#include "cast.hpp"
+#include "http/JsonWriter.hpp"
+#include "http/Query.hpp"
+
+
+// Body
+
+StateCache::Body::~Body() {
+}
+
+
+// StateCache
+
+StateCache::StateCache(ptr<Network> network) : network(network.p), epoch(uint32_t(std::time(nullptr))) {
+	network->addListener(this);
+}
+
+StateCache::~StateCache() {
+}
+
+void StateCache::onChanged(uint32_t nodeId, Parameters const & parameters) {
+	auto it = this->slices.find(nodeId);
+	if (it != this->slices.end())
+		it->second.dirty = true;
+}
+
+void StateCache::getNodes(std::vector<std::pair<uint32_t, ptr<Body>>> & nodes) {
+	update();
+	for (auto const & p : this->slices) {
+		nodes.emplace_back(p.first, p.second.body);
+	}
+}
+
+void StateCache::getDocument(std::string & r, std::set<std::string> const & fields, bool json) {
+	update();
+	if (json) {
+		JsonWriter writer(r);
+		writer.beginArray();
+		for (auto const & p : this->slices) {
+			writer.beginObject();
+			writer.key("node");
+			writer.number(p.first);
+			for (auto const & parameter : p.second.parameters.parameters) {
+				if (fields.count(parameter.first) > 0) {
+					writer.key(parameter.first);
+					writer.value(parameter.second);
+				}
+			}
+			writer.endObject();
+		}
+		writer.endArray();
+	} else {
+		for (auto const & p : this->slices) {
+			render(r, p.first, p.second.parameters, fields);
+		}
+	}
+}
+
+ptr<StateCache::Body> StateCache::getNode(uint32_t nodeId) {
+	auto it = this->slices.find(nodeId);
+	if (it == this->slices.end()) {
+		// node may have been discovered
+		update();
+		it = this->slices.find(nodeId);
+		if (it == this->slices.end())
+			return nullptr;
+	}
+	Slice & slice = it->second;
+	if (slice.dirty) {
+		slice.dirty = false;
+		render(nodeId, slice);
+	}
+	return slice.body;
+}
+
+void StateCache::update() {
+	// nodes may have been discovered or removed
+	this->nodeIds.clear();
+	this->network->getNodeIds(this->nodeIds);
+	
+	auto it = this->slices.begin();
+	for (uint32_t nodeId : this->nodeIds) {
+		// drop slices of removed nodes
+		while (it != this->slices.end() && it->first < nodeId) {
+			it = this->slices.erase(it);
+		}
+		
+		// add slice of new node
+		if (it == this->slices.end() || it->first != nodeId) {
+			it = this->slices.insert(it, {nodeId, Slice{Parameters(), nullptr, true}});
+		}
+		
+		// render only slices of changed nodes
+		Slice & slice = it->second;
+		if (slice.dirty) {
+			slice.dirty = false;
+			render(nodeId, slice);
+		}
+		++it;
+	}
+	this->slices.erase(it, this->slices.end());
+}
+
+void StateCache::render(uint32_t nodeId, Slice & slice) {
+	slice.parameters.parameters.clear();
+	if (!this->network->get(nodeId, slice.parameters)) {
+		// node was removed
+		slice.parameters.parameters.clear();
+	}
+	
+	// create a new body, the previous one may still be in use
+	ptr<Body> body = new Body();
+	encodeParameters(body->data, slice.parameters);
+	body->etag = '"';
+	append(body->etag, this->epoch);
+	body->etag += '-';
+	append(body->etag, nodeId);
+	body->etag += '-';
+	append(body->etag, ++this->version);
+	body->etag += '"';
+	body->headers = "Content-Type: application/x-www-form-urlencoded\r\nContent-Length: ";
+	append(body->headers, body->data.length());
+	body->headers += "\r\nETag: ";
+	body->headers += body->etag;
+	body->headers += "\r\nVary: Accept\r\n";
+	
+	// JSON representation, the entity tag differs from the form representation
+	JsonWriter writer(body->json);
+	writer.beginObject();
+	writer.members(slice.parameters);
+	writer.endObject();
+	body->jsonEtag.assign(body->etag, 0, body->etag.length() - 1);
+	body->jsonEtag += "-json\"";
+	body->jsonHeaders = "Content-Type: application/json\r\nContent-Length: ";
+	append(body->jsonHeaders, body->json.length());
+	body->jsonHeaders += "\r\nETag: ";
+	body->jsonHeaders += body->jsonEtag;
+	body->jsonHeaders += "\r\nVary: Accept\r\n";
+	slice.body = body;
+}
+
+void StateCache::render(std::string & r, uint32_t nodeId, Parameters const & parameters,
+	std::set<std::string> const & fields)
+{
+	r += "node=";
+	append(r, nodeId);
+	for (auto const & p : parameters.parameters) {
+		if (fields.count(p.first) > 0) {
+			r += '&';
+			r += p.first;
+			r += '=';
+			encodeQuery(r, p.second);
+		}
+	}
+	r += '\n';
+}
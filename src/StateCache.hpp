@@ -0,0 +1,100 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "Network.hpp"
+#include "ptr.hpp"
+
+
+///
+/// State of all nodes of a network. The state of each node is rendered into an immutable body
+/// ("position.blinds=50&position.slat=50" and as JSON) which is only rendered again when the node has changed. The document of
+/// all nodes is streamed from a snapshot of the bodies. Use only on the event loop of the network, e.g. using
+/// network->loop.dispatch()
+class StateCache : public Network::Listener {
+public:
+	///
+	/// Constructor. Registers the cache as listener at the network, therefore construct on the event loop of the network
+	/// @param network network whose state is cached
+	StateCache(ptr<Network> network);
+
+	~StateCache() override;
+
+	///
+	/// Pre-rendered response for the state of one node. Immutable once created, therefore it can be shared with
+	/// channels on other event loops and sent without copying
+	class Body : public Object {
+	public:
+		~Body() override;
+
+		// state of the node as query string ("position.blinds=50&position.slat=50")
+		std::string data;
+
+		// entity tag of this version of the state (including quotes)
+		std::string etag;
+		
+		// Content-Type, Content-Length, ETag and Vary headers
+		std::string headers;
+		
+		// state of the node as JSON object ({"position.blinds":50,"position.slat":50}), its entity tag and headers
+		std::string json;
+		std::string jsonEtag;
+		std::string jsonHeaders;
+	};
+
+	void onChanged(uint32_t nodeId, Parameters const & parameters) override;
+
+	///
+	/// get state of all nodes. Only bodies of changed nodes are rendered again
+	/// @param nodes receives node id and body of all nodes in ascending order of the node id
+	void getNodes(std::vector<std::pair<uint32_t, ptr<Body>>> & nodes);
+
+	///
+	/// append state of all nodes, restricted to the given parameters
+	/// @param r string to append to
+	/// @param fields names of parameters to include
+	/// @param json JSON array of objects, otherwise one line per node
+	void getDocument(std::string & r, std::set<std::string> const & fields, bool json);
+
+	///
+	/// get state of a node. The body is rendered again only if the node has changed
+	/// @param nodeId id of node
+	/// @return body or null if the node does not exist
+	ptr<Body> getNode(uint32_t nodeId);
+
+	
+	// network whose state is cached (not owned by a ptr to prevent a reference cycle)
+	Network * network;
+
+protected:
+
+	struct Slice {
+		Parameters parameters;
+		ptr<Body> body;
+		bool dirty;
+	};
+
+	///
+	/// render slices of new and changed nodes and drop slices of removed nodes
+	void update();
+
+	///
+	/// render body of a node
+	void render(uint32_t nodeId, Slice & slice);
+
+	///
+	/// render a line of the state of a node restricted to the given parameters
+	static void render(std::string & r, uint32_t nodeId, Parameters const & parameters,
+		std::set<std::string> const & fields);
+
+
+	std::map<uint32_t, Slice> slices;
+	
+	std::vector<uint32_t> nodeIds;
+	
+	// entity tags are made unique by the start time and a version counter that increases on every render
+	uint32_t epoch;
+	uint32_t version = 0;
+};
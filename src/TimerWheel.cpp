@@ -0,0 +1,124 @@
+#include "Channel.hpp"
+#include "TimerWheel.hpp"
+
+
+TimerWheel::TimerWheel(asio::io_service & loop, int resolution)
+		: timer(loop), resolution(resolution) {
+}
+
+TimerWheel::~TimerWheel() {
+}
+
+void TimerWheel::add(Channel * channel) {
+	if (channel->wheelSlot >= 0)
+		return;
+	channel->lastActivity = this->time;
+	link(channel);
+	if (++this->count == 1 && !this->running)
+		start();
+}
+
+void TimerWheel::remove(Channel * channel) {
+	if (channel->wheelSlot < 0)
+		return;
+	unlink(channel);
+	--this->count;
+}
+
+bool TimerWheel::closeIdle() {
+	// find the idle channel with the oldest activity
+	Channel * oldest = nullptr;
+	for (Channel * channel : this->slots) {
+		for (; channel != nullptr; channel = channel->wheelNext) {
+			if ((oldest == nullptr || int32_t(channel->lastActivity - oldest->lastActivity) <= 0) && channel->isIdle())
+				oldest = channel;
+		}
+	}
+	if (oldest == nullptr)
+		return false;
+	
+	// keep the channel alive while closing it
+	ptr<Channel> p = oldest;
+	oldest->close();
+	return true;
+}
+
+void TimerWheel::link(Channel * channel) {
+	int slot = (channel->lastActivity + toTicks(channel->timeout)) % SLOT_COUNT;
+	channel->wheelSlot = slot;
+	channel->wheelPrev = nullptr;
+	channel->wheelNext = this->slots[slot];
+	if (channel->wheelNext != nullptr)
+		channel->wheelNext->wheelPrev = channel;
+	this->slots[slot] = channel;
+}
+
+void TimerWheel::unlink(Channel * channel) {
+	if (channel->wheelPrev != nullptr)
+		channel->wheelPrev->wheelNext = channel->wheelNext;
+	else
+		this->slots[channel->wheelSlot] = channel->wheelNext;
+	if (channel->wheelNext != nullptr)
+		channel->wheelNext->wheelPrev = channel->wheelPrev;
+	channel->wheelSlot = -1;
+	channel->wheelPrev = nullptr;
+	channel->wheelNext = nullptr;
+}
+
+void TimerWheel::start() {
+	this->running = true;
+	
+	// add reference to this object until async_wait completes
+	addReference();
+	
+	this->timer.expires_from_now(std::chrono::milliseconds(this->resolution));
+	this->timer.async_wait(makeHandler(this->handlerMemory, [this] (error_code error) {
+		// still running during the tick so that channels that are added again don't start a second timer
+		if (!error)
+			tick();
+		this->running = false;
+		
+		// only keep ticking while there are channels
+		if (!error && this->count > 0)
+			start();
+		
+		// remove reference to this object
+		removeReference();
+	}));
+}
+
+void TimerWheel::tick() {
+	++this->time;
+	int slot = this->time % SLOT_COUNT;
+	
+	// take the list of the current slot
+	Channel * channel = this->slots[slot];
+	this->slots[slot] = nullptr;
+	for (Channel * c = channel; c != nullptr; c = c->wheelNext) {
+		c->wheelSlot = -1;
+	}
+	
+	while (channel != nullptr) {
+		Channel * next = channel->wheelNext;
+		if (next != nullptr)
+			next->wheelPrev = nullptr;
+		channel->wheelPrev = nullptr;
+		channel->wheelNext = nullptr;
+		
+		uint32_t deadline = channel->lastActivity + toTicks(channel->timeout);
+		if (int32_t(deadline - this->time) > 0) {
+			// channel was active in the meantime: move to the slot of its new deadline
+			link(channel);
+		} else {
+			// channel is idle: keep it alive while notifying the timeout
+			--this->count;
+			ptr<Channel> p = channel;
+			channel->onTimeout();
+			
+			// the channel stays open if onTimeout() was overridden, then its timeout starts again
+			if (channel->socket.is_open() && channel->timeout > 0 && channel->wheelSlot < 0)
+				add(channel);
+		}
+		channel = next;
+	}
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "asio.hpp"
+#include "HandlerMemory.hpp"
+#include "Object.hpp"
+
+
+class Channel;
+
+///
+/// Coarse-grained hashed timer wheel for inactivity timeouts of channels. Channels only note the current tick when
+/// data is sent or received, a periodic tick walks one slot of the wheel and expires the channels that were idle for
+/// longer than their timeout. Only use from the event loop of the wheel
+class TimerWheel : public Object {
+public:
+	///
+	/// Constructor
+	/// @param loop event loop of the channels
+	/// @param resolution duration of one tick in milliseconds
+	TimerWheel(asio::io_service & loop, int resolution = 1000);
+
+	~TimerWheel() override;
+
+	///
+	/// add a channel, onTimeout() of the channel gets called when it is idle for longer than its timeout
+	void add(Channel * channel);
+
+	///
+	/// remove a channel
+	void remove(Channel * channel);
+
+	///
+	/// close the least recently active channel that is idle (e.g. an idle keep-alive connection)
+	/// @return false if no channel is idle
+	bool closeIdle();
+
+	///
+	/// get the current tick
+	uint32_t now() const {return this->time;}
+
+protected:
+
+	///
+	/// convert timeout in milliseconds to number of ticks, rounded up to not expire early
+	uint32_t toTicks(int timeout) const {return uint32_t((timeout + this->resolution - 1) / this->resolution) + 1;}
+
+	///
+	/// insert channel into the slot for its deadline
+	void link(Channel * channel);
+
+	///
+	/// remove channel from its slot
+	void unlink(Channel * channel);
+
+	///
+	/// start the periodic tick
+	void start();
+
+	///
+	/// advance the wheel by one tick
+	void tick();
+
+	enum {SLOT_COUNT = 64};
+
+	HandlerMemory handlerMemory;
+	asio::steady_timer timer;
+	int resolution;
+	bool running = false;
+
+	// current tick and number of channels in the wheel
+	uint32_t time = 0;
+	int count = 0;
+
+	// each slot is a list of channels that are due when the time modulo SLOT_COUNT reaches the slot index
+	Channel * slots[SLOT_COUNT] = {};
+};
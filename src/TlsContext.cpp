@@ -0,0 +1,77 @@
+#include "cast.hpp"
+#include "TlsContext.hpp"
+
+
+// select HTTP/2 if the client offers it, otherwise HTTP/1.1 (ALPN)
+static int selectProtocol(SSL * ssl, unsigned char const ** out, unsigned char * outLength, unsigned char const * in,
+	unsigned int inLength, void * arg)
+{
+	static unsigned char const protocols[] = "\x02h2\x08http/1.1";
+	if (SSL_select_next_proto(const_cast<unsigned char **>(out), outLength, protocols, sizeof(protocols) - 1, in,
+		inLength) != OPENSSL_NPN_NEGOTIATED)
+	{
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+	return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::TlsContext(std::string const & certificate, std::string const & privateKey)
+		: context(asio::ssl::context::sslv23_server) {
+	this->context.set_options(asio::ssl::context::default_workarounds | asio::ssl::context::no_sslv2
+		| asio::ssl::context::no_sslv3 | asio::ssl::context::no_tlsv1 | asio::ssl::context::no_tlsv1_1
+		| asio::ssl::context::single_dh_use);
+	this->context.use_certificate_chain_file(certificate);
+	this->context.use_private_key_file(privateKey, asio::ssl::context::pem);
+
+	SSL_CTX * ctx = this->context.native_handle();
+
+	// server side session cache for resumption by session id (TLS 1.2)
+	static unsigned char const sessionIdContext[] = "huasi";
+	SSL_CTX_set_session_id_context(ctx, sessionIdContext, sizeof(sessionIdContext) - 1);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+	SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+
+	// session tickets (TLS 1.2 and 1.3), the ticket keys are generated per process. One ticket per connection is
+	// enough as the clients reconnect one connection at a time
+	SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	SSL_CTX_set_num_tickets(ctx, 1);
+#endif
+
+	// release the read and write buffers of idle connections
+	SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+
+	// protocol negotiation for HTTP/2
+	SSL_CTX_set_alpn_select_cb(ctx, selectProtocol, nullptr);
+}
+
+TlsContext::~TlsContext() {
+}
+
+void TlsContext::addHandshake(bool resumed, int64_t microseconds) {
+	if (resumed) {
+		++this->resumedCount;
+		this->resumedTime += microseconds;
+	} else {
+		++this->fullCount;
+		this->fullTime += microseconds;
+	}
+}
+
+void TlsContext::getStats(std::string & s) {
+	int fullCount = this->fullCount;
+	int resumedCount = this->resumedCount;
+	s += "handshakes.full=";
+	append(s, fullCount);
+	s += "&handshakes.resumed=";
+	append(s, resumedCount);
+	s += "&handshakes.failed=";
+	append(s, int(this->failedCount));
+	s += "&time.full=";
+	append(s, fullCount > 0 ? int(this->fullTime / fullCount) : 0);
+	s += "&time.resumed=";
+	append(s, resumedCount > 0 ? int(this->resumedTime / resumedCount) : 0);
+	s += "&sessions=";
+	append(s, int(SSL_CTX_sess_number(this->context.native_handle())));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include "asio.hpp"
+#include "Object.hpp"
+
+
+///
+/// Server side TLS configuration shared by all channels of a server. Keeps a session cache and issues session
+/// tickets, so that clients that reconnect frequently (e.g. a mobile app) resume their session with an abbreviated
+/// handshake instead of a full handshake. Counts the handshakes and their duration to see how many resumptions hit.
+/// Can be used from all event loops
+class TlsContext : public Object {
+public:
+	///
+	/// Constructor, throws if the certificate or the private key can't be loaded
+	/// @param certificate PEM file with the certificate chain
+	/// @param privateKey PEM file with the private key
+	TlsContext(std::string const & certificate, std::string const & privateKey);
+
+	~TlsContext() override;
+
+	///
+	/// note a completed handshake
+	/// @param resumed true if a session was resumed
+	/// @param microseconds duration of the handshake
+	void addHandshake(bool resumed, int64_t microseconds);
+
+	///
+	/// note a failed handshake
+	void addFailure() {++this->failedCount;}
+
+	///
+	/// append handshake statistics as query string, e.g.
+	/// "handshakes.full=3&handshakes.resumed=12&handshakes.failed=0&time.full=2100&time.resumed=250&sessions=3"
+	/// where the times are the average durations in microseconds
+	void getStats(std::string & s);
+
+	asio::ssl::context context;
+
+protected:
+
+	enum {
+		// maximum number of sessions in the server side cache
+		SESSION_CACHE_SIZE = 1024,
+
+		// lifetime of sessions and tickets in seconds
+		SESSION_TIMEOUT = 24 * 60 * 60
+	};
+
+	std::atomic<int> fullCount{0};
+	std::atomic<int> resumedCount{0};
+	std::atomic<int> failedCount{0};
+	std::atomic<int64_t> fullTime{0};
+	std::atomic<int64_t> resumedTime{0};
+};
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <stdexcept>
+#include "cast.hpp"
+#include "http/Query.hpp"
+#include "Webhook.hpp"
+
+
+// Connection
+
+Webhook::Connection::~Connection() {
+}
+
+void Webhook::Connection::send(std::string && body) {
+	this->body = std::move(body);
+	this->inFlight = true;
+	this->status = 0;
+	if (this->connected) {
+		std::string data = this->body;
+		sendRequest(Method::POST, this->webhook->path, this->webhook->headers.c_str(), "text/plain",
+			std::move(data));
+	}
+}
+
+void Webhook::Connection::close() {
+	// keep alive while removing from the idle connections
+	ptr<Connection> connection = this;
+	std::vector<ptr<Connection>> & idle = this->webhook->idle;
+	idle.erase(std::remove(idle.begin(), idle.end(), connection), idle.end());
+
+	// retry the request in flight (also when connecting failed)
+	if (this->inFlight) {
+		this->inFlight = false;
+		this->webhook->onDone(nullptr, this->body);
+	}
+	HttpChannel::close();
+}
+
+void Webhook::Connection::onConnect() {
+	HttpChannel::onConnect();
+	this->connected = true;
+
+	// send the request that was waiting for the connection
+	if (this->inFlight) {
+		std::string data = this->body;
+		sendRequest(Method::POST, this->webhook->path, this->webhook->headers.c_str(), "text/plain",
+			std::move(data));
+	}
+}
+
+void Webhook::Connection::onResponse(int status) {
+	this->status = status;
+}
+
+void Webhook::Connection::onBody(uint8_t const * data, size_t length) {
+	// response body is ignored
+}
+
+void Webhook::Connection::onEnd() {
+	if (!this->inFlight)
+		return;
+	this->inFlight = false;
+
+	// retry on server errors, other responses mean the changes were delivered (or can never be)
+	if (this->status < 500)
+		this->body.clear();
+
+	if (isKeepAlive()) {
+		this->webhook->onDone(this, this->body);
+	} else {
+		this->webhook->onDone(nullptr, this->body);
+		close();
+	}
+}
+
+void Webhook::Connection::onError(error_code error) {
+	close();
+}
+
+
+// Webhook
+
+Webhook::Webhook(asio::io_service & loop, ptr<Network> network, std::string const & url)
+		: loop(loop), wheel(new TimerWheel(loop)), pool(new BufferPool()), timer(loop) {
+	// parse url
+	http_parser_url u;
+	http_parser_url_init(&u);
+	if (http_parser_parse_url(url.data(), url.length(), 0, &u) != 0 || !(u.field_set & (1 << UF_HOST))
+			|| url.compare(u.field_data[UF_SCHEMA].off, u.field_data[UF_SCHEMA].len, "http") != 0) {
+		throw std::invalid_argument("invalid webhook url: " + url);
+	}
+	std::string host = url.substr(u.field_data[UF_HOST].off, u.field_data[UF_HOST].len);
+	std::string port = (u.field_set & (1 << UF_PORT))
+		? url.substr(u.field_data[UF_PORT].off, u.field_data[UF_PORT].len) : std::string("80");
+	this->path = (u.field_set & (1 << UF_PATH))
+		? url.substr(u.field_data[UF_PATH].off) : std::string("/");
+
+	// resolve host once
+	asio::ip::tcp::resolver resolver(loop);
+	this->endpoint = resolver.resolve(asio::ip::tcp::resolver::query(host, port))->endpoint();
+
+	this->headers = "Host: " + host;
+	if (u.field_set & (1 << UF_PORT))
+		this->headers += ':' + port;
+	this->headers += "\r\nUser-Agent: huasi\r\n";
+
+	network->addListener(this);
+}
+
+Webhook::~Webhook() {
+}
+
+void Webhook::onChanged(uint32_t nodeId, Parameters const & parameters) {
+	std::string line = "node=";
+	append(line, nodeId);
+	encodeParameters(line, parameters);
+	line += '\n';
+
+	// continue on the event loop of the webhook
+	ptr<Webhook> webhook = this;
+	this->loop.post([webhook, line] () {
+		webhook->add(line);
+	});
+}
+
+void Webhook::add(std::string const & line) {
+	this->batch += line;
+	truncate();
+
+	// collect changes that arrive close together
+	schedule(BATCH_DELAY);
+}
+
+void Webhook::flush() {
+	if (this->batch.empty() || this->inFlight >= MAX_IN_FLIGHT)
+		return;
+
+	// reuse an idle connection or connect a new one
+	ptr<Connection> connection;
+	if (!this->idle.empty()) {
+		connection = this->idle.back();
+		this->idle.pop_back();
+	} else {
+		connection = new Connection(this->loop, this);
+		connection->connect(this->endpoint, this->wheel, this->pool);
+	}
+	++this->inFlight;
+	std::string body;
+	std::swap(body, this->batch);
+	connection->send(std::move(body));
+}
+
+void Webhook::onDone(Connection * connection, std::string & body) {
+	--this->inFlight;
+	if (connection != nullptr)
+		this->idle.push_back(connection);
+
+	if (!body.empty()) {
+		// failed: retry later, the failed changes go before the changes that arrived in the meantime
+		this->batch.insert(0, body);
+		body.clear();
+		truncate();
+		schedule(RETRY_DELAY);
+	} else {
+		// send changes that arrived in the meantime
+		flush();
+	}
+}
+
+void Webhook::truncate() {
+	if (this->batch.length() > MAX_BATCH_LENGTH) {
+		// drop the oldest changes
+		size_t end = this->batch.find('\n', this->batch.length() - MAX_BATCH_LENGTH);
+		this->batch.erase(0, end == std::string::npos ? this->batch.length() : end + 1);
+	}
+}
+
+void Webhook::schedule(int delay) {
+	if (this->scheduled)
+		return;
+	this->scheduled = true;
+
+	// add reference to this object until async_wait completes
+	addReference();
+	this->timer.expires_from_now(std::chrono::milliseconds(delay));
+	this->timer.async_wait([this] (error_code error) {
+		this->scheduled = false;
+		if (!error)
+			flush();
+
+		// remove reference to this object
+		removeReference();
+	});
+}
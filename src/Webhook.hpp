@@ -0,0 +1,123 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "http/HttpChannel.hpp"
+#include "BufferPool.hpp"
+#include "Network.hpp"
+#include "TimerWheel.hpp"
+#include "ptr.hpp"
+
+
+///
+/// Pushes changes of the nodes to a webhook url as POST requests with one line per change
+/// ("node=4&position.blinds=50"). Changes that arrive close together are batched into one request. The requests are
+/// sent over a pool of keep-alive connections with a limited number of requests in flight, further changes are
+/// batched until a request completes. The network only posts the changes to the event loop of the webhook, therefore
+/// delivery never stalls the event loop of the network
+class Webhook : public Network::Listener {
+public:
+	///
+	/// Constructor. Registers the webhook as listener at the network, therefore construct on the event loop of the
+	/// network. Throws if the url is invalid or the host can't be resolved
+	/// @param loop event loop for the connections
+	/// @param network network whose changes are pushed
+	/// @param url target url (e.g. "http://192.168.1.10:8080/huasi")
+	Webhook(asio::io_service & loop, ptr<Network> network, std::string const & url);
+
+	~Webhook() override;
+
+	void onChanged(uint32_t nodeId, Parameters const & parameters) override;
+
+protected:
+
+	enum {
+		// time in milliseconds to collect changes before a request is sent
+		BATCH_DELAY = 50,
+
+		// time in milliseconds to wait before retrying after a failed request
+		RETRY_DELAY = 1000,
+
+		// inactivity timeout of the connections in milliseconds
+		TIMEOUT = 10000,
+
+		// maximum number of requests in flight (and connections)
+		MAX_IN_FLIGHT = 2,
+
+		// maximum size of the batch, the oldest changes are dropped when the target does not keep up
+		MAX_BATCH_LENGTH = 65536
+	};
+
+	///
+	/// Keep-alive connection to the target, sends one request at a time
+	class Connection : public HttpChannel {
+	public:
+		Connection(asio::io_service & loop, ptr<Webhook> webhook)
+			: HttpChannel(loop, TIMEOUT, true), webhook(webhook) {}
+		~Connection() override;
+
+		///
+		/// send the body as POST request, when connecting the request is sent after the connection is established
+		void send(std::string && body);
+
+		void close() override;
+
+	protected:
+		void onConnect() override;
+		void onResponse(int status) override;
+		void onBody(uint8_t const * data, size_t length) override;
+		void onEnd() override;
+		void onError(error_code error) override;
+
+		ptr<Webhook> webhook;
+		bool connected = false;
+
+		// body of the request in flight, kept for retrying
+		std::string body;
+		bool inFlight = false;
+		int status = 0;
+	};
+
+	///
+	/// Add a change to the batch, called on the event loop of the webhook
+	void add(std::string const & line);
+
+	///
+	/// Send the batch if a request slot is free
+	void flush();
+
+	///
+	/// A request has completed
+	/// @param connection connection that can be reused or null if it was closed
+	/// @param body body of the request if it failed and should be retried, empty if delivered
+	void onDone(Connection * connection, std::string & body);
+
+	///
+	/// Drop the oldest changes if the batch exceeds MAX_BATCH_LENGTH
+	void truncate();
+
+	///
+	/// Start the timer that calls flush() after the given delay
+	void schedule(int delay);
+
+
+	asio::io_service & loop;
+	asio::generic::stream_protocol::endpoint endpoint;
+
+	// path of the url and headers of the requests
+	std::string path;
+	std::string headers;
+
+	// timer wheel and receive buffers of the connections
+	ptr<TimerWheel> wheel;
+	ptr<BufferPool> pool;
+
+	// changes that are not sent yet, one line per change
+	std::string batch;
+	asio::steady_timer timer;
+	bool scheduled = false;
+
+	// idle keep-alive connections and number of requests in flight
+	std::vector<ptr<Connection>> idle;
+	int inFlight = 0;
+};
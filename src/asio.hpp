@@ -1,10 +1,17 @@
 #pragma once
 
 #include "asio/io_service.hpp"
+#include "asio/basic_socket_acceptor.hpp"
+#include "asio/generic/stream_protocol.hpp"
+#include "asio/local/stream_protocol.hpp"
 #include "asio/serial_port.hpp"
 #include "asio/ip/tcp.hpp"
+#include "asio/ip/udp.hpp"
 #include "asio/steady_timer.hpp"
 #include "asio/write.hpp"
+#ifdef WITH_TLS
+#include "asio/ssl.hpp"
+#endif
 
 using std::error_code;
 using std::error_category;
@@ -14,5 +21,10 @@ inline bool isCanceled(std::error_code error) {
 }
 
 inline bool isEof(std::error_code error) {
+#ifdef WITH_TLS
+	// peer closed the connection without TLS close_notify
+	if (error == asio::ssl::error::stream_truncated)
+		return true;
+#endif
 	return error.category() == asio::error::get_misc_category() && error.value() == asio::error::eof;
 }
@@ -1,13 +1,15 @@
 #pragma once
 
+#include <limits>
 #include <string>
 #include "optional.hpp"
 #include "ptr.hpp"
+#include "string_view.hpp"
 
 
 /// cast string to integer. Returns null value if conversion is not possible
 template <typename D, typename std::enable_if<std::is_integral<D>::value>::type* = nullptr>
-optional<D> cast(std::string s) {
+optional<D> cast(string_view s) {
   using UD = typename std::make_unsigned<D>::type;
 
   D d = 0;
@@ -43,15 +45,12 @@ optional<D> cast(std::string s) {
 }
 
 
-/// cast integer to string. always succeeds
-template <typename D, typename S, typename std::enable_if<std::is_integral<S>::value>::type* = nullptr>
-D cast(S s) {
-  char buffer[sizeof(s) * 3 + 2];
-
+/// format integer as decimal into a buffer that ends at the given position. Returns the start of the number
+template <typename S, typename std::enable_if<std::is_integral<S>::value>::type* = nullptr>
+char * format(char * end, S s) {
   typename std::make_unsigned<S>::type value = s < 0 ? -s : s;
 
-  char * b = std::end(buffer) - 1;
-  *b = 0;
+  char * b = end;
   do {
      --b;
      *b = '0' + value % 10;
@@ -67,6 +66,27 @@ D cast(S s) {
 }
 
 
+/// cast integer to string. always succeeds
+template <typename D, typename S, typename std::enable_if<std::is_integral<S>::value>::type* = nullptr>
+D cast(S s) {
+  char buffer[sizeof(s) * 3 + 2];
+
+  char * b = std::end(buffer) - 1;
+  *b = 0;
+  return format(b, s);
+}
+
+
+/// append integer to string without temporary string. always succeeds
+template <typename S, typename std::enable_if<std::is_integral<S>::value>::type* = nullptr>
+void append(std::string & d, S s) {
+  char buffer[sizeof(s) * 3 + 1];
+
+  char * e = std::end(buffer);
+  d.append(format(e, s), e);
+}
+
+
 /// cast pointer. Returns null pointer if conversion is not possible
 template <typename D, typename S>
 ptr<D> cast(ptr<S> s) {
@@ -0,0 +1,175 @@
+#include "CoapMessage.hpp"
+
+
+// decode an unsigned integer option value (0 to 4 bytes in network byte order)
+static optional<uint32_t> decodeUint(uint8_t const * data, size_t length) {
+	if (length > 4)
+		return nullptr;
+	uint32_t value = 0;
+	for (size_t i = 0; i < length; ++i) {
+		value = value << 8 | data[i];
+	}
+	return value;
+}
+
+// append an option delta or length nibble extension, returns the nibble
+static int encodeExtended(uint32_t value, std::string & extension) {
+	if (value < 13)
+		return value;
+	if (value < 269) {
+		extension += char(value - 13);
+		return 13;
+	}
+	value -= 269;
+	extension += char(value >> 8);
+	extension += char(value);
+	return 14;
+}
+
+
+// CoapMessage
+
+bool CoapMessage::parse(uint8_t const * data, size_t length) {
+	this->pathCount = 0;
+	this->query.parameters.clear();
+	this->observe = nullptr;
+	this->contentFormat = nullptr;
+	this->accept = nullptr;
+	this->unknownCritical = false;
+	this->payload = string_view();
+
+	// header: version, type, token length, code and message id
+	if (length < 4 || (data[0] >> 6) != 1)
+		return false;
+	this->type = Type((data[0] >> 4) & 3);
+	int tokenLength = data[0] & 0x0f;
+	this->code = data[1];
+	this->messageId = uint16_t(data[2] << 8 | data[3]);
+	if (tokenLength > MAX_TOKEN_LENGTH || 4 + size_t(tokenLength) > length)
+		return false;
+	this->token = string_view((char const *)data + 4, tokenLength);
+
+	// an empty message consists of the header only
+	if (this->code == EMPTY)
+		return tokenLength == 0 && length == 4;
+
+	// options with delta encoded numbers until the payload marker or the end
+	uint8_t const * it = data + 4 + tokenLength;
+	uint8_t const * end = data + length;
+	uint32_t number = 0;
+	while (it < end) {
+		int header = *it++;
+		if (header == 0xff) {
+			// payload marker must be followed by a payload
+			if (it == end)
+				return false;
+			this->payload = string_view((char const *)it, end - it);
+			break;
+		}
+
+		// delta and length nibbles with one or two extension bytes
+		uint32_t values[2] = {uint32_t(header >> 4), uint32_t(header & 0x0f)};
+		for (uint32_t & value : values) {
+			if (value == 13) {
+				if (it == end)
+					return false;
+				value = 13 + *it++;
+			} else if (value == 14) {
+				if (end - it < 2)
+					return false;
+				value = 269 + (it[0] << 8 | it[1]);
+				it += 2;
+			} else if (value == 15) {
+				return false;
+			}
+		}
+		number += values[0];
+		uint32_t optionLength = values[1];
+		if (optionLength > size_t(end - it))
+			return false;
+		uint8_t const * value = it;
+		it += optionLength;
+
+		switch (number) {
+		case URI_PATH:
+			if (this->pathCount < MAX_PATH_SEGMENTS)
+				this->path[this->pathCount] = string_view((char const *)value, optionLength);
+			if (this->pathCount <= MAX_PATH_SEGMENTS)
+				++this->pathCount;
+			break;
+		case URI_QUERY:
+		{
+			string_view q((char const *)value, optionLength);
+			size_t pos = q.find('=');
+			if (pos == string_view::npos)
+				this->query.parameters[q.str()];
+			else
+				this->query.parameters[q.substr(0, pos).str()] = q.substr(pos + 1).str();
+			break;
+		}
+		case OBSERVE:
+			this->observe = decodeUint(value, optionLength);
+			break;
+		case CONTENT_FORMAT:
+			this->contentFormat = decodeUint(value, optionLength);
+			break;
+		case ACCEPT:
+			this->accept = decodeUint(value, optionLength);
+			break;
+		case URI_HOST:
+		case URI_PORT:
+			// the server answers for all hosts and ports it receives on
+			break;
+		default:
+			// elective options (even numbers) can be ignored
+			if (number & 1)
+				this->unknownCritical = true;
+		}
+	}
+	return true;
+}
+
+bool CoapMessage::isPath(char const * segment1, char const * segment2) const {
+	if (segment2 == nullptr)
+		return this->pathCount == 1 && this->path[0] == segment1;
+	return this->pathCount == 2 && this->path[0] == segment1 && this->path[1] == segment2;
+}
+
+
+// CoapWriter
+
+CoapWriter::CoapWriter(std::string & r, CoapMessage::Type type, int code, uint16_t messageId, string_view token)
+		: r(r) {
+	r.clear();
+	r += char(0x40 | type << 4 | token.length());
+	r += char(code);
+	r += char(messageId >> 8);
+	r += char(messageId);
+	r.append(token.data(), token.length());
+}
+
+void CoapWriter::option(int number, string_view value) {
+	// header byte with delta and length nibbles, followed by their extensions
+	std::string extension;
+	int delta = encodeExtended(number - this->number, extension);
+	int length = encodeExtended(uint32_t(value.length()), extension);
+	this->r += char(delta << 4 | length);
+	this->r += extension;
+	this->r.append(value.data(), value.length());
+	this->number = number;
+}
+
+void CoapWriter::option(int number, uint32_t value) {
+	char bytes[4];
+	int length = 0;
+	for (int shift = 24; shift >= 0; shift -= 8) {
+		if (length > 0 || (value >> shift) != 0)
+			bytes[length++] = char(value >> shift);
+	}
+	option(number, string_view(bytes, length));
+}
+
+std::string & CoapWriter::payload() {
+	this->r += char(0xff);
+	return this->r;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "../Parameters.hpp"
+#include "../optional.hpp"
+#include "../string_view.hpp"
+
+
+///
+/// CoAP message (RFC 7252) that is parsed from a datagram. Only the options that the server uses are decoded, the
+/// token and the payload refer to the datagram
+class CoapMessage {
+public:
+
+	enum Type {
+		CONFIRMABLE = 0,
+		NON_CONFIRMABLE = 1,
+		ACKNOWLEDGEMENT = 2,
+		RESET = 3
+	};
+
+	// codes as class * 32 + detail, e.g. 0x45 for 2.05
+	enum Code {
+		EMPTY = 0x00,
+		GET = 0x01,
+		POST = 0x02,
+		PUT = 0x03,
+		DELETE = 0x04,
+		CHANGED = 0x44,
+		CONTENT = 0x45,
+		BAD_REQUEST = 0x80,
+		BAD_OPTION = 0x82,
+		NOT_FOUND = 0x84,
+		METHOD_NOT_ALLOWED = 0x85,
+		NOT_ACCEPTABLE = 0x86,
+		REQUEST_ENTITY_TOO_LARGE = 0x8d,
+		UNSUPPORTED_CONTENT_FORMAT = 0x8f,
+		TOO_MANY_REQUESTS = 0x9d,
+		SERVICE_UNAVAILABLE = 0xa3
+	};
+
+	enum Option {
+		URI_HOST = 3,
+		ETAG = 4,
+		OBSERVE = 6,
+		URI_PORT = 7,
+		URI_PATH = 11,
+		CONTENT_FORMAT = 12,
+		MAX_AGE = 14,
+		URI_QUERY = 15,
+		ACCEPT = 17
+	};
+
+	enum Format {
+		TEXT_PLAIN = 0,
+		LINK_FORMAT = 40,
+		JSON = 50
+	};
+
+	enum {
+		// maximum number of Uri-Path options
+		MAX_PATH_SEGMENTS = 4,
+
+		// maximum length of a token
+		MAX_TOKEN_LENGTH = 8
+	};
+
+	///
+	/// parse a datagram
+	/// @return false if the datagram is no valid CoAP message
+	bool parse(uint8_t const * data, size_t length);
+
+	///
+	/// check if the path consists of the given segments
+	bool isPath(char const * segment1, char const * segment2 = nullptr) const;
+
+	Type type;
+	int code;
+	uint16_t messageId;
+	string_view token;
+
+	// Uri-Path options, a path with more segments is marked by pathCount > MAX_PATH_SEGMENTS
+	string_view path[MAX_PATH_SEGMENTS];
+	int pathCount;
+
+	// Uri-Query options ("position.blinds=50"), not percent-encoded
+	Parameters query;
+
+	optional<uint32_t> observe;
+	optional<uint32_t> contentFormat;
+	optional<uint32_t> accept;
+
+	// the message contains a critical option (odd number) that the server does not understand
+	bool unknownCritical;
+
+	string_view payload;
+};
+
+///
+/// Builds a CoAP message into a string. Options have to be added in ascending order of their numbers
+class CoapWriter {
+public:
+	///
+	/// Constructor, writes the header and the token
+	/// @param r string to write to, gets cleared
+	CoapWriter(std::string & r, CoapMessage::Type type, int code, uint16_t messageId, string_view token);
+
+	///
+	/// add an option with an opaque or string value
+	void option(int number, string_view value);
+
+	///
+	/// add an option with an unsigned integer value in the shortest form
+	void option(int number, uint32_t value);
+
+	///
+	/// start the payload, the caller appends the payload to the string which must not be empty
+	std::string & payload();
+
+protected:
+
+	std::string & r;
+	int number = 0;
+};
@@ -0,0 +1,468 @@
+#include <sys/socket.h> // getsockname
+#include "../http/FormParser.hpp"
+#include "../http/JsonParser.hpp"
+#include "../cast.hpp"
+#include "CoapServer.hpp"
+
+
+// parse a node id, only digits are allowed
+static optional<uint32_t> parseNodeId(string_view s) {
+	if (s.empty() || s.length() > 9)
+		return nullptr;
+	uint32_t nodeId = 0;
+	for (char ch : s) {
+		if (ch < '0' || ch > '9')
+			return nullptr;
+		nodeId = nodeId * 10 + (ch - '0');
+	}
+	return nodeId;
+}
+
+// get the address of a client as key for rate limiting
+static std::string getClient(asio::ip::udp::endpoint const & endpoint) {
+	asio::ip::address address = endpoint.address();
+	if (address.is_v4()) {
+		auto bytes = address.to_v4().to_bytes();
+		return std::string((char const *)bytes.data(), bytes.size());
+	}
+	auto bytes = address.to_v6().to_bytes();
+	return std::string((char const *)bytes.data(), bytes.size());
+}
+
+
+// CoapServer
+
+CoapServer::CoapServer(asio::io_service & loop, asio::ip::udp::endpoint const & endpoint, ptr<ZWaveNetwork> network,
+		ptr<StateCache> cache, ptr<RateLimiter> limiter)
+		: socket(loop, endpoint), timer(loop), network(network), cache(cache), limiter(limiter)
+		, random(uint32_t(Clock::now().time_since_epoch().count())) {
+	this->messageId = uint16_t(this->random());
+	this->socket.non_blocking(true);
+}
+
+CoapServer::CoapServer(asio::io_service & loop, int socket, ptr<ZWaveNetwork> network, ptr<StateCache> cache,
+		ptr<RateLimiter> limiter)
+		: socket(loop), timer(loop), network(network), cache(cache), limiter(limiter)
+		, random(uint32_t(Clock::now().time_since_epoch().count())) {
+	// get the protocol from the address family of the socket
+	sockaddr_storage address = {};
+	socklen_t length = sizeof(address);
+	::getsockname(socket, (sockaddr *)&address, &length);
+	this->socket.assign(address.ss_family == AF_INET6 ? asio::ip::udp::v6() : asio::ip::udp::v4(), socket);
+	this->messageId = uint16_t(this->random());
+	this->socket.non_blocking(true);
+}
+
+CoapServer::~CoapServer() {
+}
+
+void CoapServer::start() {
+	// the cache was registered at the network before, therefore it is up to date when this server gets notified
+	this->network->addListener(this);
+	this->listening = true;
+	receive();
+}
+
+void CoapServer::close() {
+	endObservations();
+	if (this->listening) {
+		this->listening = false;
+		this->network->removeListener(this);
+	}
+	this->timer.cancel();
+	this->socket.close();
+}
+
+void CoapServer::onChanged(uint32_t nodeId, Parameters const & parameters) {
+	// render the state once for all observers of the node
+	ptr<StateCache::Body> body;
+	for (auto it = this->observers.begin(); it != this->observers.end(); ++it) {
+		if (it->nodeId != nodeId)
+			continue;
+		if (!body) {
+			body = this->cache->getNode(nodeId);
+			if (!body)
+				return;
+			this->sequence = (this->sequence + 1) & 0xffffff;
+		}
+		notify(*it, body);
+	}
+	schedule();
+}
+
+void CoapServer::onClose() {
+	endObservations();
+}
+
+void CoapServer::receive() {
+	// add reference to this object until async_receive_from completes
+	addReference();
+	this->socket.async_receive_from(asio::buffer(this->receiveBuffer), this->sender,
+		makeHandler(this->handlerMemory, [this] (error_code error, size_t length) {
+			if (!this->socket.is_open()) {
+				// server was closed
+				removeReference();
+				return;
+			}
+			if (error)
+				onError(error);
+			else if (length <= MAX_MESSAGE_SIZE)
+				onReceive(this->sender, length);
+
+			// receive the next datagram
+			receive();
+
+			// remove reference to this object
+			removeReference();
+		}));
+}
+
+void CoapServer::onReceive(Endpoint const & endpoint, size_t length) {
+	CoapMessage & request = this->request;
+	if (!request.parse(this->receiveBuffer, length)) {
+		// reject confirmable messages with a format error, others are silently ignored
+		uint8_t const * data = this->receiveBuffer;
+		if (length >= 4 && (data[0] >> 6) == 1 && ((data[0] >> 4) & 3) == CoapMessage::CONFIRMABLE) {
+			CoapWriter(this->buffer, CoapMessage::RESET, CoapMessage::EMPTY, uint16_t(data[2] << 8 | data[3]),
+				string_view());
+			send(endpoint, this->buffer);
+		}
+		return;
+	}
+
+	// acknowledgement or reset of a notification
+	if (request.type == CoapMessage::ACKNOWLEDGEMENT || request.type == CoapMessage::RESET) {
+		for (auto it = this->observers.begin(); it != this->observers.end(); ++it) {
+			if (it->messageId == request.messageId && it->endpoint == endpoint) {
+				if (request.type == CoapMessage::RESET) {
+					this->observers.erase(it);
+				} else {
+					it->pending = false;
+					it->message.clear();
+				}
+				break;
+			}
+		}
+		return;
+	}
+
+	// the server sends no requests, therefore responses and empty messages (ping) get a reset
+	if (request.code == CoapMessage::EMPTY || request.code >= 0x20) {
+		if (request.type == CoapMessage::CONFIRMABLE) {
+			CoapWriter(this->buffer, CoapMessage::RESET, CoapMessage::EMPTY, request.messageId, string_view());
+			send(endpoint, this->buffer);
+		}
+		return;
+	}
+
+	// a retransmitted request gets the same response without being executed again
+	auto now = Clock::now();
+	for (Exchange & exchange : this->exchanges) {
+		if (exchange.messageId == request.messageId && exchange.endpoint == endpoint
+			&& now - exchange.time < std::chrono::milliseconds(EXCHANGE_LIFETIME))
+		{
+			send(endpoint, exchange.response);
+			return;
+		}
+	}
+
+	handleRequest(endpoint);
+	send(endpoint, this->buffer);
+
+	// remember the response in place of the oldest one
+	Exchange & exchange = this->exchanges[this->exchangeIndex];
+	this->exchangeIndex = (this->exchangeIndex + 1) % MAX_EXCHANGES;
+	exchange.endpoint = endpoint;
+	exchange.messageId = request.messageId;
+	exchange.time = now;
+	exchange.response.assign(this->buffer);
+
+	// a registration may have answered a pending notification
+	schedule();
+}
+
+void CoapServer::handleRequest(Endpoint const & endpoint) {
+	CoapMessage const & request = this->request;
+	if (request.unknownCritical) {
+		respond(CoapMessage::BAD_OPTION);
+	} else if (request.isPath(".well-known", "core")) {
+		if (request.code == CoapMessage::GET)
+			handleDiscovery();
+		else
+			respond(CoapMessage::METHOD_NOT_ALLOWED);
+	} else if (request.pathCount == 2 && request.path[0] == "node") {
+		optional<uint32_t> nodeId = parseNodeId(request.path[1]);
+		if (nodeId)
+			handleNode(endpoint, *nodeId);
+		else
+			respond(CoapMessage::NOT_FOUND);
+	} else {
+		respond(CoapMessage::NOT_FOUND);
+	}
+}
+
+void CoapServer::handleNode(Endpoint const & endpoint, uint32_t nodeId) {
+	CoapMessage const & request = this->request;
+	if (request.code == CoapMessage::GET) {
+		// query string as text/plain by default, JSON if the client asks for it
+		if (request.accept && *request.accept != CoapMessage::TEXT_PLAIN && *request.accept != CoapMessage::JSON) {
+			respond(CoapMessage::NOT_ACCEPTABLE);
+			return;
+		}
+		bool json = request.accept && *request.accept == CoapMessage::JSON;
+
+		// Observe 0 registers, 1 deregisters
+		ptr<StateCache::Body> body = this->cache->getNode(nodeId);
+		bool observing = false;
+		if (request.observe && *request.observe == 1)
+			removeObserver(endpoint, request.token);
+		else if (request.observe && *request.observe == 0 && body)
+			observing = addObserver(endpoint, nodeId, json);
+		if (!body) {
+			respond(CoapMessage::NOT_FOUND);
+			return;
+		}
+
+		CoapWriter writer = beginResponse(CoapMessage::CONTENT);
+		if (observing)
+			writer.option(CoapMessage::OBSERVE, this->sequence);
+		writer.option(CoapMessage::CONTENT_FORMAT, uint32_t(json ? CoapMessage::JSON : CoapMessage::TEXT_PLAIN));
+		std::string const & data = json ? body->json : body->data;
+		if (!data.empty())
+			writer.payload() += data;
+	} else if (request.code == CoapMessage::PUT || request.code == CoapMessage::POST) {
+		// parameters of Uri-Query options and the payload
+		this->record = request.query;
+		this->tooLarge = this->record.parameters.size() > MAX_RECORD_FIELDS;
+		if (!this->tooLarge && !request.payload.empty()) {
+			int format = request.contentFormat ? int(*request.contentFormat) : int(CoapMessage::TEXT_PLAIN);
+			uint8_t const * data = (uint8_t const *)request.payload.data();
+			bool valid;
+			if (format == CoapMessage::TEXT_PLAIN) {
+				FormParser parser(*this);
+				valid = parser.parse(data, request.payload.length()) && parser.finish();
+			} else if (format == CoapMessage::JSON) {
+				JsonParser parser(*this);
+				valid = parser.parse(data, request.payload.length()) && parser.finish();
+			} else {
+				respond(CoapMessage::UNSUPPORTED_CONTENT_FORMAT);
+				return;
+			}
+			if (!valid && !this->tooLarge) {
+				respond(CoapMessage::BAD_REQUEST);
+				return;
+			}
+		}
+		if (this->tooLarge) {
+			respond(CoapMessage::REQUEST_ENTITY_TOO_LARGE);
+			return;
+		}
+
+		// network was handed over to a new process or too many commands wait for the serial link
+		if (!this->network->isOpen() || this->network->isSaturated()) {
+			respondRetryLater(CoapMessage::SERVICE_UNAVAILABLE, 1);
+			return;
+		}
+
+		// client exceeds its rate
+		int retryAfter = 1;
+		if (this->limiter && !this->limiter->acquire(getClient(endpoint), 1, retryAfter)) {
+			respondRetryLater(CoapMessage::TOO_MANY_REQUESTS, retryAfter);
+			return;
+		}
+
+		bool found = this->network->sendSet(nodeId, this->record);
+		respond(found ? CoapMessage::CHANGED : CoapMessage::NOT_FOUND);
+	} else {
+		respond(CoapMessage::METHOD_NOT_ALLOWED);
+	}
+}
+
+void CoapServer::handleDiscovery() {
+	// link format (RFC 6690) with the observable nodes
+	std::vector<uint32_t> nodeIds;
+	this->network->getNodeIds(nodeIds);
+	CoapWriter writer = beginResponse(CoapMessage::CONTENT);
+	writer.option(CoapMessage::CONTENT_FORMAT, uint32_t(CoapMessage::LINK_FORMAT));
+	std::string & data = writer.payload();
+	bool first = true;
+	for (uint32_t nodeId : nodeIds) {
+		if (!first)
+			data += ',';
+		first = false;
+		data += "</node/";
+		append(data, nodeId);
+		data += ">;ct=\"0 50\";obs";
+	}
+
+	// an empty payload has no payload marker
+	if (first)
+		data.pop_back();
+}
+
+CoapWriter CoapServer::beginResponse(int code) {
+	CoapMessage const & request = this->request;
+	if (request.type == CoapMessage::CONFIRMABLE) {
+		// piggybacked response
+		return CoapWriter(this->buffer, CoapMessage::ACKNOWLEDGEMENT, code, request.messageId, request.token);
+	}
+	return CoapWriter(this->buffer, CoapMessage::NON_CONFIRMABLE, code, this->messageId++, request.token);
+}
+
+void CoapServer::respond(int code) {
+	beginResponse(code);
+}
+
+void CoapServer::respondRetryLater(int code, int retryAfter) {
+	CoapWriter writer = beginResponse(code);
+	writer.option(CoapMessage::MAX_AGE, uint32_t(retryAfter));
+}
+
+bool CoapServer::addObserver(Endpoint const & endpoint, uint32_t nodeId, bool json) {
+	string_view token = this->request.token;
+
+	// a registration with the token of an existing observation replaces it
+	Observer * observer = nullptr;
+	for (Observer & o : this->observers) {
+		if (o.endpoint == endpoint && o.token == token) {
+			observer = &o;
+			break;
+		}
+	}
+	if (observer == nullptr) {
+		if (this->observers.size() >= MAX_OBSERVERS)
+			return false;
+		this->observers.emplace_back();
+		observer = &this->observers.back();
+		observer->endpoint = endpoint;
+		observer->token.assign(token.data(), token.length());
+		observer->messageId = 0;
+	}
+	observer->nodeId = nodeId;
+	observer->json = json;
+	observer->count = 0;
+	observer->pending = false;
+	observer->message.clear();
+	return true;
+}
+
+void CoapServer::removeObserver(Endpoint const & endpoint, string_view token) {
+	for (auto it = this->observers.begin(); it != this->observers.end(); ++it) {
+		if (it->endpoint == endpoint && it->token == token) {
+			this->observers.erase(it);
+			break;
+		}
+	}
+}
+
+void CoapServer::notify(Observer & observer, ptr<StateCache::Body> const & body) {
+	// confirmable when a notification is still in flight or to check from time to time that the observer is there
+	bool confirmable = observer.pending || ++observer.count >= CONFIRMABLE_INTERVAL;
+	std::string & message = confirmable ? observer.message : this->buffer;
+	observer.messageId = this->messageId++;
+	CoapWriter writer(message, confirmable ? CoapMessage::CONFIRMABLE : CoapMessage::NON_CONFIRMABLE,
+		CoapMessage::CONTENT, observer.messageId, observer.token);
+	writer.option(CoapMessage::OBSERVE, this->sequence);
+	writer.option(CoapMessage::CONTENT_FORMAT,
+		uint32_t(observer.json ? CoapMessage::JSON : CoapMessage::TEXT_PLAIN));
+	std::string const & data = observer.json ? body->json : body->data;
+	if (!data.empty())
+		writer.payload() += data;
+	send(observer.endpoint, message);
+
+	if (confirmable) {
+		observer.count = 0;
+		if (!observer.pending) {
+			// initial timeout between ACK_TIMEOUT and ACK_TIMEOUT * 1.5
+			observer.pending = true;
+			observer.retransmitCount = 0;
+			observer.timeout = std::chrono::milliseconds(ACK_TIMEOUT + this->random() % (ACK_TIMEOUT / 2 + 1));
+			observer.deadline = Clock::now() + observer.timeout;
+		}
+	}
+}
+
+void CoapServer::endObservations() {
+	if (this->socket.is_open()) {
+		for (Observer & observer : this->observers) {
+			CoapWriter(this->buffer, CoapMessage::NON_CONFIRMABLE, CoapMessage::SERVICE_UNAVAILABLE,
+				this->messageId++, observer.token);
+			send(observer.endpoint, this->buffer);
+		}
+	}
+	this->observers.clear();
+}
+
+void CoapServer::schedule() {
+	// earliest deadline of the pending notifications
+	bool pending = false;
+	Clock::time_point deadline;
+	for (Observer & observer : this->observers) {
+		if (observer.pending && (!pending || observer.deadline < deadline)) {
+			pending = true;
+			deadline = observer.deadline;
+		}
+	}
+	if (!pending || (this->timerRunning && this->timerDeadline <= deadline))
+		return;
+
+	// add reference to this object until async_wait completes
+	addReference();
+
+	// setting the expiry cancels a running wait
+	this->timerRunning = true;
+	this->timerDeadline = deadline;
+	this->timer.expires_at(deadline);
+	this->timer.async_wait(makeHandler(this->handlerMemory, [this] (error_code error) {
+		if (!error) {
+			this->timerRunning = false;
+			retransmit();
+		}
+
+		// remove reference to this object
+		removeReference();
+	}));
+}
+
+void CoapServer::retransmit() {
+	auto now = Clock::now();
+	for (auto it = this->observers.begin(); it != this->observers.end();) {
+		Observer & observer = *it;
+		if (observer.pending && observer.deadline <= now) {
+			if (observer.retransmitCount >= MAX_RETRANSMIT) {
+				// observer is gone
+				it = this->observers.erase(it);
+				continue;
+			}
+
+			// double the timeout with every retransmission
+			++observer.retransmitCount;
+			observer.timeout *= 2;
+			observer.deadline += observer.timeout;
+			send(observer.endpoint, observer.message);
+		}
+		++it;
+	}
+	schedule();
+}
+
+void CoapServer::send(Endpoint const & endpoint, std::string const & message) {
+	// datagrams are sent without waiting, a full send buffer drops the message like the network would
+	error_code error;
+	this->socket.send_to(asio::buffer(message), endpoint, 0, error);
+}
+
+bool CoapServer::onField(string_view key, string_view value) {
+	Parameters & record = this->record;
+	record.parameters[key.str()].assign(value.data(), value.length());
+	if (record.parameters.size() > MAX_RECORD_FIELDS) {
+		this->tooLarge = true;
+		return false;
+	}
+	return true;
+}
+
+bool CoapServer::onRecord() {
+	// all records add to the parameters of the node
+	return true;
+}
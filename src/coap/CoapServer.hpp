@@ -0,0 +1,195 @@
+#pragma once
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "../http/BodyParser.hpp"
+#include "../zwave/ZWaveNetwork.hpp"
+#include "../HandlerMemory.hpp"
+#include "../RateLimiter.hpp"
+#include "../StateCache.hpp"
+#include "CoapMessage.hpp"
+
+
+///
+/// CoAP server (RFC 7252) on UDP for constrained clients. Exposes the nodes like Gateway: GET /node/{id} gets the
+/// state as query string (text/plain) or JSON (Accept: 50), PUT and POST set parameters from Uri-Query options and
+/// the payload. A GET with Observe 0 registers the client for notifications when the node changes (RFC 7641).
+/// Requests are answered with piggybacked responses. Every CONFIRMABLE_INTERVAL-th notification is confirmable and
+/// retransmitted with exponential backoff, an observer that does not acknowledge it or resets a notification is
+/// removed. Runs on the event loop of the network
+class CoapServer : public Network::Listener, protected BodyParser::Listener {
+public:
+	///
+	/// Constructor
+	/// @param loop event loop of the network
+	/// @param endpoint address and port to receive on, e.g. port 5683
+	/// @param network network that executes the commands
+	/// @param cache pre-rendered state of the nodes, shared with the http servers
+	/// @param limiter rate limit for the commands of each client, shared with the http servers
+	CoapServer(asio::io_service & loop, asio::ip::udp::endpoint const & endpoint, ptr<ZWaveNetwork> network,
+		ptr<StateCache> cache, ptr<RateLimiter> limiter);
+
+	///
+	/// takes over a bound socket, e.g. one that was handed over by a previous process
+	/// @param loop event loop of the network
+	/// @param socket native handle of a bound UDP socket
+	CoapServer(asio::io_service & loop, int socket, ptr<ZWaveNetwork> network, ptr<StateCache> cache,
+		ptr<RateLimiter> limiter);
+
+	~CoapServer() override;
+
+	///
+	/// start receiving requests and register as listener at the network
+	void start();
+
+	///
+	/// end all observations and close the socket
+	void close();
+
+	///
+	/// get the native handle of the socket, e.g. for handing it over to a new process
+	int getSocket() {return this->socket.native_handle();}
+
+	void onChanged(uint32_t nodeId, Parameters const & parameters) override;
+	void onClose() override;
+
+protected:
+
+	enum {
+		// maximum size of a message, larger datagrams are dropped
+		MAX_MESSAGE_SIZE = 1152,
+
+		// initial retransmission timeout in milliseconds, randomized by the factor 1 to 1.5 (ACK_RANDOM_FACTOR)
+		ACK_TIMEOUT = 2000,
+
+		// number of retransmissions of a confirmable notification
+		MAX_RETRANSMIT = 4,
+
+		// time in milliseconds during which a retransmitted request gets the same response
+		EXCHANGE_LIFETIME = 247000,
+
+		// number of recent responses kept for retransmitted requests
+		MAX_EXCHANGES = 64,
+
+		// maximum number of observers, further clients get the state without being registered
+		MAX_OBSERVERS = 64,
+
+		// one notification out of this many is confirmable to check that the observer is still there
+		CONFIRMABLE_INTERVAL = 10,
+
+		// maximum number of parameters in a request
+		MAX_RECORD_FIELDS = 32
+	};
+
+	using Clock = std::chrono::steady_clock;
+	using Endpoint = asio::ip::udp::endpoint;
+
+	struct Observer {
+		Endpoint endpoint;
+		std::string token;
+		uint32_t nodeId;
+		bool json;
+
+		// number of notifications since the last confirmable one
+		int count;
+
+		// message id of the last notification, a reset with this id ends the observation
+		uint16_t messageId;
+
+		// confirmable notification that waits for its acknowledgement. A newer notification replaces it and keeps
+		// the retransmission state (RFC 7641 4.5.2)
+		bool pending;
+		std::string message;
+		int retransmitCount;
+		std::chrono::milliseconds timeout;
+		Clock::time_point deadline;
+	};
+
+	// response to a recent request
+	struct Exchange {
+		Endpoint endpoint;
+		uint16_t messageId;
+		Clock::time_point time;
+		std::string response;
+	};
+
+	///
+	/// called when an error occurs
+	virtual void onError(error_code error) = 0;
+
+	void receive();
+	void onReceive(Endpoint const & endpoint, size_t length);
+
+	///
+	/// build the response to the received request into the send buffer
+	void handleRequest(Endpoint const & endpoint);
+	void handleNode(Endpoint const & endpoint, uint32_t nodeId);
+	void handleDiscovery();
+
+	///
+	/// start the response to the received request, an acknowledgement for a confirmable request
+	CoapWriter beginResponse(int code);
+
+	///
+	/// build a response without payload
+	void respond(int code);
+
+	///
+	/// build a response that asks the client to retry after some seconds
+	void respondRetryLater(int code, int retryAfter);
+
+	bool addObserver(Endpoint const & endpoint, uint32_t nodeId, bool json);
+	void removeObserver(Endpoint const & endpoint, string_view token);
+	void notify(Observer & observer, ptr<StateCache::Body> const & body);
+
+	///
+	/// end all observations with 5.03 so that the clients register again, e.g. at the next process
+	void endObservations();
+
+	///
+	/// start the retransmission timer for the earliest pending notification
+	void schedule();
+	void retransmit();
+
+	void send(Endpoint const & endpoint, std::string const & message);
+
+	bool onField(string_view key, string_view value) override;
+	bool onRecord() override;
+
+
+	HandlerMemory handlerMemory;
+	asio::ip::udp::socket socket;
+	asio::steady_timer timer;
+	ptr<ZWaveNetwork> network;
+	ptr<StateCache> cache;
+	ptr<RateLimiter> limiter;
+	bool listening = false;
+
+	// received datagram and its sender, one byte larger to detect datagrams that are too large
+	uint8_t receiveBuffer[MAX_MESSAGE_SIZE + 1];
+	Endpoint sender;
+	CoapMessage request;
+
+	// response that is being built, keeps its capacity
+	std::string buffer;
+
+	// parameters of a PUT or POST request
+	Parameters record;
+	bool tooLarge;
+
+	// message ids of the messages that the server originates
+	std::minstd_rand random;
+	uint16_t messageId;
+
+	// sequence number for the Observe option, increments with every change of an observed node
+	uint32_t sequence = 0;
+	std::vector<Observer> observers;
+	bool timerRunning = false;
+	Clock::time_point timerDeadline;
+
+	// ring of recent responses for the deduplication of retransmitted requests
+	Exchange exchanges[MAX_EXCHANGES];
+	int exchangeIndex = 0;
+};
@@ -79,10 +79,19 @@ bool EnOceanNetwork::get(uint32_t nodeId, Parameters & parameters) {
 	return false;
 }
 
+void EnOceanNetwork::getNodeIds(std::vector<uint32_t> & nodeIds) {
+	nodeIds.insert(nodeIds.end(), this->nodeIds.begin(), this->nodeIds.end());
+}
+
 void EnOceanNetwork::onRequest(uint8_t packetType, const uint8_t *data, int length,
 	const uint8_t *optionalData, int optionalLength)
 {
 	if (packetType == RADIO_ERP1) {
+		// telegram = RORG data sender id (4 bytes) status, the nodes are known once they have sent something
+		if (length >= 6) {
+			uint8_t const * sender = data + length - 5;
+			this->nodeIds.insert((uint32_t(sender[0]) << 24) | (sender[1] << 16) | (sender[2] << 8) | sender[3]);
+		}
 		if (length >= 7 && data[0] == 0xf6) {
 			
 			uint32_t nodeId = (data[2] << 24) | (data[3] << 16) | (data[4] << 8) | data[5];
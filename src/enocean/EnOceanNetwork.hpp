@@ -1,5 +1,6 @@
 #pragma once
 
+#include <set>
 #include "EnOceanProtocol.hpp"
 #include "cast.hpp"
 
@@ -52,10 +53,17 @@ public:
 	/// @param parameters parameters to get
 	/// @return true if node exists in the ZWave network
 	bool get(uint32_t nodeId, Parameters &parameters) override;
+
+	///
+	/// get ids of all nodes in the network
+	/// @param nodeIds ids of nodes in ascending order
+	void getNodeIds(std::vector<uint32_t> & nodeIds) override;
 	
 protected:
 
 	void onRequest(uint8_t packetType, const uint8_t *data, int length,
 		const uint8_t *optionalData, int optionalLength) override;
 
+	// ids of the nodes that have sent a radio telegram
+	std::set<uint32_t> nodeIds;
 };
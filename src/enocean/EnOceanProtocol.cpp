@@ -45,7 +45,7 @@ EnOceanProtocol::Request::~Request() {
 // EnOceanProtocol
 
 EnOceanProtocol::EnOceanProtocol(asio::io_service &loop, const std::string &device)
-	: tty(loop), txTimer(loop)
+	: Network(loop), tty(loop), txTimer(loop)
 {
 	this->tty.open(device);
 	
@@ -74,7 +74,7 @@ void EnOceanProtocol::sendRequest(ptr<Request> request) {
 void EnOceanProtocol::receive() {
 	this->tty.async_read_some(
 			asio::buffer(this->rxBuffer + this->rxPosition, sizeof(this->rxBuffer) - this->rxPosition),
-			[this] (error_code error, size_t readCount) {
+			makeHandler(this->handlerMemory, [this] (error_code error, size_t readCount) {
 				if (error) {
 					onError(error);
 					return;
@@ -142,7 +142,7 @@ void EnOceanProtocol::receive() {
 		
 				// continue receiving
 				receive();
-			});
+			}));
 }
 
 void EnOceanProtocol::sendRequest() {
@@ -165,12 +165,12 @@ void EnOceanProtocol::sendRequest() {
 
 	// start timeout timer
 	this->txTimer.expires_from_now(std::chrono::milliseconds(RESPONSE_TIMEOUT));
-	this->txTimer.async_wait([this] (error_code error) {
+	this->txTimer.async_wait(makeHandler(this->handlerMemory, [this] (error_code error) {
 		if (!error) {
 			// timer expired before response was received
 			resendRequest(2);
 		}
-	});
+	}));
 	
 	// send request
 	#ifdef DEBUG_PROTOCOL
@@ -180,13 +180,13 @@ void EnOceanProtocol::sendRequest() {
 	asio::async_write(
 		this->tty,
 		asio::buffer(this->txBuffer, 6 + length + 1),
-		[this] (error_code error, size_t writtenCount) {
+		makeHandler(this->handlerMemory, [this] (error_code error, size_t writtenCount) {
 			if (error) {
 				onError(error);
 			} else {
 				// wait for response or timeout
 			}
-		});
+		}));
 }
 
 void EnOceanProtocol::resendRequest(int error) {
@@ -3,6 +3,7 @@
 #include <deque>
 #include <chrono>
 #include "asio.hpp"
+#include "HandlerMemory.hpp"
 #include "Network.hpp"
 #include "ptr.hpp"
 
@@ -136,6 +137,9 @@ protected:
 	uint8_t calcChecksum(const uint8_t *data, int length);
 
 	
+	// memory for the asynchronous operations of serial port and timer
+	HandlerMemory handlerMemory;
+
 	// serial connection to zwave dongle
 	asio::serial_port tty;
 	
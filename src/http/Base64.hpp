@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+///
+/// append data encoded as base64 to a string
+inline void encodeBase64(std::string & r, uint8_t const * data, size_t length) {
+	static char const table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	size_t i = 0;
+	for (; i + 2 < length; i += 3) {
+		uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+		r += table[v >> 18];
+		r += table[(v >> 12) & 63];
+		r += table[(v >> 6) & 63];
+		r += table[v & 63];
+	}
+	if (i + 1 == length) {
+		uint32_t v = data[i] << 16;
+		r += table[v >> 18];
+		r += table[(v >> 12) & 63];
+		r += "==";
+	} else if (i + 2 == length) {
+		uint32_t v = (data[i] << 16) | (data[i + 1] << 8);
+		r += table[v >> 18];
+		r += table[(v >> 12) & 63];
+		r += table[(v >> 6) & 63];
+		r += '=';
+	}
+}
+
+///
+/// append data decoded from base64 or base64url to a string, padding is optional
+/// @return false if the string contains invalid characters
+inline bool decodeBase64(std::string & r, char const * s, size_t length) {
+	uint32_t v = 0;
+	int bits = 0;
+	for (size_t i = 0; i < length; ++i) {
+		char ch = s[i];
+		int d;
+		if (ch >= 'A' && ch <= 'Z')
+			d = ch - 'A';
+		else if (ch >= 'a' && ch <= 'z')
+			d = ch - 'a' + 26;
+		else if (ch >= '0' && ch <= '9')
+			d = ch - '0' + 52;
+		else if (ch == '+' || ch == '-')
+			d = 62;
+		else if (ch == '/' || ch == '_')
+			d = 63;
+		else if (ch == '=')
+			break;
+		else
+			return false;
+		v = (v << 6) | d;
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			r += char(v >> bits);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,8 @@
+#include "BodyParser.hpp"
+
+
+BodyParser::Listener::~Listener() {
+}
+
+BodyParser::~BodyParser() {
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "../string_view.hpp"
+
+
+///
+/// Incremental parser for request bodies that consist of records of key/value fields. The body is parsed part by
+/// part as it arrives in HttpChannel::onBody(), decoded fields are passed to a listener without buffering the body
+class BodyParser {
+public:
+	///
+	/// Receives the decoded fields and the ends of the records
+	class Listener {
+	public:
+		virtual ~Listener();
+
+		///
+		/// a field was decoded, key and value are only valid during the call
+		/// @return false to stop parsing
+		virtual bool onField(string_view key, string_view value) = 0;
+
+		///
+		/// end of a record, e.g. a line of a form body or an object of a JSON array
+		/// @return false to stop parsing
+		virtual bool onRecord() = 0;
+	};
+
+	enum {
+		// maximum length of a key or a value
+		MAX_LENGTH = 1024
+	};
+
+	BodyParser(Listener & listener) : listener(listener) {}
+
+	virtual ~BodyParser();
+
+	///
+	/// parse the next part of the body
+	/// @return false on a syntax error, when a key or value is too long or when the listener stopped parsing
+	virtual bool parse(uint8_t const * data, size_t length) = 0;
+
+	///
+	/// end of the body
+	/// @return false if the body is incomplete or the listener stopped parsing
+	virtual bool finish() = 0;
+
+protected:
+
+	Listener & listener;
+};
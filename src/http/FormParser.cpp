@@ -0,0 +1,87 @@
+#include "FormParser.hpp"
+#include "Query.hpp"
+
+
+FormParser::~FormParser() {
+}
+
+bool FormParser::parse(uint8_t const * data, size_t length) {
+	char const * it = (char const *)data;
+	char const * end = it + length;
+	while (it < end) {
+		std::string & s = this->inValue ? this->value : this->key;
+		
+		// hex digits of a percent-encoding, may be split between parts
+		if (this->escape > 0) {
+			int digit = decodeHex(*it++);
+			if (digit < 0)
+				return false;
+			this->escapeValue = this->escapeValue << 4 | digit;
+			if (--this->escape == 0)
+				s += char(this->escapeValue);
+			continue;
+		}
+		
+		// copy characters that need no decoding in one go
+		char const * run = it;
+		while (it < end && *it != '&' && *it != '=' && *it != '%' && *it != '+' && *it != '\n' && *it != '\r')
+			++it;
+		s.append(run, it - run);
+		if (s.length() > MAX_LENGTH)
+			return false;
+		if (it == end)
+			break;
+		
+		switch (*it++) {
+		case '&':
+			if (!endField())
+				return false;
+			break;
+		case '=':
+			if (this->inValue)
+				s += '=';
+			this->inValue = true;
+			break;
+		case '%':
+			this->escape = 2;
+			this->escapeValue = 0;
+			break;
+		case '+':
+			s += ' ';
+			break;
+		case '\n':
+			if (!endField())
+				return false;
+			if (this->inRecord) {
+				this->inRecord = false;
+				if (!this->listener.onRecord())
+					return false;
+			}
+			break;
+		}
+	}
+	return true;
+}
+
+bool FormParser::finish() {
+	if (this->escape > 0 || !endField())
+		return false;
+	if (this->inRecord) {
+		this->inRecord = false;
+		return this->listener.onRecord();
+	}
+	return true;
+}
+
+bool FormParser::endField() {
+	// fields without '=' are ignored as in parseQuery()
+	bool result = true;
+	if (this->inValue && !this->key.empty()) {
+		this->inRecord = true;
+		result = this->listener.onField(this->key, this->value);
+	}
+	this->key.clear();
+	this->value.clear();
+	this->inValue = false;
+	return result;
+}
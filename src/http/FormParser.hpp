@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+#include "BodyParser.hpp"
+
+
+///
+/// Incremental parser for application/x-www-form-urlencoded bodies ("a=1&b=2"). A line feed ends a record, so that
+/// a body can contain one form per line ("node=4&position.blinds=50\nnode=5&position.blinds=0\n")
+class FormParser : public BodyParser {
+public:
+	FormParser(Listener & listener) : BodyParser(listener) {}
+
+	~FormParser() override;
+
+	bool parse(uint8_t const * data, size_t length) override;
+	bool finish() override;
+
+protected:
+
+	///
+	/// end of a field at '&', line feed or end of body
+	bool endField();
+
+	// key and value of the current field, keep their capacity
+	std::string key;
+	std::string value;
+	bool inValue = false;
+
+	// percent-encoding that continues in the next part: number of hex digits still expected and value so far
+	int escape = 0;
+	int escapeValue = 0;
+
+	// a field was passed to the listener since the last record
+	bool inRecord = false;
+};
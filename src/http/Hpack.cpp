@@ -0,0 +1,422 @@
+#include <algorithm>
+#include <vector>
+#include "Hpack.hpp"
+
+
+// static table (RFC 7541 appendix A), index 1 is the first entry
+static struct {
+	char const * name;
+	char const * value;
+} const staticTable[] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""}
+};
+static uint32_t const STATIC_TABLE_LENGTH = sizeof(staticTable) / sizeof(staticTable[0]);
+
+// code of each symbol, right aligned, and its length in bits (RFC 7541 appendix B)
+static uint32_t const huffmanCodes[256] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee
+};
+static uint8_t const huffmanLengths[256] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26
+};
+
+// huffman decoding tree, built on first use. Nodes with a symbol >= 0 are leaves
+namespace {
+struct HuffmanTree {
+	struct Node {
+		int16_t children[2];
+		int16_t symbol;
+	};
+	std::vector<Node> nodes;
+
+	HuffmanTree() {
+		this->nodes.push_back({{0, 0}, -1});
+		for (int symbol = 0; symbol < 256; ++symbol) {
+			int node = 0;
+			for (int i = huffmanLengths[symbol] - 1; i >= 0; --i) {
+				int bit = (huffmanCodes[symbol] >> i) & 1;
+				if (this->nodes[node].children[bit] == 0) {
+					this->nodes[node].children[bit] = int16_t(this->nodes.size());
+					this->nodes.push_back({{0, 0}, -1});
+				}
+				node = this->nodes[node].children[bit];
+			}
+			this->nodes[node].symbol = int16_t(symbol);
+		}
+	}
+};
+}
+
+
+// Table
+
+void Hpack::Table::add(string_view name, string_view value) {
+	uint32_t entrySize = uint32_t(name.length() + value.length() + 32);
+	if (entrySize > this->maxSize) {
+		// an entry larger than the table empties the table
+		this->entries.clear();
+		this->size = 0;
+		return;
+	}
+	evict(this->maxSize - entrySize);
+	this->entries.push_front({name.str(), value.str()});
+	this->size += entrySize;
+}
+
+void Hpack::Table::evict(uint32_t maxSize) {
+	while (this->size > maxSize) {
+		Entry const & entry = this->entries.back();
+		this->size -= uint32_t(entry.name.length() + entry.value.length() + 32);
+		this->entries.pop_back();
+	}
+}
+
+
+// Hpack
+
+Hpack::Listener::~Listener() {
+}
+
+void Hpack::encode(std::string & block, string_view name, string_view value, bool index) {
+	// look up full match and name in the static table
+	uint32_t nameIndex = 0;
+	for (uint32_t i = 0; i < STATIC_TABLE_LENGTH; ++i) {
+		if (name == staticTable[i].name) {
+			if (value == staticTable[i].value) {
+				encodeInteger(block, 0x80, 7, i + 1);
+				return;
+			}
+			if (nameIndex == 0)
+				nameIndex = i + 1;
+		}
+	}
+
+	// look up full match and name in the dynamic table
+	std::deque<Entry> const & entries = this->encoderTable.entries;
+	for (size_t i = 0; i < entries.size(); ++i) {
+		if (name == entries[i].name) {
+			if (value == entries[i].value) {
+				encodeInteger(block, 0x80, 7, uint32_t(STATIC_TABLE_LENGTH + 1 + i));
+				return;
+			}
+			if (nameIndex == 0)
+				nameIndex = uint32_t(STATIC_TABLE_LENGTH + 1 + i);
+		}
+	}
+
+	// literal with incremental indexing or without indexing
+	if (index)
+		encodeInteger(block, 0x40, 6, nameIndex);
+	else
+		encodeInteger(block, 0x00, 4, nameIndex);
+	if (nameIndex == 0)
+		encodeString(block, name);
+	encodeString(block, value);
+	if (index)
+		this->encoderTable.add(name, value);
+}
+
+void Hpack::begin(std::string & block) {
+	if (this->tableSizeChanged) {
+		this->tableSizeChanged = false;
+		if (this->minTableSize < this->newTableSize) {
+			encodeInteger(block, 0x20, 5, this->minTableSize);
+			this->encoderTable.evict(this->minTableSize);
+		}
+		encodeInteger(block, 0x20, 5, this->newTableSize);
+		this->encoderTable.evict(this->newTableSize);
+		this->encoderTable.maxSize = this->newTableSize;
+		this->minTableSize = this->newTableSize;
+	}
+}
+
+void Hpack::setEncoderTableSize(uint32_t size) {
+	// never use a larger table than the default
+	size = std::min(size, uint32_t(DEFAULT_TABLE_SIZE));
+	if (size != this->newTableSize || this->tableSizeChanged) {
+		this->minTableSize = std::min(this->minTableSize, size);
+		this->newTableSize = size;
+		this->tableSizeChanged = true;
+	}
+}
+
+Hpack::Result Hpack::decode(uint8_t const * data, size_t length, Listener & listener) {
+	uint8_t const * it = data;
+	uint8_t const * end = data + length;
+	uint32_t listSize = 0;
+	while (it < end) {
+		uint8_t b = *it;
+		if (b & 0x20 && !(b & 0xc0)) {
+			// dynamic table size update, only at the start of the block (no field yet) and may not exceed the size in
+			// our settings
+			uint32_t size;
+			if (listSize > 0 || !decodeInteger(it, end, 5, size) || size > DEFAULT_TABLE_SIZE)
+				return INVALID;
+			this->decoderTable.evict(size);
+			this->decoderTable.maxSize = size;
+			continue;
+		}
+		
+		// prefix length of the index: indexed field, literal with incremental indexing, literal without indexing
+		int n = (b & 0x80) ? 7 : (b & 0x40) ? 6 : 4;
+		uint32_t index;
+		if (!decodeInteger(it, end, n, index))
+			return INVALID;
+		string_view name;
+		string_view value;
+		if (index > 0) {
+			// name (and value) from the static or dynamic table
+			if (index <= STATIC_TABLE_LENGTH) {
+				name = staticTable[index - 1].name;
+				value = staticTable[index - 1].value;
+			} else if (index - STATIC_TABLE_LENGTH - 1 < this->decoderTable.entries.size()) {
+				Entry const & entry = this->decoderTable.entries[index - STATIC_TABLE_LENGTH - 1];
+				name = entry.name;
+				value = entry.value;
+			} else {
+				return INVALID;
+			}
+		} else if (b & 0x80) {
+			return INVALID;
+		}
+		
+		if (!(b & 0x80)) {
+			// literal value, copy the name as adding to the dynamic table may evict its entry
+			this->buffer.clear();
+			if (index > 0)
+				this->buffer.append(name.data(), name.length());
+			else if (!decodeString(it, end, this->buffer))
+				return INVALID;
+			size_t nameLength = this->buffer.length();
+			if (!decodeString(it, end, this->buffer))
+				return INVALID;
+			name = string_view(this->buffer.data(), nameLength);
+			value = string_view(this->buffer.data() + nameLength, this->buffer.length() - nameLength);
+		}
+		
+		// limit the size so that small references to large table entries can't inflate the header list
+		listSize += uint32_t(name.length() + value.length() + 32);
+		if (listSize > MAX_HEADER_LIST_SIZE)
+			return TOO_LARGE;
+		listener.onHeaderField(name, value);
+		if ((b & 0xc0) == 0x40)
+			this->decoderTable.add(name, value);
+	}
+	return OK;
+}
+
+void Hpack::encodeInteger(std::string & s, uint8_t flags, int n, uint32_t value) {
+	uint32_t mask = (1 << n) - 1;
+	if (value < mask) {
+		s += char(flags | value);
+		return;
+	}
+	s += char(flags | mask);
+	value -= mask;
+	while (value >= 128) {
+		s += char(0x80 | (value & 0x7f));
+		value >>= 7;
+	}
+	s += char(value);
+}
+
+void Hpack::encodeString(std::string & s, string_view value) {
+	// get length of huffman code in bits
+	size_t bits = 0;
+	for (char ch : value) {
+		bits += huffmanLengths[uint8_t(ch)];
+	}
+	size_t length = (bits + 7) / 8;
+	if (length >= value.length()) {
+		// raw string
+		encodeInteger(s, 0x00, 7, uint32_t(value.length()));
+		s.append(value.data(), value.length());
+		return;
+	}
+	
+	// huffman coded string, padded with the most significant bits of EOS (all ones)
+	encodeInteger(s, 0x80, 7, uint32_t(length));
+	uint64_t accumulator = 0;
+	int count = 0;
+	for (char ch : value) {
+		accumulator = (accumulator << huffmanLengths[uint8_t(ch)]) | huffmanCodes[uint8_t(ch)];
+		count += huffmanLengths[uint8_t(ch)];
+		while (count >= 8) {
+			count -= 8;
+			s += char(accumulator >> count);
+		}
+	}
+	if (count > 0)
+		s += char((accumulator << (8 - count)) | (0xff >> count));
+}
+
+bool Hpack::decodeInteger(uint8_t const *& it, uint8_t const * end, int n, uint32_t & value) {
+	if (it >= end)
+		return false;
+	uint32_t mask = (1 << n) - 1;
+	value = *it++ & mask;
+	if (value < mask)
+		return true;
+	int shift = 0;
+	while (it < end) {
+		uint8_t b = *it++;
+		if (shift > 21)
+			return false;
+		value += uint32_t(b & 0x7f) << shift;
+		shift += 7;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool Hpack::decodeString(uint8_t const *& it, uint8_t const * end, std::string & s) {
+	if (it >= end)
+		return false;
+	bool huffman = (*it & 0x80) != 0;
+	uint32_t length;
+	if (!decodeInteger(it, end, 7, length) || length > size_t(end - it))
+		return false;
+	uint8_t const * data = it;
+	it += length;
+	if (huffman)
+		return decodeHuffman(data, length, s);
+	s.append((char const *)data, length);
+	return true;
+}
+
+bool Hpack::decodeHuffman(uint8_t const * data, size_t length, std::string & s) {
+	static HuffmanTree const tree;
+	HuffmanTree::Node const * nodes = tree.nodes.data();
+	int node = 0;
+	
+	// number of bits since the last symbol and whether they are all ones (valid padding)
+	int bits = 0;
+	bool ones = true;
+	for (size_t i = 0; i < length; ++i) {
+		uint8_t b = data[i];
+		for (int j = 7; j >= 0; --j) {
+			int bit = (b >> j) & 1;
+			node = nodes[node].children[bit];
+			if (node == 0)
+				return false;
+			++bits;
+			ones &= bit == 1;
+			if (nodes[node].symbol >= 0) {
+				s += char(nodes[node].symbol);
+				node = 0;
+				bits = 0;
+				ones = true;
+			}
+		}
+	}
+	
+	// padding has to be shorter than 8 bits and consist of ones
+	return bits < 8 && ones;
+}
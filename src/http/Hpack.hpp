@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include "../string_view.hpp"
+
+
+///
+/// HPACK header compression for HTTP/2 (RFC 7541). Encoder and decoder each keep a dynamic table for the lifetime of
+/// the connection, therefore headers that are repeated in every request or response are sent as a single byte
+class Hpack {
+public:
+	enum {
+		// default size of the dynamic table
+		DEFAULT_TABLE_SIZE = 4096,
+
+		// maximum size of a decoded header list (SETTINGS_MAX_HEADER_LIST_SIZE), counted like the table entries as
+		// name, value and 32 bytes per field
+		MAX_HEADER_LIST_SIZE = 16384
+	};
+
+	enum Result {
+		OK,
+
+		// invalid encoding (connection error of type COMPRESSION_ERROR)
+		INVALID,
+
+		// decoded header list exceeds MAX_HEADER_LIST_SIZE, decoding stops and the dynamic table is out of sync
+		TOO_LARGE
+	};
+
+	///
+	/// Receives the decoded header fields
+	class Listener {
+	public:
+		virtual ~Listener();
+
+		///
+		/// called for each decoded header field, name and value are only valid during the call
+		virtual void onHeaderField(string_view name, string_view value) = 0;
+	};
+
+	///
+	/// append a header field to a header block, the name has to be lower case
+	/// @param index add the field to the dynamic table, false for values that change every time (e.g. content-length)
+	void encode(std::string & block, string_view name, string_view value, bool index = true);
+
+	///
+	/// start a new header block, emits a dynamic table size update if the peer has changed the maximum size
+	void begin(std::string & block);
+
+	///
+	/// set the maximum size of the dynamic table of the encoder (SETTINGS_HEADER_TABLE_SIZE of the peer)
+	void setEncoderTableSize(uint32_t size);
+
+	///
+	/// decode a complete header block. Fields from the tables are passed without copying them
+	/// @param listener receives the decoded header fields
+	Result decode(uint8_t const * data, size_t length, Listener & listener);
+
+	///
+	/// append an integer with prefix of n bits, the flags occupy the upper bits of the first byte
+	static void encodeInteger(std::string & s, uint8_t flags, int n, uint32_t value);
+
+	///
+	/// append a string literal, huffman coded if shorter
+	static void encodeString(std::string & s, string_view value);
+
+protected:
+
+	struct Entry {
+		std::string name;
+		std::string value;
+	};
+
+	// dynamic table with the newest entry at the front
+	struct Table {
+		std::deque<Entry> entries;
+		uint32_t size = 0;
+		uint32_t maxSize = DEFAULT_TABLE_SIZE;
+
+		void add(string_view name, string_view value);
+		void evict(uint32_t maxSize);
+	};
+
+	static bool decodeInteger(uint8_t const *& it, uint8_t const * end, int n, uint32_t & value);
+	static bool decodeString(uint8_t const *& it, uint8_t const * end, std::string & s);
+	static bool decodeHuffman(uint8_t const * data, size_t length, std::string & s);
+
+	Table encoderTable;
+	Table decoderTable;
+
+	// dynamic table size updates that have to be sent at the start of the next header block: the smallest and the
+	// last size that the peer has set
+	uint32_t minTableSize = DEFAULT_TABLE_SIZE;
+	uint32_t newTableSize = DEFAULT_TABLE_SIZE;
+	bool tableSizeChanged = false;
+
+	// decoded name and value of the current literal field
+	std::string buffer;
+};
@@ -1,5 +1,13 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <iostream>
+#include <strings.h> // strcasecmp
+#include <unistd.h> // pread
+#include "../cast.hpp"
+#include "Base64.hpp"
 #include "HttpChannel.hpp"
+#include "Sha1.hpp"
 
 
 // http error category
@@ -18,63 +26,1344 @@ error_category & getHttpCategory() {
 	return httpCategory;
 }
 
+// connection preface of HTTP/2 clients, the method PRI does not exist in HTTP/1
+static char const http2Preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+static uint32_t read32(uint8_t const * p) {
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+static void write32(uint8_t * p, uint32_t value) {
+	p[0] = uint8_t(value >> 24);
+	p[1] = uint8_t(value >> 16);
+	p[2] = uint8_t(value >> 8);
+	p[3] = uint8_t(value);
+}
+
+static int getMethod(string_view s) {
+	#define XX(num, name, string) if (s == #string) return num;
+	HTTP_METHOD_MAP(XX)
+	#undef XX
+	return -1;
+}
+
 // Response
 
-HttpChannel::Response::Response(int status, std::string const & message) {
-	this->s << "HTTP/1.1 " << status << ' ' << message << "\r\n";
+HttpChannel::Response::Response(HttpChannel & channel, uint32_t requestId, int status, char const * message)
+		: requestId(requestId), s(channel.newBuffer()) {
+	this->s += "HTTP/1.1 ";
+	append(this->s, status);
+	this->s += ' ';
+	this->s += message;
+	this->s += "\r\n";
+}
+
+void HttpChannel::Response::addHeader(char const * key, char const * value) {
+	this->s += key;
+	this->s += ": ";
+	this->s += value;
+	this->s += "\r\n";
 }
 
 void HttpChannel::Response::addHeader(std::string const & key, std::string const & value) {
-	this->s << key << ": " << value << "\r\n";
+	this->s += key;
+	this->s += ": ";
+	this->s += value;
+	this->s += "\r\n";
+}
+
+void HttpChannel::Response::addHeader(char const * key, int64_t value) {
+	this->s += key;
+	this->s += ": ";
+	append(this->s, value);
+	this->s += "\r\n";
 }
 
 void HttpChannel::Response::addHeaders(Headers const & headers) {
-	for (auto p : headers) {
-		this->s << p.first << ": " << p.second << "\r\n";
+	for (auto const & p : headers) {
+		addHeader(p.first, p.second);
 	}
 }
 
 void HttpChannel::Response::addClose() {
-	this->s << "Connection: close\r\n";
+	if (!this->close) {
+		this->close = true;
+		this->s += "Connection: close\r\n";
+	}
+}
+
+void HttpChannel::Response::addContent(char const * contentType, size_t contentLength) {
+	this->s += "Content-Type: ";
+	this->s += contentType;
+	this->s += "\r\nContent-Length: ";
+	append(this->s, contentLength);
+	this->s += "\r\n";
 }
 
-void HttpChannel::Response::addContent(std::string const & contentType, size_t contentLength) {
-	this->s << "Content-Type: " << contentType << "\r\n";
-	this->s << "Content-Length: " << contentLength << "\r\n";
+// Source
+
+HttpChannel::Source::~Source() {
 }
 
+
 // HttpChannel
 
-HttpChannel::HttpChannel(asio::io_service & loop, int timeout)
-		: Channel(loop, timeout) {
+HttpChannel::HttpChannel(asio::io_service & loop, int timeout, bool client)
+		: Channel(loop, timeout), client(client) {
 	this->parser.data = this;
+	
+	// headers for the upgrade to HTTP/2
+	if (!client)
+		this->captureMask = (1 << int(Header::UPGRADE)) | (1 << int(Header::HTTP2_SETTINGS));
 }
 
 HttpChannel::~HttpChannel() {
 }
 
-void HttpChannel::sendResponse(Response const & response) {
-	std::string data = response.s.str();
+void HttpChannel::pauseBody() {
+	this->bodyPaused = true;
+	if (!this->http2)
+		pauseReceive();
+}
 
+void HttpChannel::resumeBody() {
+	this->bodyPaused = false;
+	if (this->http2)
+		acknowledgeData(true);
+	else if (HTTP_PARSER_ERRNO(&this->parser) != HPE_PAUSED)
+		resumeReceive();
+}
+
+void HttpChannel::sendResponse(Response & response) {
+	if (this->http2) {
+		sendHeaders(response.requestId, response.s);
+		return;
+	}
+	
+	// a response with "Connection: close" ends the connection
+	uint32_t index = response.requestId - this->firstRequestId;
+	if (response.close && index < this->slots.size()) {
+		this->slots[index].close = true;
+		this->ignoring = true;
+	}
+	
 	// end of headers
-	data += "\r\n";
-	sendData(data);
+	response.s += "\r\n";
+	write(response.requestId, std::move(response.s));
+}
+
+void HttpChannel::sendRequest(Method method, std::string const & url, char const * headers,
+	char const * contentType, std::string && body)
+{
+	std::string s = newBuffer();
+	s += getMethodString(method);
+	s += ' ';
+	s += url;
+	s += " HTTP/1.1\r\n";
+	s += headers;
+	s += "Content-Type: ";
+	s += contentType;
+	s += "\r\nContent-Length: ";
+	append(s, body.length());
+	s += "\r\n\r\n";
+	sendData(std::move(s));
+	sendData(std::move(body));
+}
+
+void HttpChannel::sendBody(uint32_t requestId, uint8_t const * data, size_t length) {
+	if (this->http2) {
+		sendStreamData(requestId, {std::string((char const *)data, length), nullptr, 0, nullptr, nullptr, 0});
+	} else if (requestId == this->firstRequestId) {
+		// response is at the head of the pipeline: send immediately
+		sendData(data, length);
+	} else {
+		write(requestId, std::string((char const *)data, length));
+	}
+}
+
+void HttpChannel::sendBody(uint32_t requestId, std::string && data) {
+	write(requestId, std::move(data));
+}
+
+void HttpChannel::sendBody(uint32_t requestId, ptr<Object> owner, uint8_t const * data, size_t length) {
+	if (this->http2) {
+		sendStreamData(requestId, {std::string(), data, length, std::move(owner), nullptr, 0});
+		return;
+	}
+	uint32_t index = requestId - this->firstRequestId;
+	if (index == 0) {
+		// response is at the head of the pipeline: send immediately
+		sendShared(std::move(owner), data, length);
+	} else if (index < this->slots.size()) {
+		// wait until the previous responses are complete
+		this->slots[index].data.push_back({std::string(), data, length, std::move(owner), nullptr, 0});
+	}
+}
+
+void HttpChannel::sendFile(uint32_t requestId, ptr<File> file, int64_t offset, size_t length) {
+	uint32_t index = requestId - this->firstRequestId;
+	if (this->http2) {
+		sendStreamData(requestId, {std::string(), nullptr, length, nullptr, std::move(file), offset});
+	} else if (index == 0) {
+		// response is at the head of the pipeline: send immediately
+		Channel::sendFile(std::move(file), offset, length);
+	} else if (index < this->slots.size()) {
+		// wait until the previous responses are complete
+		this->slots[index].data.push_back({std::string(), nullptr, length, nullptr, std::move(file), offset});
+	}
+}
+
+void HttpChannel::sendStream(Response & response, ptr<Source> source) {
+	if (this->http2) {
+		// HTTP/2 frames the body, the end is marked by END_STREAM
+		auto it = this->streams.find(response.requestId);
+		if (it == this->streams.end())
+			return;
+		it->second.source = source;
+		sendResponse(response);
+		return;
+	}
+	uint32_t index = response.requestId - this->firstRequestId;
+	if (index >= this->slots.size())
+		return;
+	Slot & slot = this->slots[index];
+	if (slot.chunked)
+		response.s += "Transfer-Encoding: chunked\r\n";
+	else
+		response.addClose();
+	slot.source = source;
+	
+	// the first part is pulled in onReadyToSend() after the headers have been written
+	sendResponse(response);
+}
+
+void HttpChannel::onReadyToSend() {
+	if (this->http2) {
+		pullSources();
+		return;
+	}
+	if (this->slots.empty() || !this->slots.front().source)
+		return;
+	Slot & slot = this->slots.front();
+	
+	// read next part behind space for the chunk size (leading zeros are allowed)
+	std::string buffer = newBuffer();
+	size_t headerLength = slot.chunked ? 10 : 0;
+	buffer.assign(headerLength, '0');
+	bool more = slot.source->read(buffer, STREAM_PART_LENGTH);
+	size_t length = buffer.length() - headerLength;
+	if (slot.chunked) {
+		if (length > 0) {
+			// write chunk size as 8 hex digits
+			static char const hex[] = "0123456789abcdef";
+			for (int i = 0; i < 8; ++i) {
+				buffer[i] = hex[(length >> (28 - i * 4)) & 15];
+			}
+			buffer[8] = '\r';
+			buffer[9] = '\n';
+			buffer += "\r\n";
+		} else {
+			buffer.clear();
+		}
+		if (!more)
+			buffer += "0\r\n\r\n";
+	}
+	sendData(std::move(buffer));
+	
+	if (!more) {
+		// end of body: finish response, HTTP/1.0 clients detect the end by the closed connection
+		slot.source = nullptr;
+		endResponse(this->firstRequestId);
+	}
+}
+
+void HttpChannel::endResponse(uint32_t requestId) {
+	if (this->http2) {
+		auto it = this->streams.find(requestId);
+		if (it != this->streams.end() && !it->second.complete) {
+			it->second.complete = true;
+			drainStream(it);
+		}
+		return;
+	}
+	uint32_t index = requestId - this->firstRequestId;
+	if (index >= this->slots.size())
+		return;
+	this->slots[index].complete = true;
+	
+	// remove completed slots at the head of the pipeline and send data of following responses
+	bool removed = false;
+	while (!this->slots.empty() && this->slots.front().complete) {
+		bool close = this->slots.front().close;
+		this->slots.pop_front();
+		++this->firstRequestId;
+		removed = true;
+		if (close) {
+			// shut down after the response was written, there are no responses to following requests
+			this->slots.clear();
+			shutdownWhenSent();
+			break;
+		}
+		if (!this->slots.empty()) {
+			for (TxBuffer & buffer : this->slots.front().data) {
+				if (buffer.file)
+					Channel::sendFile(std::move(buffer.file), buffer.fileOffset, buffer.length);
+				else if (buffer.borrowed != nullptr)
+					sendShared(std::move(buffer.owner), buffer.borrowed, buffer.length);
+				else
+					sendData(std::move(buffer.data));
+			}
+			this->slots.front().data.clear();
+		}
+	}
+	
+	// continue parsing if the pipeline was full
+	if (removed && HTTP_PARSER_ERRNO(&this->parser) == HPE_PAUSED && int(this->slots.size()) < this->pipelineDepth) {
+		http_parser_pause(&this->parser, 0);
+
+		// parse pending data later as we may be called from within the parser
+		addReference();
+		this->socket.get_io_service().post([this] () {
+			if (this->socket.is_open() && HTTP_PARSER_ERRNO(&this->parser) == HPE_OK) {
+				std::string pending;
+				std::swap(pending, this->rxPending);
+				parse((uint8_t const *)pending.data(), pending.length());
+				
+				// pauseBody() keeps receiving paused
+				if (HTTP_PARSER_ERRNO(&this->parser) != HPE_PAUSED && !this->bodyPaused)
+					resumeReceive();
+			}
+			removeReference();
+		});
+	}
+}
+
+bool HttpChannel::acceptWebSocket(Request const & request) {
+	string_view key = request.getHeader(Header::SEC_WEBSOCKET_KEY);
+	string_view upgrade = request.getHeader(Header::UPGRADE);
+	string_view version = request.getHeader(Header::SEC_WEBSOCKET_VERSION);
+	int status = 101;
+	if (this->http2 || !this->parser.upgrade || key.empty() || upgrade.length() != 9
+			|| strncasecmp(upgrade.data(), "websocket", 9) != 0)
+		status = 400;
+	else if (version != "13")
+		status = 426;
+	if (status != 101) {
+		// the client may already send frames behind the upgrade request, therefore the connection gets shut down
+		// after the response and the following data is not parsed as HTTP
+		Response response(*this, status, status == 426 ? "Upgrade Required" : "Bad Request");
+		response.addClose();
+		if (status == 426)
+			response.addHeaders("Sec-WebSocket-Version: 13\r\n");
+		response.addHeaders("Content-Length: 0\r\n");
+		sendResponse(response);
+		endResponse(this->requestId);
+		return false;
+	}
+	
+	// calculate accept value
+	static char const guid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	Sha1 sha1;
+	sha1.update((uint8_t const *)key.data(), key.length());
+	sha1.update((uint8_t const *)guid, sizeof(guid) - 1);
+	uint8_t digest[Sha1::DIGEST_LENGTH];
+	sha1.finish(digest);
+	
+	// send handshake response, the response stays open for the messages
+	Response response(*this, 101, "Switching Protocols");
+	response.addHeaders("Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ");
+	encodeBase64(response.s, digest, sizeof(digest));
+	response.addHeaders("\r\n");
+	sendResponse(response);
+	
+	this->webSocket = true;
+	this->webSocketRequestId = this->requestId;
+	return true;
+}
+
+void HttpChannel::sendMessage(uint8_t const * data, size_t length, bool binary) {
+	sendFrame(binary ? WS_BINARY : WS_TEXT, data, length);
+}
+
+bool HttpChannel::isIdle() {
+	if (this->http2)
+		return this->streams.empty() && this->txPending == 0;
+	return !this->webSocket && !this->receiving && this->slots.empty() && this->txPending == 0;
 }
 
 void HttpChannel::onConnect() {
-	// init for http server
-	http_parser_init(&this->parser, HTTP_REQUEST);
+	// init for http server or client
+	initParser();
+	if (!this->client) {
+#ifdef WITH_TLS
+		// HTTP/2 negotiated via ALPN
+		if (this->tls) {
+			unsigned char const * protocol;
+			unsigned int length;
+			SSL_get0_alpn_selected(this->tls->native_handle(), &protocol, &length);
+			if (length == 2 && memcmp(protocol, "h2", 2) == 0) {
+				startHttp2();
+				return;
+			}
+		}
+#endif
+		this->detectHttp2 = true;
+	}
 }
 
 void HttpChannel::onData(uint8_t const * data, size_t length) {
+	parse(data, length);
+}
+
+void HttpChannel::initRequest(Request & request, Method method) {
+	// create views into the arena
+	char const * arena = this->arena.data();
+	request.method = method;
+	request.url = string_view(arena + this->url.offset, this->url.length);
+	request.present = this->present;
+	for (int i = 0; i < int(Header::COUNT); ++i) {
+		Span span = (this->present & (1 << i)) ? this->headers[i] : Span{0, 0};
+		request.headers[i] = string_view(arena + span.offset, span.length);
+	}
+	
+	// split url into path and query
+	http_parser_url u;
+	http_parser_url_init(&u);
+	if (http_parser_parse_url(request.url.data(), request.url.length(), method == Method::CONNECT, &u) == 0) {
+		request.path = request.url.substr(u.field_data[UF_PATH].off, u.field_data[UF_PATH].len);
+		request.query = request.url.substr(u.field_data[UF_QUERY].off, u.field_data[UF_QUERY].len);
+	}
+}
+
+void HttpChannel::parse(uint8_t const * data, size_t length) {
+	if (this->detectHttp2) {
+		// HTTP/2 with prior knowledge: the first request starts with the method PRI of the connection preface
+		size_t matched = this->rxPending.length();
+		size_t n = std::min(length, size_t(3) - matched);
+		bool prefix = memcmp(data, http2Preface + matched, n) == 0;
+		if (prefix && matched + n < 3) {
+			// wait for more data
+			this->rxPending.append((char const *)data, length);
+			return;
+		}
+		this->detectHttp2 = false;
+		if (prefix)
+			startHttp2();
+		if (matched > 0) {
+			// parse together with the kept data
+			std::string pending;
+			std::swap(pending, this->rxPending);
+			pending.append((char const *)data, length);
+			parse((uint8_t const *)pending.data(), pending.length());
+			return;
+		}
+	}
+	if (this->http2) {
+		parseHttp2(data, length);
+		return;
+	}
+	if (this->webSocket) {
+		parseFrames(data, length);
+		return;
+	}
+	if (this->ignoring) {
+		// the connection gets shut down after a response or the response never ends, ignore following requests
+		return;
+	}
+#ifdef HTTP_SCANNER
+	size_t numParsed = this->client
+		? http_parser_execute(&this->parser, &HttpChannel::callbacks, (char const *)data, length)
+		: this->scanner.execute(this->parser, HttpChannel::callbacks, (char const *)data, length);
+#else
 	size_t numParsed = http_parser_execute(&this->parser, &HttpChannel::callbacks, (char const *)data, length);
-	if (numParsed != length) {
-		// error
-		http_errno error = HTTP_PARSER_ERRNO(&this->parser);
+#endif
+	http_errno error = HTTP_PARSER_ERRNO(&this->parser);
+	if (this->parser.upgrade && error == HPE_OK) {
+		if (this->webSocket) {
+			// remaining data belongs to the WebSocket protocol
+			parseFrames(data + numParsed, length - numParsed);
+		} else if (this->http2) {
+			// remaining data starts with the HTTP/2 connection preface
+			parseHttp2(data + numParsed, length - numParsed);
+		} else {
+			// upgrade was not accepted: continue with http
+			initParser();
+			parse(data + numParsed, length - numParsed);
+		}
+	} else if (error == HPE_PAUSED && this->ignoring) {
+		// following requests get ignored, keep receiving to detect when the connection gets closed
+	} else if (error == HPE_PAUSED) {
+		// pipeline is full: keep remaining data and stop receiving until a response is complete
+		this->rxPending.assign((char const *)data + numParsed, length - numParsed);
+		pauseReceive();
+	} else if (error != HPE_OK) {
+		// error, the scanner may report it after consuming all data
 		onError(error_code(int(error), httpCategory));
 	}
 }
 
+void HttpChannel::write(uint32_t requestId, std::string && data) {
+	uint32_t index = requestId - this->firstRequestId;
+	if (this->http2) {
+		sendStreamData(requestId, {std::move(data), nullptr, 0, nullptr, nullptr, 0});
+	} else if (index == 0) {
+		// response is at the head of the pipeline: send immediately
+		sendData(std::move(data));
+	} else if (index < this->slots.size()) {
+		// wait until the previous responses are complete
+		this->slots[index].data.push_back({std::move(data), nullptr, 0, nullptr, nullptr, 0});
+	}
+}
+
+void HttpChannel::matchHeader() {
+	// names of the headers that can be captured, in the order of the Header enum
+	static char const * const names[] = {
+		"Accept",
+		"Accept-Encoding",
+		"Connection",
+		"Content-Length",
+		"Content-Type",
+		"Host",
+		"HTTP2-Settings",
+		"If-None-Match",
+		"Sec-WebSocket-Key",
+		"Sec-WebSocket-Version",
+		"Upgrade"
+	};
+	this->headerIndex = -1;
+	if (this->fieldLength < MAX_FIELD_LENGTH) {
+		for (int i = 0; i < int(Header::COUNT); ++i) {
+			if ((this->captureMask & (1 << i)) && strncasecmp(this->field, names[i], this->fieldLength) == 0
+					&& names[i][this->fieldLength] == 0) {
+				this->headerIndex = i;
+				
+				// a repeated header replaces the previous value
+				this->headers[i] = {uint32_t(this->arena.length()), 0};
+				this->present |= 1 << i;
+				break;
+			}
+		}
+	}
+	this->fieldLength = 0;
+}
+
+void HttpChannel::onRequest(Request const & request) {
+}
+
+void HttpChannel::onResponse(int status) {
+}
+
+void HttpChannel::onAbort() {
+}
+
+void HttpChannel::onMessage(uint8_t const * data, size_t length, bool binary) {
+}
+
+void HttpChannel::parseFrames(uint8_t const * data, size_t length) {
+	this->wsFrame.append((char const *)data, length);
+	
+	size_t position = 0;
+	while (this->socket.is_open()) {
+		// frame = FIN|opcode MASK|length [extended length] [mask] payload
+		uint8_t const * frame = (uint8_t const *)this->wsFrame.data() + position;
+		size_t available = this->wsFrame.length() - position;
+		if (available < 2)
+			break;
+		bool fin = (frame[0] & 0x80) != 0;
+		int opcode = frame[0] & 0x0f;
+		bool masked = (frame[1] & 0x80) != 0;
+		uint64_t payloadLength = frame[1] & 0x7f;
+		size_t headerLength = 2;
+		if (payloadLength == 126) {
+			if (available < 4)
+				break;
+			payloadLength = (frame[2] << 8) | frame[3];
+			headerLength = 4;
+		} else if (payloadLength == 127) {
+			if (available < 10)
+				break;
+			payloadLength = 0;
+			for (int i = 0; i < 8; ++i) {
+				payloadLength = (payloadLength << 8) | frame[2 + i];
+			}
+			headerLength = 10;
+		}
+		
+		// clients must mask their frames, reserved bits and opcodes are not allowed, control frames are not fragmented
+		// and have at most 125 bytes, a continuation frame continues a fragmented message and a new message must not
+		// start before the fragmented message has ended
+		bool control = (opcode & 0x08) != 0;
+		bool valid = masked && (frame[0] & 0x70) == 0 && (control
+			? opcode <= WS_PONG && fin && payloadLength <= 125
+			: opcode <= WS_BINARY && (opcode == WS_CONTINUATION) == (this->wsOpcode != 0));
+		if (!valid || (!control && (payloadLength > WS_MAX_MESSAGE_LENGTH
+				|| this->wsMessage.length() + payloadLength > WS_MAX_MESSAGE_LENGTH))) {
+			// close with "protocol error" or "message too big"
+			uint8_t const status[] = {0x03, uint8_t(valid ? 0xf1 : 0xea)};
+			sendFrame(WS_CLOSE, status, sizeof(status));
+			shutdownWhenSent();
+			this->wsFrame.clear();
+			return;
+		}
+		if (available < headerLength + 4 + payloadLength)
+			break;
+		
+		// unmask payload in place
+		uint8_t const * mask = frame + headerLength;
+		uint8_t * payload = (uint8_t *)frame + headerLength + 4;
+		for (size_t i = 0; i < payloadLength; ++i) {
+			payload[i] ^= mask[i & 3];
+		}
+		position += headerLength + 4 + payloadLength;
+		
+		switch (opcode) {
+		case WS_CONTINUATION:
+		case WS_TEXT:
+		case WS_BINARY:
+		{
+			bool binary = (opcode == WS_CONTINUATION ? this->wsOpcode : opcode) == WS_BINARY;
+			if (fin && opcode != WS_CONTINUATION) {
+				// unfragmented message
+				onMessage(payload, size_t(payloadLength), binary);
+			} else {
+				// reassemble fragmented message
+				this->wsMessage.append((char const *)payload, size_t(payloadLength));
+				this->wsOpcode = fin ? 0 : (opcode == WS_CONTINUATION ? this->wsOpcode : opcode);
+				if (fin) {
+					std::string message;
+					std::swap(message, this->wsMessage);
+					onMessage((uint8_t const *)message.data(), message.length(), binary);
+				}
+			}
+			break;
+		}
+		case WS_CLOSE:
+			// echo close frame and close the connection, nothing may follow the close frame
+			sendFrame(WS_CLOSE, payload, std::min(size_t(payloadLength), size_t(2)));
+			shutdownWhenSent();
+			this->wsFrame.clear();
+			return;
+		case WS_PING:
+			sendFrame(WS_PONG, payload, size_t(payloadLength));
+			break;
+		}
+	}
+	
+	// remove processed frames
+	this->wsFrame.erase(0, position);
+}
+
+void HttpChannel::sendFrame(int opcode, uint8_t const * data, size_t length) {
+	// server frames are not masked
+	std::string frame = newBuffer();
+	frame += char(0x80 | opcode);
+	if (length < 126) {
+		frame += char(length);
+	} else if (length < 65536) {
+		frame += char(126);
+		frame += char(length >> 8);
+		frame += char(length);
+	} else {
+		frame += char(127);
+		for (int i = 7; i >= 0; --i) {
+			frame += char(uint64_t(length) >> (i * 8));
+		}
+	}
+	frame.append((char const *)data, length);
+	sendBody(this->webSocketRequestId, std::move(frame));
+}
+
+void HttpChannel::startHttp2() {
+	this->http2 = true;
+	this->detectHttp2 = false;
+	this->h2Preface = 0;
+	
+	// server settings, the other settings keep their default values
+	uint8_t settings[18] = {0, H2_SETTINGS_MAX_CONCURRENT_STREAMS, 0, 0, 0, 0, 0, H2_SETTINGS_INITIAL_WINDOW_SIZE,
+		0, 0, 0, 0, 0, H2_SETTINGS_MAX_HEADER_LIST_SIZE};
+	write32(settings + 2, H2_MAX_STREAMS);
+	write32(settings + 8, H2_STREAM_WINDOW);
+	write32(settings + 14, Hpack::MAX_HEADER_LIST_SIZE);
+	sendFrameHeader(H2_SETTINGS, 0, 0, sizeof(settings));
+	sendData(settings, sizeof(settings));
+}
+
+void HttpChannel::parseHttp2(uint8_t const * data, size_t length) {
+	if (this->h2Closed)
+		return;
+	
+	// connection preface of the client
+	if (this->h2Preface < H2_PREFACE_LENGTH) {
+		size_t n = std::min(length, H2_PREFACE_LENGTH - this->h2Preface);
+		if (memcmp(data, http2Preface + this->h2Preface, n) != 0) {
+			goAway(H2_PROTOCOL_ERROR);
+			return;
+		}
+		this->h2Preface += n;
+		data += n;
+		length -= n;
+	}
+	
+	// parse directly from the received data if no incomplete frame is pending
+	if (!this->h2Input.empty()) {
+		this->h2Input.append((char const *)data, length);
+		data = (uint8_t const *)this->h2Input.data();
+		length = this->h2Input.length();
+	}
+	size_t position = 0;
+	while (this->socket.is_open() && !this->h2Closed) {
+		// frame = length(24) type(8) flags(8) R|stream id(31) payload
+		uint8_t const * frame = data + position;
+		size_t available = length - position;
+		if (available < H2_FRAME_HEADER_LENGTH)
+			break;
+		size_t frameLength = (frame[0] << 16) | (frame[1] << 8) | frame[2];
+		if (frameLength > H2_DEFAULT_FRAME_LENGTH) {
+			// we don't announce a larger SETTINGS_MAX_FRAME_SIZE
+			goAway(H2_FRAME_SIZE_ERROR);
+			return;
+		}
+		if (available < H2_FRAME_HEADER_LENGTH + frameLength)
+			break;
+		position += H2_FRAME_HEADER_LENGTH + frameLength;
+		
+		int error = onFrame(frame[3], frame[4], read32(frame + 5) & 0x7fffffff, frame + H2_FRAME_HEADER_LENGTH,
+			frameLength);
+		if (error != H2_NO_ERROR) {
+			goAway(error);
+			return;
+		}
+	}
+	
+	// keep incomplete frame
+	if (this->h2Input.empty())
+		this->h2Input.assign((char const *)data + position, length - position);
+	else
+		this->h2Input.erase(0, position);
+}
+
+int HttpChannel::onFrame(int type, int flags, uint32_t streamId, uint8_t const * payload, size_t length) {
+	// a header block has to be continued without other frames in between
+	if (this->h2HeaderStreamId != 0 && (type != H2_CONTINUATION || streamId != this->h2HeaderStreamId))
+		return H2_PROTOCOL_ERROR;
+	
+	switch (type) {
+	case H2_DATA: {
+		if (streamId == 0)
+			return H2_PROTOCOL_ERROR;
+		
+		// padding counts for flow control
+		size_t frameLength = length;
+		if (flags & H2_PADDED) {
+			if (length < 1 || payload[0] >= length)
+				return H2_PROTOCOL_ERROR;
+			length -= 1 + payload[0];
+			++payload;
+		}
+		this->h2RxConsumed += uint32_t(frameLength);
+		
+		// the data may not exceed the receive window of the connection
+		this->h2RxWindow -= frameLength;
+		if (this->h2RxWindow < 0)
+			return H2_FLOW_CONTROL_ERROR;
+		
+		auto it = this->streams.find(streamId);
+		if (it == this->streams.end() || it->second.received) {
+			// data on an idle stream is a connection error, on a closed stream a stream error
+			if (streamId > this->lastStreamId)
+				return H2_PROTOCOL_ERROR;
+			resetStream(streamId, H2_STREAM_CLOSED);
+		} else {
+			Stream & stream = it->second;
+			stream.rxConsumed += uint32_t(frameLength);
+			stream.rxWindow -= frameLength;
+			if (stream.rxWindow < 0) {
+				// the data exceeds the receive window of the stream
+				resetStream(streamId, H2_FLOW_CONTROL_ERROR);
+			} else if (!stream.started) {
+				// the request waits for its turn, bound the memory of all waiting requests
+				size_t waiting = length;
+				for (auto const & p : this->streams) {
+					waiting += p.second.body.length();
+				}
+				if (waiting > H2_MAX_WAITING_DATA) {
+					resetStream(streamId, H2_REFUSED_STREAM);
+				} else {
+					stream.body.append((char const *)payload, length);
+					stream.received = (flags & H2_END_STREAM) != 0;
+				}
+			} else {
+				// pass the data of the current request as it arrives, it gets acknowledged when the body is not paused
+				this->requestId = streamId;
+				if (length > 0)
+					onBody(payload, length);
+				if ((flags & H2_END_STREAM) && this->socket.is_open())
+					endRequest(streamId);
+			}
+		}
+		acknowledgeData(false);
+		dispatchStreams();
+		return H2_NO_ERROR;
+	}
+	case H2_HEADERS: {
+		if (streamId == 0)
+			return H2_PROTOCOL_ERROR;
+		
+		// remove padding and priority
+		size_t padding = 0;
+		if (flags & H2_PADDED) {
+			if (length < 1)
+				return H2_PROTOCOL_ERROR;
+			padding = payload[0];
+			++payload;
+			--length;
+		}
+		if (flags & H2_PRIORITY_FLAG) {
+			if (length < 5)
+				return H2_PROTOCOL_ERROR;
+			payload += 5;
+			length -= 5;
+		}
+		if (padding > length)
+			return H2_PROTOCOL_ERROR;
+		this->h2HeaderBlock.assign((char const *)payload, length - padding);
+		this->h2HeaderEndStream = (flags & H2_END_STREAM) != 0;
+		if (!(flags & H2_END_HEADERS)) {
+			// header block continues in CONTINUATION frames
+			this->h2HeaderStreamId = streamId;
+			return H2_NO_ERROR;
+		}
+		return onHeaderBlock(streamId, this->h2HeaderEndStream);
+	}
+	case H2_CONTINUATION:
+		if (this->h2HeaderStreamId == 0)
+			return H2_PROTOCOL_ERROR;
+		if (this->h2HeaderBlock.length() + length > H2_MAX_HEADER_BLOCK_LENGTH)
+			return H2_ENHANCE_YOUR_CALM;
+		this->h2HeaderBlock.append((char const *)payload, length);
+		if (flags & H2_END_HEADERS) {
+			this->h2HeaderStreamId = 0;
+			return onHeaderBlock(streamId, this->h2HeaderEndStream);
+		}
+		return H2_NO_ERROR;
+	case H2_PRIORITY:
+		// priorities are ignored, all streams are served in the order of their responses
+		if (streamId == 0)
+			return H2_PROTOCOL_ERROR;
+		return H2_NO_ERROR;
+	case H2_RST_STREAM:
+		if (streamId == 0 || streamId > this->lastStreamId)
+			return H2_PROTOCOL_ERROR;
+		if (length != 4)
+			return H2_FRAME_SIZE_ERROR;
+		
+		// a response that is still sent later is dropped as the stream does not exist any more
+		removeStream(streamId);
+		dispatchStreams();
+		return H2_NO_ERROR;
+	case H2_SETTINGS: {
+		if (streamId != 0)
+			return H2_PROTOCOL_ERROR;
+		if (flags & H2_ACK) {
+			if (length != 0)
+				return H2_FRAME_SIZE_ERROR;
+			if (!this->h2SettingsAcked) {
+				// the client has reduced the receive windows of all streams to H2_STREAM_WINDOW
+				this->h2SettingsAcked = true;
+				for (auto & p : this->streams) {
+					p.second.rxWindow -= H2_DEFAULT_WINDOW - H2_STREAM_WINDOW;
+				}
+			}
+			return H2_NO_ERROR;
+		}
+		if (length % 6 != 0)
+			return H2_FRAME_SIZE_ERROR;
+		int error = applySettings(payload, length);
+		if (error != H2_NO_ERROR)
+			return error;
+		sendFrameHeader(H2_SETTINGS, H2_ACK, 0, 0);
+		drainStreams();
+		return H2_NO_ERROR;
+	}
+	case H2_PUSH_PROMISE:
+		// clients can't push
+		return H2_PROTOCOL_ERROR;
+	case H2_PING:
+		if (streamId != 0)
+			return H2_PROTOCOL_ERROR;
+		if (length != 8)
+			return H2_FRAME_SIZE_ERROR;
+		if (!(flags & H2_ACK)) {
+			sendFrameHeader(H2_PING, H2_ACK, 0, 8);
+			sendData(payload, 8);
+		}
+		return H2_NO_ERROR;
+	case H2_GOAWAY:
+		// the client creates no new streams, the open streams get their responses
+		if (streamId != 0)
+			return H2_PROTOCOL_ERROR;
+		return H2_NO_ERROR;
+	case H2_WINDOW_UPDATE: {
+		if (length != 4)
+			return H2_FRAME_SIZE_ERROR;
+		uint32_t increment = read32(payload) & 0x7fffffff;
+		if (streamId == 0) {
+			if (increment == 0)
+				return H2_PROTOCOL_ERROR;
+			this->h2Window += increment;
+			if (this->h2Window > 0x7fffffff)
+				return H2_FLOW_CONTROL_ERROR;
+			drainStreams();
+		} else {
+			auto it = this->streams.find(streamId);
+			if (it != this->streams.end()) {
+				it->second.window += increment;
+				if (increment == 0)
+					resetStream(streamId, H2_PROTOCOL_ERROR);
+				else if (it->second.window > 0x7fffffff)
+					resetStream(streamId, H2_FLOW_CONTROL_ERROR);
+				else
+					drainStream(it);
+			}
+		}
+		
+		// streamed bodies that waited for the window are pulled in onReadyToSend(), but only if something is sent
+		if (this->txPending == 0)
+			pullSources();
+		return H2_NO_ERROR;
+	}
+	}
+	
+	// unknown frame types are ignored
+	return H2_NO_ERROR;
+}
+
+int HttpChannel::checkSettings(uint8_t const * payload, size_t length) {
+	for (size_t i = 0; i + 6 <= length; i += 6) {
+		int id = (payload[i] << 8) | payload[i + 1];
+		uint32_t value = read32(payload + i + 2);
+		if (id == H2_SETTINGS_INITIAL_WINDOW_SIZE && value > 0x7fffffff)
+			return H2_FLOW_CONTROL_ERROR;
+		if (id == H2_SETTINGS_MAX_FRAME_SIZE && (value < H2_DEFAULT_FRAME_LENGTH || value > 0xffffff))
+			return H2_PROTOCOL_ERROR;
+	}
+	return H2_NO_ERROR;
+}
+
+int HttpChannel::applySettings(uint8_t const * payload, size_t length) {
+	// check first so that invalid settings don't get applied partially
+	int error = checkSettings(payload, length);
+	if (error != H2_NO_ERROR)
+		return error;
+	for (size_t i = 0; i + 6 <= length; i += 6) {
+		int id = (payload[i] << 8) | payload[i + 1];
+		uint32_t value = read32(payload + i + 2);
+		switch (id) {
+		case H2_SETTINGS_HEADER_TABLE_SIZE:
+			this->hpack.setEncoderTableSize(value);
+			break;
+		case H2_SETTINGS_INITIAL_WINDOW_SIZE: {
+			// the change applies to the windows of all open streams
+			int64_t delta = int64_t(value) - int64_t(this->h2InitialWindow);
+			for (auto & p : this->streams) {
+				p.second.window += delta;
+			}
+			this->h2InitialWindow = value;
+			break;
+		}
+		case H2_SETTINGS_MAX_FRAME_SIZE:
+			this->h2MaxFrameLength = value;
+			break;
+		}
+	}
+	return H2_NO_ERROR;
+}
+
+int HttpChannel::onHeaderBlock(uint32_t streamId, bool endStream) {
+	// only new streams with increasing odd ids that are not refused capture their fields
+	auto it = this->streams.find(streamId);
+	bool newStream = it == this->streams.end();
+	this->h2Capture = newStream && streamId > this->lastStreamId && (streamId & 1) != 0
+		&& this->streams.size() < H2_MAX_STREAMS;
+	
+	// fill the arena like the callbacks of http-parser do
+	if (this->h2Capture) {
+		this->arena.clear();
+		this->url = {0, 0};
+		this->present = 0;
+		this->h2Method = -1;
+	}
+	
+	// also decode the other blocks to keep the dynamic table in sync
+	Hpack::Result result = this->hpack.decode((uint8_t const *)this->h2HeaderBlock.data(),
+		this->h2HeaderBlock.length(), *this);
+	this->h2Capture = false;
+	if (result == Hpack::INVALID)
+		return H2_COMPRESSION_ERROR;
+	if (result == Hpack::TOO_LARGE)
+		return H2_ENHANCE_YOUR_CALM;
+	
+	if (!newStream) {
+		// trailers, their fields are ignored and they have to end the request
+		if (it->second.received || !endStream)
+			return H2_PROTOCOL_ERROR;
+		if (it->second.started)
+			endRequest(streamId);
+		else
+			it->second.received = true;
+		dispatchStreams();
+		return H2_NO_ERROR;
+	}
+	
+	// new streams have increasing odd ids
+	if (streamId <= this->lastStreamId || (streamId & 1) == 0)
+		return H2_PROTOCOL_ERROR;
+	this->lastStreamId = streamId;
+	if (this->streams.size() >= H2_MAX_STREAMS) {
+		resetStream(streamId, H2_REFUSED_STREAM);
+		return H2_NO_ERROR;
+	}
+	if (this->h2Method < 0 || this->url.length == 0) {
+		resetStream(streamId, H2_PROTOCOL_ERROR);
+		return H2_NO_ERROR;
+	}
+	
+	// the request waits in the stream until it is its turn
+	Stream & stream = this->streams[streamId];
+	stream.method = Method(this->h2Method);
+	std::swap(stream.arena, this->arena);
+	stream.url = this->url;
+	std::copy(std::begin(this->headers), std::end(this->headers), std::begin(stream.headers));
+	stream.present = this->present;
+	stream.window = this->h2InitialWindow;
+	stream.rxWindow = this->h2SettingsAcked ? H2_STREAM_WINDOW : H2_DEFAULT_WINDOW;
+	stream.received = endStream;
+	dispatchStreams();
+	return H2_NO_ERROR;
+}
+
+void HttpChannel::onHeaderField(string_view name, string_view value) {
+	if (!this->h2Capture)
+		return;
+	if (!name.empty() && name[0] == ':') {
+		// pseudo header fields
+		if (name == ":method") {
+			this->h2Method = getMethod(value);
+			return;
+		} else if (name == ":path") {
+			this->url = {uint32_t(this->arena.length()), uint32_t(value.length())};
+			this->arena.append(value.data(), value.length());
+			return;
+		} else if (name == ":authority") {
+			name = "host";
+		} else {
+			return;
+		}
+	}
+	size_t n = std::min(name.length(), size_t(MAX_FIELD_LENGTH));
+	memcpy(this->field, name.data(), n);
+	this->fieldLength = int(n);
+	matchHeader();
+	if (this->headerIndex >= 0) {
+		this->arena.append(value.data(), value.length());
+		this->headers[this->headerIndex].length += uint32_t(value.length());
+	}
+}
+
+void HttpChannel::dispatchStreams() {
+	// the stream whose body is being received may have been reset
+	if (this->h2BodyStreamId != 0 && this->streams.count(this->h2BodyStreamId) == 0)
+		this->h2BodyStreamId = 0;
+	
+	// pass the waiting requests in the order of their streams, like pipelined HTTP/1.1 requests
+	while (this->h2BodyStreamId == 0 && this->socket.is_open()) {
+		auto it = this->streams.begin();
+		while (it != this->streams.end() && it->second.started)
+			++it;
+		if (it == this->streams.end())
+			return;
+		uint32_t streamId = it->first;
+		Stream & stream = it->second;
+		stream.started = true;
+		
+		// restore the request into the arena of the channel
+		std::swap(this->arena, stream.arena);
+		this->url = stream.url;
+		std::copy(std::begin(stream.headers), std::end(stream.headers), std::begin(this->headers));
+		this->present = stream.present;
+		std::string body;
+		std::swap(body, stream.body);
+		bool received = stream.received;
+		if (!received) {
+			// the body follows, enlarge the window of the stream
+			stream.rxConsumed += H2_DEFAULT_WINDOW - H2_STREAM_WINDOW;
+			this->h2BodyStreamId = streamId;
+		}
+		Request request;
+		initRequest(request, stream.method);
+		
+		// the stream may get removed by the callbacks
+		this->requestId = streamId;
+		onRequest(request);
+		if (!body.empty() && this->socket.is_open()) {
+			this->requestId = streamId;
+			onBody((uint8_t const *)body.data(), body.length());
+		}
+		if (received && this->socket.is_open()) {
+			this->requestId = streamId;
+			onEnd();
+		}
+	}
+	acknowledgeData(false);
+}
+
+void HttpChannel::endRequest(uint32_t streamId) {
+	// the next waiting request may follow
+	this->h2BodyStreamId = 0;
+	auto it = this->streams.find(streamId);
+	if (it == this->streams.end())
+		return;
+	it->second.received = true;
+	if (it->second.sentEnd) {
+		// the response is already complete
+		this->streams.erase(it);
+	}
+	this->requestId = streamId;
+	onEnd();
+}
+
+void HttpChannel::acknowledgeData(bool all) {
+	if (this->bodyPaused || !this->socket.is_open())
+		return;
+	uint32_t threshold = all ? 1 : H2_DEFAULT_WINDOW / 2;
+	
+	// only the stream whose body is being received gets its window back, the others wait with their initial window
+	auto it = this->streams.find(this->h2BodyStreamId);
+	if (it != this->streams.end() && it->second.rxConsumed >= threshold) {
+		sendWindowUpdate(it->first, it->second.rxConsumed);
+		it->second.rxWindow += it->second.rxConsumed;
+		it->second.rxConsumed = 0;
+	}
+	if (this->h2RxConsumed >= threshold) {
+		sendWindowUpdate(0, this->h2RxConsumed);
+		this->h2RxWindow += this->h2RxConsumed;
+		this->h2RxConsumed = 0;
+	}
+}
+
+void HttpChannel::sendFrameHeader(int type, int flags, uint32_t streamId, size_t length) {
+	uint8_t header[H2_FRAME_HEADER_LENGTH] = {uint8_t(length >> 16), uint8_t(length >> 8), uint8_t(length),
+		uint8_t(type), uint8_t(flags)};
+	write32(header + 5, streamId);
+	sendData(header, sizeof(header));
+}
+
+void HttpChannel::sendWindowUpdate(uint32_t streamId, uint32_t increment) {
+	uint8_t payload[4];
+	write32(payload, increment);
+	sendFrameHeader(H2_WINDOW_UPDATE, 0, streamId, sizeof(payload));
+	sendData(payload, sizeof(payload));
+}
+
+void HttpChannel::sendHeaders(uint32_t streamId, std::string const & header) {
+	if (this->streams.count(streamId) == 0)
+		return;
+	
+	size_t position = header.find("\r\n");
+	if (position == std::string::npos || position < 12)
+		return;
+	
+	// convert status line and header lines to a header block behind space for the frame header. Begin the block only
+	// now as it may carry a pending dynamic table size update
+	std::string block = newBuffer();
+	block.assign(H2_FRAME_HEADER_LENGTH, 0);
+	this->hpack.begin(block);
+	this->hpack.encode(block, ":status", string_view(header.data() + 9, 3));
+	std::string name;
+	for (position += 2; position < header.length();) {
+		size_t end = header.find("\r\n", position);
+		if (end == std::string::npos)
+			break;
+		size_t colon = header.find(':', position);
+		if (colon < end) {
+			// header names are lower case in HTTP/2
+			name.assign(header, position, colon - position);
+			for (char & ch : name) {
+				if (ch >= 'A' && ch <= 'Z')
+					ch += 'a' - 'A';
+			}
+			size_t valueStart = colon + 1;
+			while (valueStart < end && header[valueStart] == ' ')
+				++valueStart;
+			
+			// connection specific headers are not allowed
+			if (name != "connection" && name != "keep-alive" && name != "transfer-encoding" && name != "upgrade"
+					&& name != "proxy-connection") {
+				this->hpack.encode(block, name, string_view(header.data() + valueStart, end - valueStart),
+					name != "content-length");
+			}
+		}
+		position = end + 2;
+	}
+	
+	size_t length = block.length() - H2_FRAME_HEADER_LENGTH;
+	if (length <= this->h2MaxFrameLength) {
+		// single HEADERS frame
+		uint8_t * frame = (uint8_t *)&block[0];
+		frame[0] = uint8_t(length >> 16);
+		frame[1] = uint8_t(length >> 8);
+		frame[2] = uint8_t(length);
+		frame[3] = H2_HEADERS;
+		frame[4] = H2_END_HEADERS;
+		write32(frame + 5, streamId);
+		sendData(std::move(block));
+	} else {
+		// HEADERS followed by CONTINUATION frames
+		uint8_t const * data = (uint8_t const *)block.data() + H2_FRAME_HEADER_LENGTH;
+		for (size_t offset = 0; offset < length;) {
+			size_t n = std::min(length - offset, size_t(this->h2MaxFrameLength));
+			sendFrameHeader(offset == 0 ? H2_HEADERS : H2_CONTINUATION, offset + n == length ? H2_END_HEADERS : 0,
+				streamId, n);
+			sendData(data + offset, n);
+			offset += n;
+		}
+	}
+}
+
+void HttpChannel::sendStreamData(uint32_t streamId, TxBuffer && buffer) {
+	auto it = this->streams.find(streamId);
+	if (it == this->streams.end() || it->second.complete)
+		return;
+	size_t length = buffer.borrowed != nullptr || buffer.file ? buffer.length : buffer.data.length();
+	if (length == 0)
+		return;
+	it->second.pending.push_back(std::move(buffer));
+	drainStream(it);
+}
+
+void HttpChannel::drainStream(std::map<uint32_t, Stream>::iterator it) {
+	uint32_t streamId = it->first;
+	Stream & stream = it->second;
+	if (stream.sentEnd)
+		return;
+	
+	// send DATA frames as long as the stream window and the connection window allow
+	while (!stream.pending.empty() && stream.window > 0 && this->h2Window > 0) {
+		TxBuffer & buffer = stream.pending.front();
+		bool borrowed = buffer.borrowed != nullptr;
+		uint8_t const * data = (borrowed ? buffer.borrowed : (uint8_t const *)buffer.data.data()) + stream.pendingOffset;
+		size_t length = (borrowed || buffer.file ? buffer.length : buffer.data.length()) - stream.pendingOffset;
+		size_t n = std::min(std::min(length, size_t(this->h2MaxFrameLength)),
+			size_t(std::min(stream.window, this->h2Window)));
+		std::string part;
+		if (buffer.file) {
+			// DATA frames need the file content in user space, read only what the windows allow
+			part = newBuffer();
+			part.resize(n);
+			ssize_t r = ::pread(buffer.file->fd, &part[0], n, buffer.fileOffset + int64_t(stream.pendingOffset));
+			if (r != ssize_t(n)) {
+				resetStream(streamId, H2_INTERNAL_ERROR);
+				return;
+			}
+		}
+		bool last = n == length && stream.pending.size() == 1 && stream.complete && !stream.source;
+		sendFrameHeader(H2_DATA, last ? H2_END_STREAM : 0, streamId, n);
+		if (buffer.file)
+			sendData(std::move(part));
+		else if (borrowed)
+			sendShared(buffer.owner, data, n);
+		else if (n == buffer.data.length())
+			sendData(std::move(buffer.data));
+		else
+			sendData(data, n);
+		stream.window -= n;
+		this->h2Window -= n;
+		if (n == length) {
+			stream.pending.pop_front();
+			stream.pendingOffset = 0;
+		} else {
+			stream.pendingOffset += n;
+		}
+		if (last) {
+			// keep the stream until the rest of the request was received
+			if (stream.received)
+				this->streams.erase(it);
+			else
+				stream.sentEnd = true;
+			return;
+		}
+	}
+	
+	if (stream.pending.empty() && stream.complete && !stream.source) {
+		// end of a response without body or whose last data was sent before endResponse()
+		sendFrameHeader(H2_DATA, H2_END_STREAM, streamId, 0);
+		if (stream.received)
+			this->streams.erase(it);
+		else
+			stream.sentEnd = true;
+	}
+}
+
+void HttpChannel::drainStreams() {
+	for (auto it = this->streams.begin(); it != this->streams.end() && this->h2Window > 0;) {
+		// drainStream() may remove the stream
+		auto next = std::next(it);
+		drainStream(it);
+		it = next;
+	}
+}
+
+void HttpChannel::pullSources() {
+	for (auto it = this->streams.begin(); it != this->streams.end() && this->h2Window > 0;) {
+		auto next = std::next(it);
+		Stream & stream = it->second;
+		if (stream.source && stream.pending.empty() && stream.window > 0) {
+			// read only as much as can be sent so that slow clients don't make us buffer
+			std::string buffer = newBuffer();
+			size_t maxLength = size_t(std::min(std::min(stream.window, this->h2Window), int64_t(STREAM_PART_LENGTH)));
+			bool more = stream.source->read(buffer, maxLength);
+			if (!more) {
+				stream.source = nullptr;
+				stream.complete = true;
+			}
+			if (!buffer.empty())
+				stream.pending.push_back({std::move(buffer), nullptr, 0, nullptr, nullptr, 0});
+			drainStream(it);
+		}
+		it = next;
+	}
+}
+
+void HttpChannel::resetStream(uint32_t streamId, int error) {
+	uint8_t payload[4];
+	write32(payload, error);
+	sendFrameHeader(H2_RST_STREAM, 0, streamId, sizeof(payload));
+	sendData(payload, sizeof(payload));
+	removeStream(streamId);
+}
+
+void HttpChannel::removeStream(uint32_t streamId) {
+	this->streams.erase(streamId);
+	if (streamId == this->h2BodyStreamId) {
+		// the next waiting request may follow
+		this->h2BodyStreamId = 0;
+		this->requestId = streamId;
+		onAbort();
+	}
+}
+
+void HttpChannel::goAway(int error) {
+	if (this->h2Closed)
+		return;
+	this->h2Closed = true;
+	uint8_t payload[8];
+	write32(payload, this->lastStreamId);
+	write32(payload + 4, error);
+	sendFrameHeader(H2_GOAWAY, 0, 0, sizeof(payload));
+	sendData(payload, sizeof(payload));
+	shutdownWhenSent();
+}
+
 char const * HttpChannel::getMethodString(Method method) {
 	#define XX(num, name, string) case Method::name: return #name;
 	switch (method) {
@@ -86,6 +1375,13 @@ char const * HttpChannel::getMethodString(Method method) {
 
 int HttpChannel::on_message_begin(http_parser *parser) {
 	//std::cout << "on_message_begin " << std::endl;
+	HttpChannel *channel = (HttpChannel*)parser->data;
+	channel->receiving = true;
+	channel->arena.clear();
+	channel->url = {0, 0};
+	channel->present = 0;
+	channel->fieldLength = 0;
+	channel->headerIndex = -1;
 	return 0;
 }
 
@@ -94,7 +1390,8 @@ int HttpChannel::on_url(http_parser *parser, const char *data, size_t length) {
 	
 	// server only
 	HttpChannel *channel = (HttpChannel*)parser->data;
-	channel->urlOrStatus.append(data, length);
+	channel->arena.append(data, length);
+	channel->url.length += uint32_t(length);
 	return 0;
 }
 
@@ -102,32 +1399,96 @@ int HttpChannel::on_status(http_parser *parser, const char *data, size_t length)
 	//std::cout << "on_status " << std::string(data, length) << std::endl;
 	
 	// client only
-	//HttpChannel *channel = (HttpChannel*)parser->data;
-	//channel->urlOrStatus.append(data, length);
 	return 0;
 }
 
 int HttpChannel::on_header_field(http_parser *parser, const char *data, size_t length) {
 	//std::cout << "on_header_field " << std::string(data, length) << std::endl;
 	HttpChannel *channel = (HttpChannel*)parser->data;
-	channel->moveHeader();
-	channel->field.append(data, length);
+	
+	// trailer fields after the last chunk are ignored, the request was already passed to onRequest()
+	if (parser->flags & F_TRAILING)
+		return 0;
+	
+	// the field name may arrive in several parts
+	channel->headerIndex = -1;
+	size_t n = std::min(length, size_t(MAX_FIELD_LENGTH - channel->fieldLength));
+	memcpy(channel->field + channel->fieldLength, data, n);
+	channel->fieldLength += int(n);
 	return 0;
 }
 
 int HttpChannel::on_header_value(http_parser *parser, const char *data, size_t length) {
 	//std::cout << "on_header_value " << std::string(data, length) << std::endl;
 	HttpChannel *channel = (HttpChannel*)parser->data;
-	channel->valueValid = true;
-	channel->value.append(data, length);
+	if (parser->flags & F_TRAILING)
+		return 0;
+	
+	// first part of the value: look up the field name
+	if (channel->fieldLength > 0)
+		channel->matchHeader();
+	
+	// copy value of captured headers into the arena, skip all others
+	if (channel->headerIndex >= 0) {
+		channel->arena.append(data, length);
+		channel->headers[channel->headerIndex].length += uint32_t(length);
+	}
 	return 0;
 }
 
 int HttpChannel::on_headers_complete(http_parser *parser) {
 	//std::cout << "on_headers_complete " << std::endl;
 	HttpChannel *channel = (HttpChannel*)parser->data;
-	channel->moveHeader();
-	channel->onRequest(Method(parser->method), std::move(channel->urlOrStatus), std::move(channel->headers));
+	if (channel->client) {
+		channel->onResponse(int(parser->status_code));
+		return 0;
+	}
+	
+	Request request;
+	channel->initRequest(request, Method(parser->method));
+	
+	// upgrade to HTTP/2 (h2c), only for requests without body
+	string_view upgrade = request.getHeader(Header::UPGRADE);
+	bool h2c = parser->upgrade && upgrade.length() == 3 && strncasecmp(upgrade.data(), "h2c", 3) == 0
+		&& request.hasHeader(Header::HTTP2_SETTINGS) && !(parser->flags & F_CHUNKED)
+		&& (parser->content_length == 0 || parser->content_length == ULLONG_MAX);
+	if (h2c) {
+		// the settings are checked before switching protocols
+		string_view value = request.getHeader(Header::HTTP2_SETTINGS);
+		std::string settings;
+		if (decodeBase64(settings, value.data(), value.length()) && settings.length() % 6 == 0
+				&& checkSettings((uint8_t const *)settings.data(), settings.length()) == H2_NO_ERROR) {
+			static char const switching[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
+			channel->sendStatic((uint8_t const *)switching, sizeof(switching) - 1);
+			channel->startHttp2();
+			channel->applySettings((uint8_t const *)settings.data(), settings.length());
+			
+			// the request becomes stream 1 which is half closed, the response is sent using HTTP/2
+			Stream & stream = channel->streams[1];
+			stream.started = true;
+			stream.received = true;
+			stream.window = channel->h2InitialWindow;
+			channel->lastStreamId = 1;
+			channel->requestId = 1;
+			channel->onRequest(request);
+			return 0;
+		}
+	}
+	
+	// add a response slot for the request
+	channel->requestId = channel->firstRequestId + uint32_t(channel->slots.size());
+	channel->slots.push_back({std::vector<TxBuffer>(), false,
+		parser->http_major > 1 || (parser->http_major == 1 && parser->http_minor >= 1), nullptr, false});
+	if (h2c) {
+		// invalid HTTP2-Settings header
+		Response response(*channel, 400, "Bad Request");
+		response.addClose();
+		response.addHeaders("Content-Length: 0\r\n");
+		channel->sendResponse(response);
+		channel->endResponse(channel->requestId);
+		return 0;
+	}
+	channel->onRequest(request);
 	return 0;
 }
 
@@ -141,7 +1502,14 @@ int HttpChannel::on_body(http_parser *parser, char const * data, size_t length)
 int HttpChannel::on_message_complete(http_parser *parser) {
 	//std::cout << "on_message_complete " << std::endl;
 	HttpChannel *channel = (HttpChannel*)parser->data;
+	channel->receiving = false;
 	channel->onEnd();
+	if (channel->http2)
+		return 0;
+	
+	// pause the parser if too many requests wait for their response or if following requests get ignored
+	if (int(channel->slots.size()) >= channel->pipelineDepth || channel->ignoring)
+		http_parser_pause(parser, 1);
 	return 0;
 }
 
@@ -1,17 +1,24 @@
 #pragma once
 
+#include <deque>
 #include <map>
+#include <string>
 #include "http_parser.h"
+#include "Hpack.hpp"
+#include "HttpScanner.hpp"
 #include "Url.hpp"
 #include "../Channel.hpp"
+#include "../string_view.hpp"
 
 
 /// Get HTTP error category
 error_category &getHttpCategory();
 
 ///
-/// Communication channel for HTTP/1.1
-class HttpChannel : public Channel {
+/// Communication channel for HTTP/1.1 and HTTP/2. In server mode HTTP/2 is negotiated via ALPN on TLS connections,
+/// via the Upgrade header (h2c) or by prior knowledge. The streams of HTTP/2 are mapped onto the same interface as
+/// pipelined HTTP/1.1 requests: each stream is a request with its own request id, but the responses are independent
+class HttpChannel : public Channel, protected Hpack::Listener {
 public:
 	// HTTP methods such as GET and POST
 	enum class Method {
@@ -22,59 +29,223 @@ public:
 	
 	using Headers = std::map<std::string, std::string>;
 
+	// request headers that can be captured, all other headers are skipped without copying
+	enum class Header {
+		ACCEPT,
+		ACCEPT_ENCODING,
+		CONNECTION,
+		CONTENT_LENGTH,
+		CONTENT_TYPE,
+		HOST,
+		HTTP2_SETTINGS,
+		IF_NONE_MATCH,
+		SEC_WEBSOCKET_KEY,
+		SEC_WEBSOCKET_VERSION,
+		UPGRADE,
+		
+		COUNT
+	};
+
+	///
+	/// HTTP request, the url and the captured headers are views into an arena of the channel that is reused for every
+	/// request. Only valid during onRequest()
+	class Request {
+		friend class HttpChannel;
+	public:
+		///
+		/// Get a captured header, the value is empty if the header is not present or was not captured
+		string_view getHeader(Header header) const {return this->headers[int(header)];}
+
+		///
+		/// Returns true if the header is present and was captured
+		bool hasHeader(Header header) const {return (this->present & (1 << int(header))) != 0;}
+		
+		// http method (e.g. GET)
+		Method method;
+		
+		// url without protocol and host (e.g. "/foo/bar?foo=bar")
+		string_view url;
+
+		// path and query of url (e.g. "/foo/bar" and "foo=bar")
+		string_view path;
+		string_view query;
+
+	protected:
+		string_view headers[int(Header::COUNT)];
+		uint32_t present;
+	};
+
 	///
-	/// HTTP response containing status and headers
+	/// HTTP response containing status and headers. The response is built directly in a reusable send buffer of the
+	/// channel, therefore a typical response does not allocate memory
 	class Response {
 		friend class HttpChannel;
 	public:
-		Response(int status, std::string const & message);
+		///
+		/// Constructor for a response to the request that is currently being received (call in onRequest())
+		Response(HttpChannel & channel, int status, char const * message)
+			: Response(channel, channel.requestId, status, message) {}
+		
+		///
+		/// Constructor for a response to the given request, e.g. when responding asynchronously
+		Response(HttpChannel & channel, uint32_t requestId, int status, char const * message);
 		
 		///
 		/// Add a header
+		void addHeader(char const * key, char const * value);
 		void addHeader(std::string const & key, std::string const & value);
 
+		///
+		/// Add a header with integer value
+		void addHeader(char const * key, int64_t value);
+
 		///
 		/// Add multiple headers
 		void addHeaders(Headers const & headers);
 
 		///
-		/// Add Connection: close header
+		/// Add a precomputed block of headers, each line has to be terminated by "\r\n"
+		void addHeaders(char const * block) {this->s += block;}
+
+		///
+		/// Add Connection: close header (only once)
 		void addClose();
 
 		///
 		/// Add Content-Type and Content-Length headers
-		void addContent(std::string const & contentType, size_t contentLength);
+		void addContent(char const * contentType, size_t contentLength);
 	protected:
-		std::ostringstream s;
+		uint32_t requestId;
+		std::string s;
+		bool close = false;
 	};
 	
+	///
+	/// Source of a streamed response body. The channel pulls the next part when all previous parts have been written,
+	/// therefore the body never has to be in memory at once
+	class Source : public Object {
+	public:
+		~Source() override;
+
+		///
+		/// append the next part of the body, called on the event loop of the channel. Append at least one byte unless
+		/// the end of the body was reached
+		/// @param buffer buffer to append to
+		/// @param maxLength maximum number of bytes to append
+		/// @return false if the end of the body was reached (the buffer may contain a last part)
+		virtual bool read(std::string & buffer, size_t maxLength) = 0;
+	};
+
 	///
 	/// Constructor
 	/// @param loop event loop for asynchronous io
 	/// @param timeout inactivity timeout in milliseconds after which the channel is closed
-	HttpChannel(asio::io_service & loop, int timeout);
+	/// @param client client mode: send requests and receive responses, otherwise server mode
+	HttpChannel(asio::io_service & loop, int timeout, bool client = false);
 	
 	~HttpChannel() override;
 
+	///
+	/// Get the id of the request that is currently being received. Valid in onRequest(), onBody() and onEnd(), use it
+	/// to respond asynchronously. Responses are always sent in the order of the requests, even if they are completed
+	/// out of order
+	uint32_t getRequestId() const {return this->requestId;}
+
+	///
+	/// Set maximum number of pipelined requests that wait for their response. Receiving is paused when reached
+	void setPipelineDepth(int depth) {this->pipelineDepth = depth;}
+
+	///
+	/// Server mode: stop receiving while the body of the current request is processed asynchronously, e.g. to bound the
+	/// memory that a large upload needs. HTTP/2 withholds the WINDOW_UPDATE frames instead, therefore onBody() may
+	/// still get the data that the client was allowed to send
+	void pauseBody();
+
+	///
+	/// Continue receiving after pauseBody(), unless receiving is paused because the pipeline is full
+	void resumeBody();
+
 	///
 	/// Server mode: send a http response to the client
-	/// @param response Response object dontaining the status and headers of the response
-	void sendResponse(Response const & response);
+	/// @param response Response object containing the status and headers of the response, gets moved into the send queue
+	void sendResponse(Response & response);
+
+	///
+	/// Client mode: send a http request with body to the server, the response arrives in onResponse(), onBody() and
+	/// onEnd(). Requests may be pipelined, the responses arrive in the order of the requests
+	/// @param method http method (e.g. POST)
+	/// @param url url without protocol and host (e.g. "/foo/bar?foo=bar")
+	/// @param headers precomputed block of headers including the Host header, each line terminated by "\r\n"
+	/// @param contentType content type of the body
+	/// @param body body of the request, gets moved into the send queue
+	void sendRequest(Method method, std::string const & url, char const * headers, char const * contentType,
+		std::string && body);
 
 	///
-	/// Send (part of) http body
-	void sendBody(uint8_t const * data, size_t length) {sendData(data, length);}
+	/// Send (part of) http body of the response to the given request
+	void sendBody(uint32_t requestId, uint8_t const * data, size_t length);
 
 	///
-	/// Send (part of) http body. use sendData(std::move(data)) to reduce copying of data
-	void sendBody(std::string const & data) {sendData(data);}
+	/// Send (part of) http body of the response to the given request, takes ownership of the string without copying
+	void sendBody(uint32_t requestId, std::string && data);
 
+	///
+	/// Send (part of) http body of the response to the given request without copying, the owner is referenced until
+	/// the data was written
+	void sendBody(uint32_t requestId, ptr<Object> owner, uint8_t const * data, size_t length);
+
+	///
+	/// Send (part of) http body of the response to the given request from a file without copying it into user space
+	/// where possible (plain HTTP/1.1 connections)
+	void sendFile(uint32_t requestId, ptr<File> file, int64_t offset, size_t length);
+
+	///
+	/// Send the body of the response from a source using chunked transfer encoding (close delimited for HTTP/1.0
+	/// clients). Adds the Transfer-Encoding header and sends the response, the response is finished automatically
+	/// at the end of the source
+	void sendStream(Response & response, ptr<Source> source);
+
+	///
+	/// Finish the response to the given request. Responses to following requests are sent as soon as they are complete
+	void endResponse(uint32_t requestId);
+
+	///
+	/// Server mode: don't parse further requests on a HTTP/1 connection, e.g. when the current response is an endless
+	/// stream that following responses would have to wait for. Receiving continues to detect a closed connection
+	void ignoreRequests() {if (!this->http2) this->ignoring = true;}
+
+	///
+	/// Server mode: accept a WebSocket upgrade request, call in onRequest(). Sends the handshake response and switches
+	/// the channel to WebSocket framing, received messages arrive in onMessage(). Requires capturing of the
+	/// Sec-WebSocket-Key and Sec-WebSocket-Version headers
+	/// @param request the upgrade request
+	/// @return false if the request is no valid WebSocket upgrade request, then it was answered with 400 Bad Request or
+	/// with 426 Upgrade Required if only the version is not supported, and the connection gets closed
+	bool acceptWebSocket(Request const & request);
+
+	///
+	/// Returns true if the channel was switched to WebSocket framing
+	bool isWebSocket() const {return this->webSocket;}
+
+	///
+	/// Send a WebSocket message
+	/// @param binary true for a binary message, false for a text message
+	void sendMessage(uint8_t const * data, size_t length, bool binary = false);
+	void sendMessage(std::string const & message) {sendMessage((uint8_t const *)message.data(), message.length());}
 
 	///
 	/// Returns true if this is a keep alive connection. check in onRequest(), onResponse() or onEnd()
-	/// Server mode: to close, respond with the "Connection: close" header
+	/// Server mode: to close, respond with the "Connection: close" header (ignored for HTTP/2)
 	/// Client mode: to close, close() the channel
-	bool isKeepAlive() {return http_should_keep_alive(&this->parser) != 0;}
+	bool isKeepAlive() {return this->http2 || http_should_keep_alive(&this->parser) != 0;}
+
+	///
+	/// Returns true if the connection uses HTTP/2
+	bool isHttp2() const {return this->http2;}
+
+	///
+	/// Returns true if no request is being received or waits for its response
+	bool isIdle() override;
 
 	///
 	/// Get string representation of HTTP method such as GET and POST
@@ -91,11 +262,24 @@ protected:
 	void onData(uint8_t const * data, size_t length) override;
 
 	///
-	/// Server mode: gets called when a http request header arrived from the client
-	/// @param method http method (e.g. GET)
-	/// @param url url without protocol and host (e.g. "/foo/bar?foo=bar")
-	/// @param http headers
-	virtual void onRequest(Method method, std::string url, Headers headers) = 0;
+	/// Pulls the next part of a streamed response
+	void onReadyToSend() override;
+
+	///
+	/// Capture a request header so that it is available in onRequest(), call e.g. in the constructor
+	void captureHeader(Header header) {this->captureMask |= 1 << int(header);}
+
+	///
+	/// Server mode: gets called when a http request header arrived from the client. default implementation does
+	/// nothing
+	/// @param request method, url and captured headers of the request
+	virtual void onRequest(Request const & request);
+
+	///
+	/// Client mode: gets called when a http response header arrived from the server. default implementation does
+	/// nothing
+	/// @param status status code of the response (e.g. 200)
+	virtual void onResponse(int status);
 
 	///
 	/// A (part of) a http body was received
@@ -105,6 +289,215 @@ protected:
 	/// The end of a http message was received.
 	virtual void onEnd() = 0;
 
+	///
+	/// The request whose body is being received was aborted by the client (HTTP/2 stream was reset), onEnd() does not
+	/// follow. default implementation does nothing
+	virtual void onAbort();
+
+	///
+	/// A complete (reassembled) WebSocket message was received. default implementation does nothing
+	virtual void onMessage(uint8_t const * data, size_t length, bool binary);
+
+	// WebSocket opcodes and limits
+	enum WebSocket {
+		WS_CONTINUATION = 0x0,
+		WS_TEXT = 0x1,
+		WS_BINARY = 0x2,
+		WS_CLOSE = 0x8,
+		WS_PING = 0x9,
+		WS_PONG = 0xA,
+		
+		// maximum size of a message
+		WS_MAX_MESSAGE_LENGTH = 65536
+	};
+
+	///
+	/// Parse received WebSocket frames
+	void parseFrames(uint8_t const * data, size_t length);
+
+	///
+	/// Send a WebSocket frame
+	void sendFrame(int opcode, uint8_t const * data, size_t length);
+
+	// offset and length of a string in an arena
+	struct Span {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	// HTTP/2 frame types, flags, settings, error codes and limits (RFC 7540)
+	enum Http2 {
+		H2_DATA = 0x0,
+		H2_HEADERS = 0x1,
+		H2_PRIORITY = 0x2,
+		H2_RST_STREAM = 0x3,
+		H2_SETTINGS = 0x4,
+		H2_PUSH_PROMISE = 0x5,
+		H2_PING = 0x6,
+		H2_GOAWAY = 0x7,
+		H2_WINDOW_UPDATE = 0x8,
+		H2_CONTINUATION = 0x9,
+
+		H2_END_STREAM = 0x1,
+		H2_ACK = 0x1,
+		H2_END_HEADERS = 0x4,
+		H2_PADDED = 0x8,
+		H2_PRIORITY_FLAG = 0x20,
+
+		H2_SETTINGS_HEADER_TABLE_SIZE = 0x1,
+		H2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+		H2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+		H2_SETTINGS_MAX_FRAME_SIZE = 0x5,
+		H2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6,
+
+		H2_NO_ERROR = 0x0,
+		H2_PROTOCOL_ERROR = 0x1,
+		H2_INTERNAL_ERROR = 0x2,
+		H2_FLOW_CONTROL_ERROR = 0x3,
+		H2_STREAM_CLOSED = 0x5,
+		H2_FRAME_SIZE_ERROR = 0x6,
+		H2_REFUSED_STREAM = 0x7,
+		H2_COMPRESSION_ERROR = 0x9,
+		H2_ENHANCE_YOUR_CALM = 0xb,
+
+		// length of the connection preface and of a frame header
+		H2_PREFACE_LENGTH = 24,
+		H2_FRAME_HEADER_LENGTH = 9,
+
+		// default window and frame size
+		H2_DEFAULT_WINDOW = 65535,
+		H2_DEFAULT_FRAME_LENGTH = 16384,
+
+		// initial receive window of the streams (SETTINGS_INITIAL_WINDOW_SIZE), bounds the data of requests that wait
+		// for their turn. The stream whose body is being passed to onBody() gets H2_DEFAULT_WINDOW
+		H2_STREAM_WINDOW = 16384,
+		
+		// maximum data of all requests that wait for their turn, also before the client has applied H2_STREAM_WINDOW
+		H2_MAX_WAITING_DATA = 4 * H2_DEFAULT_WINDOW,
+
+		// maximum number of concurrent streams and size of a header block
+		H2_MAX_STREAMS = 100,
+		H2_MAX_HEADER_BLOCK_LENGTH = 65536
+	};
+
+	///
+	/// HTTP/2 stream
+	struct Stream {
+		// request that waits for its body: method, url and captured headers in an own arena
+		Method method = Method::GET;
+		std::string arena;
+		Span url = {0, 0};
+		Span headers[int(Header::COUNT)];
+		uint32_t present = 0;
+
+		// data that was received before the request was passed to onRequest()
+		std::string body;
+
+		// the request was passed to onRequest(), following data is passed to onBody() as it arrives
+		bool started = false;
+
+		// END_STREAM was received, onEnd() was called for a started request
+		bool received = false;
+
+		// endResponse() was called, END_STREAM is sent after the pending data
+		bool complete = false;
+
+		// END_STREAM was sent, the stream is removed when the request was received too
+		bool sentEnd = false;
+
+		// send window and data that waits for the window
+		int64_t window = 0;
+		std::deque<TxBuffer> pending;
+		size_t pendingOffset = 0;
+
+		// source of a streamed body
+		ptr<Source> source;
+		
+		// received data that was not yet acknowledged with WINDOW_UPDATE and receive window as seen by the client
+		uint32_t rxConsumed = 0;
+		int64_t rxWindow = H2_DEFAULT_WINDOW;
+	};
+
+	///
+	/// switch to HTTP/2 and send the server settings, the client preface is expected next
+	void startHttp2();
+
+	///
+	/// parse received HTTP/2 frames
+	void parseHttp2(uint8_t const * data, size_t length);
+
+	///
+	/// handle a HTTP/2 frame
+	/// @return HTTP/2 error code, a connection error if not H2_NO_ERROR
+	int onFrame(int type, int flags, uint32_t streamId, uint8_t const * payload, size_t length);
+
+	///
+	/// check the values of settings of the peer
+	/// @return error code, H2_NO_ERROR if the settings are valid
+	static int checkSettings(uint8_t const * payload, size_t length);
+
+	///
+	/// handle settings of the peer
+	int applySettings(uint8_t const * payload, size_t length);
+
+	///
+	/// decode a complete header block of a stream
+	int onHeaderBlock(uint32_t streamId, bool endStream);
+	void onHeaderField(string_view name, string_view value) override;
+
+	///
+	/// pass the waiting requests to onRequest(), one request at a time receives its body in onBody() and onEnd()
+	void dispatchStreams();
+
+	///
+	/// END_STREAM of the request whose body is being received, calls onEnd()
+	void endRequest(uint32_t streamId);
+
+	///
+	/// send WINDOW_UPDATE frames for the consumed data unless pauseBody() was called
+	/// @param all also acknowledge less than half of the window, e.g. after resumeBody()
+	void acknowledgeData(bool all);
+
+	///
+	/// send a HTTP/2 frame header, the payload follows with separate sends
+	void sendFrameHeader(int type, int flags, uint32_t streamId, size_t length);
+
+	///
+	/// acknowledge received data of a stream or of the connection (stream id 0)
+	void sendWindowUpdate(uint32_t streamId, uint32_t increment);
+
+	///
+	/// send the response header (in HTTP/1.1 format) as HEADERS frame
+	void sendHeaders(uint32_t streamId, std::string const & header);
+
+	///
+	/// queue data of a stream and send as much as the flow control windows allow
+	void sendStreamData(uint32_t streamId, TxBuffer && buffer);
+
+	///
+	/// send pending data of a stream, END_STREAM when the response is complete. Removes finished streams
+	void drainStream(std::map<uint32_t, Stream>::iterator it);
+
+	///
+	/// send pending data of all streams, e.g. after the window has grown
+	void drainStreams();
+
+	///
+	/// pull the next part of streamed response bodies
+	void pullSources();
+
+	///
+	/// send RST_STREAM and remove the stream
+	void resetStream(uint32_t streamId, int error);
+
+	///
+	/// remove a stream, calls onAbort() if its body is being received
+	void removeStream(uint32_t streamId);
+
+	///
+	/// send GOAWAY and shut down the connection
+	void goAway(int error);
+
 	// http-parser callbacks
 	static int on_message_begin(http_parser *parser);
 	static int on_url(http_parser *parser, const char *data, size_t length);
@@ -118,25 +511,140 @@ protected:
 	static int on_chunk_complete(http_parser *parser);
 	static const http_parser_settings callbacks;
 
-	void moveHeader() {
-		if (this->valueValid) {
-			this->headers[std::move(this->field)] = std::move(this->value);
-			this->valueValid = false;
-		}
+	///
+	/// Initialize the parser for a new request (server mode) or response (client mode)
+	void initParser() {
+		http_parser_init(&this->parser, this->client ? HTTP_RESPONSE : HTTP_REQUEST);
+	#ifdef HTTP_SCANNER
+		this->scanner.reset();
+	#endif
 	}
 
+	///
+	/// Create the request with views into the arena
+	void initRequest(Request & request, Method method);
+
+	///
+	/// Parse received data, handles pausing of the parser when the pipeline is full
+	void parse(uint8_t const * data, size_t length);
+
+	///
+	/// Send data of the response to the given request or buffer it until the previous responses are complete
+	void write(uint32_t requestId, std::string && data);
+
+	///
+	/// Look up the header field that was received, sets headerIndex
+	void matchHeader();
+
+	// client or server mode
+	bool client;
+	
 	// https://github.com/nodejs/http-parser
 	http_parser parser;
+#ifdef HTTP_SCANNER
+	// alternative request parser that uses the state fields of parser, server mode only
+	HttpScanner scanner;
+#endif
 
 	// aditional parser state
 
-	// headers
-	std::string field;
-	std::string value;
-	bool valueValid = false;
-	Headers headers;
+	// headers to capture
+	uint32_t captureMask = 0;
+	
+	// name of the header field that is being received, longer names than any captured header are truncated
+	enum {MAX_FIELD_LENGTH = 24};
+	char field[MAX_FIELD_LENGTH];
+	int fieldLength = 0;
+	
+	// index of the captured header whose value is being received or -1 if the header gets skipped
+	int headerIndex = -1;
+	
+	// arena for url and captured header values of the current request, keeps its capacity between requests.
+	// Offset and length into the arena are stored as the arena may grow
+	std::string arena;
+	Span url;
+	Span headers[int(Header::COUNT)];
+	uint32_t present = 0;
+	
+	// response slot for each pipelined request, the first slot is the one that currently gets sent
+	struct Slot {
+		// data that is waiting for the previous responses to complete
+		std::vector<TxBuffer> data;
+		bool complete;
+		
+		// request was HTTP/1.1 or later and supports chunked transfer encoding
+		bool chunked;
+		
+		// source of a streamed body
+		ptr<Source> source;
+		
+		// response has the "Connection: close" header, the connection gets shut down after it
+		bool close;
+	};
 
-	// server mode: url without protocol and host (e.g. "/foo/bar?foo=bar")
-	// client mode: status (e.g. "OK")
-	std::string urlOrStatus;
+	// maximum size of one part of a streamed response
+	enum {STREAM_PART_LENGTH = 16384};
+	std::deque<Slot> slots;
+	
+	// id of the first slot and id of the request that is currently being received
+	uint32_t firstRequestId = 0;
+	uint32_t requestId = 0;
+	
+	// maximum number of slots before receiving is paused
+	int pipelineDepth = 8;
+	
+	// data that was received after the parser was paused
+	std::string rxPending;
+	
+	// a request is being received
+	bool receiving = false;
+	
+	// following requests are not parsed any more, e.g. because a response closes the connection
+	bool ignoring = false;
+	
+	// pauseBody() was called: HTTP/1.1 stops receiving, HTTP/2 withholds the WINDOW_UPDATE frames
+	bool bodyPaused = false;
+	
+	// first bytes of a server connection are checked for the HTTP/2 connection preface
+	bool detectHttp2 = false;
+	
+	// HTTP/2 state
+	bool http2 = false;
+	size_t h2Preface = 0;
+	bool h2Closed = false;
+	std::string h2Input;
+	std::map<uint32_t, Stream> streams;
+	uint32_t lastStreamId = 0;
+	Hpack hpack;
+	
+	// the decoded header fields are captured for a new stream, method -1 if it has no :method field
+	bool h2Capture = false;
+	int h2Method;
+	
+	// header block that is continued by CONTINUATION frames
+	std::string h2HeaderBlock;
+	uint32_t h2HeaderStreamId = 0;
+	bool h2HeaderEndStream = false;
+	
+	// settings of the peer and connection window
+	uint32_t h2InitialWindow = H2_DEFAULT_WINDOW;
+	uint32_t h2MaxFrameLength = H2_DEFAULT_FRAME_LENGTH;
+	int64_t h2Window = H2_DEFAULT_WINDOW;
+	
+	// received data of the connection that was not yet acknowledged, receive window as seen by the client and whether
+	// the client has applied our settings
+	uint32_t h2RxConsumed = 0;
+	int64_t h2RxWindow = H2_DEFAULT_WINDOW;
+	bool h2SettingsAcked = false;
+	
+	// stream whose body is being passed to onBody(), the requests of the other streams wait
+	uint32_t h2BodyStreamId = 0;
+	
+	// WebSocket state: incomplete frame, fragments of current message and opcode of current message (0 if no
+	// fragmented message is in progress)
+	bool webSocket = false;
+	uint32_t webSocketRequestId = 0;
+	std::string wsFrame;
+	std::string wsMessage;
+	int wsOpcode = 0;
 };
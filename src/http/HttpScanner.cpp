@@ -0,0 +1,683 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <strings.h> // strncasecmp
+#if defined(__AVX2__) || defined(__SSE4_2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "HttpScanner.hpp"
+
+
+namespace {
+
+	inline int countTrailingZeros(uint32_t mask) {
+	#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return int(index);
+	#else
+		return __builtin_ctz(mask);
+	#endif
+	}
+
+	// find the first occurrence of a or b, returns end if not found
+	char const * find(char const * p, char const * end, char a, char b) {
+	#if defined(__AVX2__)
+		// 32 bytes at a time
+		__m256i a32 = _mm256_set1_epi8(a);
+		__m256i b32 = _mm256_set1_epi8(b);
+		for (; end - p >= 32; p += 32) {
+			__m256i v = _mm256_loadu_si256((__m256i const *)p);
+			uint32_t mask = uint32_t(_mm256_movemask_epi8(
+				_mm256_or_si256(_mm256_cmpeq_epi8(v, a32), _mm256_cmpeq_epi8(v, b32))));
+			if (mask != 0)
+				return p + countTrailingZeros(mask);
+		}
+	#endif
+	#if defined(__SSE4_2__)
+		// 16 bytes at a time, compare with a set of characters
+		__m128i set = _mm_setr_epi8(a, b, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		for (; end - p >= 16; p += 16) {
+			__m128i v = _mm_loadu_si128((__m128i const *)p);
+			int index = _mm_cmpestri(set, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+			if (index < 16)
+				return p + index;
+		}
+	#elif defined(__SSE2__) || defined(_M_X64)
+		// 16 bytes at a time
+		__m128i a16 = _mm_set1_epi8(a);
+		__m128i b16 = _mm_set1_epi8(b);
+		for (; end - p >= 16; p += 16) {
+			__m128i v = _mm_loadu_si128((__m128i const *)p);
+			uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, a16), _mm_cmpeq_epi8(v, b16))));
+			if (mask != 0)
+				return p + countTrailingZeros(mask);
+		}
+	#elif defined(__ARM_NEON)
+		// 16 bytes at a time, the position inside the block is found by the scalar loop
+		uint8x16_t a16 = vdupq_n_u8(uint8_t(a));
+		uint8x16_t b16 = vdupq_n_u8(uint8_t(b));
+		for (; end - p >= 16; p += 16) {
+			uint8x16_t v = vld1q_u8((uint8_t const *)p);
+			uint64x2_t mask = vreinterpretq_u64_u8(vorrq_u8(vceqq_u8(v, a16), vceqq_u8(v, b16)));
+			if ((vgetq_lane_u64(mask, 0) | vgetq_lane_u64(mask, 1)) != 0)
+				break;
+		}
+	#endif
+		// scalar
+		for (; p < end; ++p) {
+			if (*p == a || *p == b)
+				return p;
+		}
+		return end;
+	}
+
+	// find the first control character other than horizontal tab, including carriage return and line feed, returns end
+	// if not found
+	char const * findControl(char const * p, char const * end) {
+	#if defined(__AVX2__)
+		// 32 bytes at a time, a byte is below 32 if the unsigned minimum with 31 is the byte itself
+		__m256i max32 = _mm256_set1_epi8(31);
+		__m256i tab32 = _mm256_set1_epi8('\t');
+		__m256i del32 = _mm256_set1_epi8(127);
+		for (; end - p >= 32; p += 32) {
+			__m256i v = _mm256_loadu_si256((__m256i const *)p);
+			__m256i control = _mm256_or_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(v, max32), v),
+				_mm256_cmpeq_epi8(v, del32));
+			uint32_t mask = uint32_t(_mm256_movemask_epi8(_mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab32), control)));
+			if (mask != 0)
+				return p + countTrailingZeros(mask);
+		}
+	#endif
+	#if defined(__SSE4_2__)
+		// 16 bytes at a time, compare with ranges of characters
+		__m128i ranges = _mm_setr_epi8(0, 8, 10, 31, 127, 127, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+		for (; end - p >= 16; p += 16) {
+			__m128i v = _mm_loadu_si128((__m128i const *)p);
+			int index = _mm_cmpestri(ranges, 6, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+			if (index < 16)
+				return p + index;
+		}
+	#elif defined(__SSE2__) || defined(_M_X64)
+		// 16 bytes at a time
+		__m128i max16 = _mm_set1_epi8(31);
+		__m128i tab16 = _mm_set1_epi8('\t');
+		__m128i del16 = _mm_set1_epi8(127);
+		for (; end - p >= 16; p += 16) {
+			__m128i v = _mm_loadu_si128((__m128i const *)p);
+			__m128i control = _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, max16), v), _mm_cmpeq_epi8(v, del16));
+			uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_andnot_si128(_mm_cmpeq_epi8(v, tab16), control)));
+			if (mask != 0)
+				return p + countTrailingZeros(mask);
+		}
+	#elif defined(__ARM_NEON)
+		// 16 bytes at a time, the position inside the block is found by the scalar loop
+		uint8x16_t space16 = vdupq_n_u8(' ');
+		uint8x16_t tab16 = vdupq_n_u8('\t');
+		uint8x16_t del16 = vdupq_n_u8(127);
+		for (; end - p >= 16; p += 16) {
+			uint8x16_t v = vld1q_u8((uint8_t const *)p);
+			uint8x16_t control = vbicq_u8(vorrq_u8(vcltq_u8(v, space16), vceqq_u8(v, del16)), vceqq_u8(v, tab16));
+			uint64x2_t mask = vreinterpretq_u64_u8(control);
+			if ((vgetq_lane_u64(mask, 0) | vgetq_lane_u64(mask, 1)) != 0)
+				break;
+		}
+	#endif
+		// scalar
+		for (; p < end; ++p) {
+			uint8_t ch = uint8_t(*p);
+			if ((ch < ' ' && ch != '\t') || ch == 127)
+				return p;
+		}
+		return end;
+	}
+
+	// find end of header block (after the empty line), returns nullptr if not found. A line that starts with a carriage
+	// return that is not followed by a line feed also ends the block as it is an error
+	char const * findHeaderEnd(char const * p, char const * end) {
+		while ((p = find(p, end, '\n', '\n')) < end) {
+			++p;
+			if (p < end && *p == '\n')
+				return p + 1;
+			if (p + 1 < end && p[0] == '\r')
+				return p + 2;
+		}
+		return nullptr;
+	}
+
+	// remove carriage return and whitespace at the end
+	char const * trimEnd(char const * begin, char const * end) {
+		while (end > begin && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+			--end;
+		return end;
+	}
+
+	bool equals(char const * begin, char const * end, char const * s, size_t length) {
+		return size_t(end - begin) == length && strncasecmp(begin, s, length) == 0;
+	}
+
+	int findMethod(char const * begin, char const * end) {
+		#define XX(num, name, string) if (size_t(end - begin) == sizeof(#string) - 1 \
+			&& memcmp(begin, #string, sizeof(#string) - 1) == 0) return num;
+		HTTP_METHOD_MAP(XX)
+		#undef XX
+		return -1;
+	}
+
+	// check if the comma separated list contains the token
+	bool containsToken(char const * begin, char const * end, char const * token, size_t length) {
+		while (begin < end) {
+			char const * e = find(begin, end, ',', ',');
+			char const * b = begin;
+			while (b < e && (*b == ' ' || *b == '\t'))
+				++b;
+			if (equals(b, trimEnd(b, e), token, length))
+				return true;
+			begin = e + 1;
+		}
+		return false;
+	}
+
+	// first character of a method, http_parser calls on_message_begin after it
+	bool isMethodStart(char ch) {
+		#define XX(num, name, string) if (ch == #string[0]) return true;
+		HTTP_METHOD_MAP(XX)
+		#undef XX
+		return false;
+	}
+
+	// characters of field names (tokens of RFC 7230)
+	struct TokenTable {
+		bool tokens[256] = {};
+
+		TokenTable() {
+			for (int ch = '0'; ch <= '9'; ++ch)
+				this->tokens[ch] = true;
+			for (int ch = 'a'; ch <= 'z'; ++ch)
+				this->tokens[ch] = this->tokens[ch - 'a' + 'A'] = true;
+			for (char const * s = "!#$%&'*+-.^_`|~"; *s != 0; ++s)
+				this->tokens[uint8_t(*s)] = true;
+		}
+	};
+	TokenTable const tokenTable;
+
+	inline bool isToken(char ch) {
+		return tokenTable.tokens[uint8_t(ch)];
+	}
+
+	// check if the last element of the comma separated list is the token
+	bool endsWithToken(char const * begin, char const * end, char const * token, size_t length) {
+		char const * b = end;
+		while (b > begin && b[-1] != ',')
+			--b;
+		while (b < end && (*b == ' ' || *b == '\t'))
+			++b;
+		return equals(b, trimEnd(b, end), token, length);
+	}
+
+	inline void setError(http_parser & parser, http_errno error) {
+		parser.http_errno = error;
+	}
+}
+
+void HttpScanner::reset() {
+	this->state = HEADER;
+	this->buffer.clear();
+	this->remaining = 0;
+}
+
+size_t HttpScanner::execute(http_parser & parser, http_parser_settings const & settings, char const * data,
+	size_t length)
+{
+	if (HTTP_PARSER_ERRNO(&parser) != HPE_OK)
+		return 0;
+
+	char const * p = data;
+	char const * end = data + length;
+	while (p < end) {
+		switch (this->state) {
+		case HEADER:
+			{
+				// skip empty lines before the request
+				if (this->buffer.empty()) {
+					while (p < end && (*p == '\r' || *p == '\n'))
+						++p;
+					if (p == end)
+						break;
+				}
+
+				// find end of header block, typically the whole block is in the received data
+				char const * blockBegin;
+				char const * blockEnd;
+				if (this->buffer.empty() && (blockEnd = findHeaderEnd(p, end)) != nullptr) {
+					blockBegin = p;
+					p = blockEnd;
+				} else {
+					// collect header block that is split over multiple calls
+					size_t previous = this->buffer.length();
+					this->buffer.append(p, end);
+					char const * b = this->buffer.data();
+					blockEnd = findHeaderEnd(b + (previous >= 3 ? previous - 3 : 0), b + this->buffer.length());
+					if (blockEnd == nullptr) {
+						if (this->buffer.length() > HTTP_MAX_HEADER_SIZE) {
+							setError(parser, HPE_HEADER_OVERFLOW);
+							return p - data;
+						}
+						return length;
+					}
+					blockBegin = b;
+					p += (blockEnd - b) - previous;
+				}
+
+				bool valid = parseHeader(parser, settings, blockBegin, blockEnd);
+				this->buffer.clear();
+				if (!valid)
+					return p - data;
+
+				// determine body
+				bool hasBody = (parser.flags & F_CHUNKED) || parser.content_length > 0;
+				if (parser.flags & F_SKIPBODY)
+					hasBody = false;
+				if (parser.upgrade && hasBody)
+					parser.upgrade = 0;
+				if (!hasBody) {
+					if (!message(parser, settings.on_message_complete) || parser.upgrade)
+						return p - data;
+				} else if (parser.flags & F_CHUNKED) {
+					this->state = CHUNK_SIZE;
+				} else {
+					this->remaining = parser.content_length;
+					this->state = BODY_IDENTITY;
+				}
+			}
+			break;
+		case BODY_IDENTITY:
+		case CHUNK_DATA:
+			{
+				size_t count = size_t(std::min(this->remaining, uint64_t(end - p)));
+				if (settings.on_body != nullptr && settings.on_body(&parser, p, count) != 0) {
+					setError(parser, HPE_CB_body);
+					return p - data;
+				}
+				p += count;
+				this->remaining -= count;
+				if (this->remaining == 0) {
+					if (this->state == CHUNK_DATA) {
+						this->state = CHUNK_DATA_CR;
+					} else {
+						if (!message(parser, settings.on_message_complete))
+							return p - data;
+					}
+				}
+			}
+			break;
+		case CHUNK_DATA_CR:
+			// chunk data has to be followed by exactly CR LF
+			if (*p != '\r') {
+				setError(parser, HPE_STRICT);
+				return p - data;
+			}
+			++p;
+			this->state = CHUNK_DATA_LF;
+			break;
+		case CHUNK_DATA_LF:
+			if (*p != '\n') {
+				setError(parser, HPE_LF_EXPECTED);
+				return p - data;
+			}
+			++p;
+			if (settings.on_chunk_complete != nullptr && settings.on_chunk_complete(&parser) != 0) {
+				setError(parser, HPE_CB_chunk_complete);
+				return p - data;
+			}
+			this->state = CHUNK_SIZE;
+			break;
+		case CHUNK_SIZE:
+		case TRAILER:
+			{
+				char const * lineBegin;
+				char const * lineEnd;
+				char const * next = getLine(p, end, lineBegin, lineEnd);
+				if (next == nullptr) {
+					if (this->buffer.length() > HTTP_MAX_HEADER_SIZE) {
+						setError(parser, HPE_HEADER_OVERFLOW);
+						return p - data;
+					}
+					return length;
+				}
+				p = next;
+
+				bool valid = this->state == CHUNK_SIZE
+					? parseChunkSize(parser, settings, lineBegin, lineEnd)
+					: parseTrailer(parser, settings, lineBegin, lineEnd);
+				this->buffer.clear();
+				if (!valid)
+					return p - data;
+			}
+			break;
+		case CLOSED:
+			while (p < end && (*p == '\r' || *p == '\n'))
+				++p;
+			if (p < end) {
+				setError(parser, HPE_CLOSED_CONNECTION);
+				return p - data;
+			}
+			break;
+		}
+	}
+	return p - data;
+}
+
+bool HttpScanner::parseHeader(http_parser & parser, http_parser_settings const & settings, char const * data,
+	char const * end)
+{
+	parser.flags = 0;
+	parser.content_length = ULLONG_MAX;
+	parser.upgrade = 0;
+	this->transferEncoding = false;
+
+	// like http_parser, call on_message_begin after the first character of the method
+	if (!isMethodStart(*data)) {
+		setError(parser, HPE_INVALID_METHOD);
+		return false;
+	}
+	if (settings.on_message_begin != nullptr && settings.on_message_begin(&parser) != 0) {
+		setError(parser, HPE_CB_message_begin);
+		return false;
+	}
+
+	// request line: method, url and version separated by a space
+	char const * lineEnd = find(data, end, '\n', '\n');
+	char const * space1 = find(data, lineEnd, ' ', ' ');
+	int method = space1 < lineEnd ? findMethod(data, space1) : -1;
+	if (method < 0) {
+		setError(parser, HPE_INVALID_METHOD);
+		return false;
+	}
+	parser.method = method;
+
+	// url: path, asterisk or absolute url without control characters (form feed and tab are tolerated like in
+	// http_parser), or host and port for CONNECT
+	char const * url = space1 + 1;
+	char const * space2 = find(url, lineEnd, ' ', ' ');
+	char const * control = url;
+	while ((control = findControl(control, space2)) < space2 && (*control == '\f'))
+		++control;
+	if (space2 == url || space2 == lineEnd || control < space2 || (method != HTTP_CONNECT && *url != '/'
+		&& *url != '*' && !((*url >= 'a' && *url <= 'z') || (*url >= 'A' && *url <= 'Z'))))
+	{
+		setError(parser, HPE_INVALID_URL);
+		return false;
+	}
+	if (settings.on_url != nullptr && settings.on_url(&parser, url, space2 - url) != 0) {
+		setError(parser, HPE_CB_url);
+		return false;
+	}
+
+	// version
+	char const * version = space2 + 1;
+	if (lineEnd - version < 5 || memcmp(version, "HTTP/", 5) != 0) {
+		setError(parser, HPE_INVALID_CONSTANT);
+		return false;
+	}
+	if (lineEnd - version < 8 || version[5] < '0' || version[5] > '9' || version[6] != '.' || version[7] < '0'
+		|| version[7] > '9' || (lineEnd - version > 8 && version[8] != '\r'))
+	{
+		setError(parser, HPE_INVALID_VERSION);
+		return false;
+	}
+	if (lineEnd - version > 9) {
+		// carriage return that is not followed by the line feed
+		setError(parser, HPE_LF_EXPECTED);
+		return false;
+	}
+	parser.http_major = version[5] - '0';
+	parser.http_minor = version[7] - '0';
+
+	// header lines until the empty line
+	char const * p = lineEnd + 1;
+	while (*p != '\n' && !(p[0] == '\r' && p[1] == '\n')) {
+		p = parseField(parser, settings, p, end);
+		if (p == nullptr)
+			return false;
+	}
+
+	// transfer encoding and content length must not be used together, chunked has to be the last encoding
+	if (this->transferEncoding && (parser.flags & F_CONTENTLENGTH)) {
+		setError(parser, HPE_UNEXPECTED_CONTENT_LENGTH);
+		return false;
+	}
+	if (this->transferEncoding && !(parser.flags & F_CHUNKED)) {
+		setError(parser, HPE_INVALID_TRANSFER_ENCODING);
+		return false;
+	}
+	if (!(parser.flags & F_CONTENTLENGTH))
+		parser.content_length = 0;
+	parser.upgrade = parser.method == HTTP_CONNECT
+		|| ((parser.flags & F_UPGRADE) && (parser.flags & F_CONNECTION_UPGRADE));
+
+	if (settings.on_headers_complete != nullptr) {
+		switch (settings.on_headers_complete(&parser)) {
+		case 0:
+			break;
+		case 2:
+			parser.upgrade = 1;
+			// fall through
+		case 1:
+			parser.flags |= F_SKIPBODY;
+			break;
+		default:
+			setError(parser, HPE_CB_headers_complete);
+			return false;
+		}
+	}
+	return true;
+}
+
+char const * HttpScanner::parseField(http_parser & parser, http_parser_settings const & settings, char const * data,
+	char const * end)
+{
+	// a carriage return at the start of the line has to be followed by the line feed of the empty line
+	if (*data == '\r') {
+		setError(parser, HPE_LF_EXPECTED);
+		return nullptr;
+	}
+
+	// field name up to the colon, whitespace before the colon and obsolete line folding are rejected
+	char const * colon = data;
+	while (colon < end && isToken(*colon))
+		++colon;
+	if (colon == data || colon == end || *colon != ':') {
+		setError(parser, HPE_INVALID_HEADER_TOKEN);
+		return nullptr;
+	}
+	if (settings.on_header_field != nullptr && settings.on_header_field(&parser, data, colon - data) != 0) {
+		setError(parser, HPE_CB_header_field);
+		return nullptr;
+	}
+
+	// value without leading whitespace up to the carriage return or line feed. Trailing whitespace is part of the
+	// value like in http_parser
+	char const * value = colon + 1;
+	while (value < end && (*value == ' ' || *value == '\t'))
+		++value;
+	char const * valueEnd = findControl(value, end);
+	char const * next = nullptr;
+	if (valueEnd == end || *valueEnd == '\n')
+		next = valueEnd + 1;
+	else if (*valueEnd == '\r' && (valueEnd + 1 == end || valueEnd[1] == '\n'))
+		next = valueEnd + 2;
+	bool lineComplete = next != nullptr;
+
+	// a bare carriage return ends the value, an empty value is not reported in this case
+	if (!lineComplete && *valueEnd == '\r' && valueEnd == value) {
+		setError(parser, HPE_LF_EXPECTED);
+		return nullptr;
+	}
+
+	// headers that affect parsing, checked before the value is reported
+	if (equals(data, colon, "Content-Length", 14)) {
+		if (value < valueEnd) {
+			if (*value < '0' || *value > '9') {
+				setError(parser, HPE_INVALID_CONTENT_LENGTH);
+				return nullptr;
+			}
+			if (parser.flags & F_CONTENTLENGTH) {
+				setError(parser, HPE_UNEXPECTED_CONTENT_LENGTH);
+				return nullptr;
+			}
+
+			// digits, optionally followed by spaces
+			uint64_t contentLength = 0;
+			char const * q = value;
+			for (; q < valueEnd && *q >= '0' && *q <= '9'; ++q) {
+				if (contentLength > (ULLONG_MAX - 10) / 10) {
+					setError(parser, HPE_INVALID_CONTENT_LENGTH);
+					return nullptr;
+				}
+				contentLength = contentLength * 10 + (*q - '0');
+			}
+			while (q < valueEnd && *q == ' ')
+				++q;
+			if (q < valueEnd) {
+				setError(parser, HPE_INVALID_CONTENT_LENGTH);
+				return nullptr;
+			}
+			parser.content_length = contentLength;
+			parser.flags |= F_CONTENTLENGTH;
+		} else if (lineComplete) {
+			setError(parser, HPE_INVALID_CONTENT_LENGTH);
+			return nullptr;
+		}
+	} else if (equals(data, colon, "Transfer-Encoding", 17)) {
+		// multiple headers are treated as one list, chunked has to be the last encoding
+		this->transferEncoding = true;
+		parser.flags &= ~F_CHUNKED;
+		if (lineComplete && endsWithToken(value, valueEnd, "chunked", 7))
+			parser.flags |= F_CHUNKED;
+	} else if (equals(data, colon, "Connection", 10) || equals(data, colon, "Proxy-Connection", 16)) {
+		if (lineComplete) {
+			if (containsToken(value, valueEnd, "close", 5))
+				parser.flags |= F_CONNECTION_CLOSE;
+			if (containsToken(value, valueEnd, "keep-alive", 10))
+				parser.flags |= F_CONNECTION_KEEP_ALIVE;
+			if (containsToken(value, valueEnd, "upgrade", 7))
+				parser.flags |= F_CONNECTION_UPGRADE;
+		}
+	} else if (equals(data, colon, "Upgrade", 7)) {
+		if (value < end && *value != '\r')
+			parser.flags |= F_UPGRADE;
+	}
+
+	// control characters are not allowed in the value
+	if (!lineComplete && *valueEnd != '\r') {
+		setError(parser, HPE_INVALID_HEADER_TOKEN);
+		return nullptr;
+	}
+	if (settings.on_header_value != nullptr && settings.on_header_value(&parser, value, valueEnd - value) != 0) {
+		setError(parser, HPE_CB_header_value);
+		return nullptr;
+	}
+	if (!lineComplete) {
+		setError(parser, HPE_LF_EXPECTED);
+		return nullptr;
+	}
+	return next;
+}
+
+bool HttpScanner::parseChunkSize(http_parser & parser, http_parser_settings const & settings, char const * data,
+	char const * end)
+{
+	// hexadecimal size, optionally followed by extensions, the line has to end with CR LF
+	uint64_t size = 0;
+	char const * p = data;
+	for (; p < end; ++p) {
+		char ch = *p;
+		int digit = ch >= '0' && ch <= '9' ? ch - '0'
+			: (ch >= 'a' && ch <= 'f' ? ch - 'a' + 10 : (ch >= 'A' && ch <= 'F' ? ch - 'A' + 10 : -1));
+		if (digit < 0)
+			break;
+		if (size > (ULLONG_MAX - 16) / 16) {
+			setError(parser, HPE_INVALID_CONTENT_LENGTH);
+			return false;
+		}
+		size = (size << 4) | uint64_t(digit);
+	}
+	if (p == data || p == end || (*p != '\r' && *p != ';' && *p != ' ')) {
+		setError(parser, HPE_INVALID_CHUNK_SIZE);
+		return false;
+	}
+	char const * cr = find(p, end, '\r', '\r');
+	if (cr == end) {
+		// line feed in the extensions
+		setError(parser, HPE_INVALID_CHUNK_SIZE);
+		return false;
+	}
+	if (cr + 1 != end) {
+		setError(parser, HPE_LF_EXPECTED);
+		return false;
+	}
+
+	parser.content_length = size;
+	if (size == 0)
+		parser.flags |= F_TRAILING;
+	if (settings.on_chunk_header != nullptr && settings.on_chunk_header(&parser) != 0) {
+		setError(parser, HPE_CB_chunk_header);
+		return false;
+	}
+	if (size == 0) {
+		this->state = TRAILER;
+	} else {
+		this->remaining = size;
+		this->state = CHUNK_DATA;
+	}
+	return true;
+}
+
+bool HttpScanner::parseTrailer(http_parser & parser, http_parser_settings const & settings, char const * data,
+	char const * end)
+{
+	// trailer fields are reported like header fields, the empty line ends the request
+	if (data < end && !(*data == '\r' && data + 1 == end))
+		return parseField(parser, settings, data, end) != nullptr;
+	if (settings.on_chunk_complete != nullptr && settings.on_chunk_complete(&parser) != 0) {
+		setError(parser, HPE_CB_chunk_complete);
+		return false;
+	}
+	return message(parser, settings.on_message_complete);
+}
+
+char const * HttpScanner::getLine(char const * data, char const * end, char const *& lineBegin,
+	char const *& lineEnd)
+{
+	char const * lf = find(data, end, '\n', '\n');
+	if (lf == end) {
+		this->buffer.append(data, end);
+		return nullptr;
+	}
+	if (this->buffer.empty()) {
+		lineBegin = data;
+		lineEnd = lf;
+	} else {
+		this->buffer.append(data, lf);
+		lineBegin = this->buffer.data();
+		lineEnd = lineBegin + this->buffer.length();
+	}
+	return lf + 1;
+}
+
+bool HttpScanner::message(http_parser & parser, http_cb callback) {
+	this->state = http_should_keep_alive(&parser) ? HEADER : CLOSED;
+	if (callback != nullptr && callback(&parser) != 0) {
+		setError(parser, HPE_CB_message_complete);
+		return false;
+	}
+
+	// stop if the callback paused the parser
+	return HTTP_PARSER_ERRNO(&parser) == HPE_OK;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "http_parser.h"
+
+
+///
+/// Request parser for the server side that scans for line ends and colons 16 or 32 bytes at a time using SSE2,
+/// SSE4.2, AVX2 or NEON depending on the target (scalar fallback otherwise). It produces the same callbacks as
+/// http_parser_execute() and updates the public fields of http_parser (method, http_major/minor, flags, upgrade,
+/// http_errno), therefore http_should_keep_alive() and http_parser_pause() work as usual. Pausing is checked after
+/// on_message_complete. Each part is validated before its callback like in http_parser, also trailer fields are
+/// reported. Differences to http_parser: HTTP/0.9 request lines and additional spaces in the request line are
+/// rejected and absolute urls are only checked for control characters. Enable with the HTTP_SCANNER build option
+class HttpScanner {
+public:
+
+	///
+	/// reset to the start of a new request, call together with http_parser_init()
+	void reset();
+
+	///
+	/// parse request data
+	/// @param parser receives method, version, flags and errors
+	/// @param settings callbacks
+	/// @return number of bytes parsed, less than length on error, pause or upgrade
+	size_t execute(http_parser & parser, http_parser_settings const & settings, char const * data, size_t length);
+
+protected:
+
+	enum State {
+		HEADER,
+		BODY_IDENTITY,
+		CHUNK_SIZE,
+		CHUNK_DATA,
+		CHUNK_DATA_CR,
+		CHUNK_DATA_LF,
+		TRAILER,
+
+		// the last request was not keep-alive, only line ends may follow like in http_parser
+		CLOSED
+	};
+
+	///
+	/// parse a complete header block
+	/// @return false on error
+	bool parseHeader(http_parser & parser, http_parser_settings const & settings, char const * data,
+		char const * end);
+
+	///
+	/// parse a header or trailer field
+	/// @param end end of the header block or end of the trailer line (position of the line feed)
+	/// @return start of the next line or nullptr on error
+	char const * parseField(http_parser & parser, http_parser_settings const & settings, char const * data,
+		char const * end);
+
+	///
+	/// parse the line with the size of a chunk
+	/// @param end end of line (position of the line feed)
+	/// @return false on error
+	bool parseChunkSize(http_parser & parser, http_parser_settings const & settings, char const * data,
+		char const * end);
+
+	///
+	/// parse a trailer line after the last chunk
+	/// @param end end of line (position of the line feed)
+	/// @return false on error or pause
+	bool parseTrailer(http_parser & parser, http_parser_settings const & settings, char const * data,
+		char const * end);
+
+	///
+	/// get a line from the data, lines that are split over multiple calls are collected in the line buffer
+	/// @return end of line (including the line feed) or nullptr if the line is not complete
+	char const * getLine(char const * data, char const * end, char const *& lineBegin, char const *& lineEnd);
+
+	///
+	/// end of a request, calls on_message_complete and waits for the next request if it is keep-alive
+	/// @return false on error or pause
+	bool message(http_parser & parser, http_cb callback);
+
+
+	State state = HEADER;
+
+	// incomplete header block or line
+	std::string buffer;
+
+	// remaining length of body or chunk
+	uint64_t remaining = 0;
+
+	// the request has a Transfer-Encoding header
+	bool transferEncoding = false;
+};
@@ -0,0 +1,394 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "HttpScanner.hpp"
+
+
+// Replays captured request bytes through http_parser_execute() and HttpScanner::execute(). Checks that both produce
+// the same callbacks, also when the data arrives in small parts, and reports the throughput of both.
+// usage: HttpScannerBenchmark [--check] [capture files...], uses built-in requests if no file is given. Malformed
+// requests are always checked, --check skips the throughput measurement (used by ctest)
+
+
+// requests that are used when no capture is given: typical requests of browsers and scripts
+static char const sampleRequests[] =
+	"GET /nodes HTTP/1.1\r\n"
+	"Host: 192.168.1.10:8080\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+	"Accept: application/json,text/plain;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Connection: keep-alive\r\n"
+	"If-None-Match: \"5f3a-1c\"\r\n"
+	"\r\n"
+	"GET /node/4?wait=20000 HTTP/1.1\r\n"
+	"Host: 192.168.1.10:8080\r\n"
+	"Accept: */*\r\n"
+	"\r\n"
+	"POST /node/4 HTTP/1.1\r\n"
+	"Host: 192.168.1.10:8080\r\n"
+	"Content-Type: application/x-www-form-urlencoded\r\n"
+	"Content-Length: 19\r\n"
+	"\r\n"
+	"position.blinds=50\n"
+	"POST /nodes HTTP/1.1\r\n"
+	"Host: 192.168.1.10:8080\r\n"
+	"Content-Type: application/json\r\n"
+	"Transfer-Encoding: chunked\r\n"
+	"\r\n"
+	"1d\r\n"
+	"[{\"node\":4,\"dim\":99},{\"node\":\r\n"
+	"f\r\n"
+	"5,\"dim\":0}]    \r\n"
+	"0\r\n"
+	"\r\n"
+	"GET /js/app.js HTTP/1.1\r\n"
+	"Host: 192.168.1.10:8080\r\n"
+	"Accept-Encoding: gzip\r\n"
+	"Connection: close\r\n"
+	"\r\n";
+
+
+// malformed and unusual requests where the parsers must agree on the callbacks before the error
+static char const * const edgeCases[] = {
+	// request smuggling: body length from transfer encoding and content length
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\nGET /smuggled HTTP/1.1\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked, gzip\r\n\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n5\r\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: gzip,Chunked \r\n\r\n5\r\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\nTransfer-Encoding: gzip\r\n\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding:\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encodings: gzip\r\nContent-Length: 5\r\n\r\nhello",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nContent-Length: 5\r\nTransfer-Encoding: gzip\r\n\r\nhello",
+	"POST /nodes HTTP/1.1\r\nContent-Length: 5\r\nContent-Length: 5\r\n\r\nhello",
+	"POST /nodes HTTP/1.1\r\nContent-Length: 1 2\r\n\r\nhello",
+	"POST /nodes HTTP/1.1\r\nContent-Length: 5  \r\n\r\nhello",
+	"POST /nodes HTTP/1.1\r\nContent-Length: x\r\n\r\nhello",
+	"POST /nodes HTTP/1.1\r\nContent-Length:\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nContent-Length : 5\r\n\r\nhello",
+
+	// request line
+	"get /nodes HTTP/1.1\r\n\r\n",
+	"GEX /nodes HTTP/1.1\r\n\r\n",
+	"GET\r\n\r\n",
+	"GET /nodes HTTP/1.x\r\n\r\n",
+	"GET /nodes HTXP/1.1\r\n\r\n",
+	"GET /nodes HTTP/1.1 \r\n\r\n",
+	"GET /nodes HTTP/1.1\rX\n\r\n",
+	"GET /no\x01" "des HTTP/1.1\r\n\r\n",
+	"GET http://localhost/nodes HTTP/1.0\r\n\r\n",
+	"CONNECT localhost:8080 HTTP/1.1\r\n\r\n",
+
+	// header fields
+	"GET /nodes HTTP/1.1\r\nFoo: a\r\n b\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo:\r\n\tb\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\n Foo: a\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nContent-Length:\r\n 5\r\n\r\nhello",
+	"GET /nodes HTTP/1.1\r\nFoo:   bar  \r\nBar:\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo: a\rb\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo: \rb\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo: a\x01b\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo: \x7f\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFo(o: a\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\n: a\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nFoo: a\r\n\rX\r\n",
+	"GET /nodes HTTP/1.1\nFoo: a\n\nGET /js HTTP/1.1\n\n",
+	"GET /nodes HTTP/1.1\r\nConnection: Keep-Alive, Upgrade\r\nUpgrade: websocket\r\n\r\nframes",
+	"GET /nodes HTTP/1.1\r\nConnection: upgrade\r\nUpgrade:\r\n\r\nGET / HTTP/1.1\r\n\r\n",
+	"GET /nodes HTTP/1.0\r\nProxy-Connection: keep-alive\r\n\r\nGET /js HTTP/1.0\r\n\r\n",
+	"GET /nodes HTTP/1.1\r\nConnection: close\r\n\r\n\r\nGET /js HTTP/1.1\r\n\r\n",
+
+	// chunks and trailers
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5;name=value\r\nhello\r\n0\r\n"
+		"Expires: never\r\nX-Checksum: 1234\r\n\r\nGET /js HTTP/1.1\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\nConnection: close\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n0\r\nFoo: a\r\n b\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhelloXY0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\r\nhello\rX0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5 x\r\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5;x\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\rhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nx\r\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n5\t\r\nhello\r\n0\r\n\r\n",
+	"POST /nodes HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\nfffffffffffffffff\r\n",
+};
+
+
+// callbacks that record a log of the events, consecutive data of the same kind is joined as the parsers may split it
+// at different positions
+
+struct Recorder {
+	std::string log;
+	int kind = 0;
+
+	void event(char const * name) {
+		this->log += name;
+		this->log += '\n';
+		this->kind = 0;
+	}
+
+	void data(int kind, char const * name, char const * data, size_t length) {
+		if (kind != this->kind) {
+			this->log += name;
+			this->log += ' ';
+			this->kind = kind;
+		} else {
+			// remove the line feed of the previous part
+			this->log.pop_back();
+		}
+		this->log.append(data, length);
+		this->log += '\n';
+	}
+};
+
+static Recorder & recorder(http_parser * parser) {
+	return *(Recorder *)parser->data;
+}
+
+static int recordMessageBegin(http_parser * parser) {
+	recorder(parser).event("begin");
+	return 0;
+}
+
+static int recordUrl(http_parser * parser, char const * data, size_t length) {
+	recorder(parser).data(1, "url", data, length);
+	return 0;
+}
+
+static int recordHeaderField(http_parser * parser, char const * data, size_t length) {
+	recorder(parser).data(2, "field", data, length);
+	return 0;
+}
+
+static int recordHeaderValue(http_parser * parser, char const * data, size_t length) {
+	recorder(parser).data(3, "value", data, length);
+	return 0;
+}
+
+static int recordHeadersComplete(http_parser * parser) {
+	std::ostringstream s;
+	s << "headers " << http_method_str(http_method(parser->method)) << " HTTP/" << parser->http_major << '.'
+		<< parser->http_minor << " keep-alive " << http_should_keep_alive(parser) << " upgrade "
+		<< int(parser->upgrade);
+	recorder(parser).event(s.str().c_str());
+	return 0;
+}
+
+static int recordBody(http_parser * parser, char const * data, size_t length) {
+	recorder(parser).data(4, "body", data, length);
+	return 0;
+}
+
+static int recordMessageComplete(http_parser * parser) {
+	recorder(parser).event("complete");
+	return 0;
+}
+
+static int recordChunkHeader(http_parser * parser) {
+	recorder(parser).event(("chunk " + std::to_string(parser->content_length)).c_str());
+	return 0;
+}
+
+static int recordChunkComplete(http_parser * parser) {
+	recorder(parser).event("chunk complete");
+	return 0;
+}
+
+static http_parser_settings const recordCallbacks = {
+	recordMessageBegin,
+	recordUrl,
+	nullptr,
+	recordHeaderField,
+	recordHeaderValue,
+	recordHeadersComplete,
+	recordBody,
+	recordMessageComplete,
+	recordChunkHeader,
+	recordChunkComplete
+};
+
+
+// callbacks that only count, for measuring the parsers
+
+static int countData(http_parser * parser, char const * data, size_t length) {
+	return 0;
+}
+
+static int countMessage(http_parser * parser) {
+	++*(size_t *)parser->data;
+	return 0;
+}
+
+static http_parser_settings const countCallbacks = {
+	nullptr,
+	countData,
+	nullptr,
+	countData,
+	countData,
+	nullptr,
+	countData,
+	countMessage,
+	nullptr,
+	nullptr
+};
+
+
+// parse the data in parts of the given size (0 for all at once) with http_parser or the scanner, returns the number
+// of bytes that were parsed until an error or upgrade
+static size_t parse(bool scanner, http_parser_settings const & settings, void * context, std::string const & data,
+	size_t partLength, http_errno & error)
+{
+	http_parser parser;
+	http_parser_init(&parser, HTTP_REQUEST);
+	parser.data = context;
+	HttpScanner httpScanner;
+	httpScanner.reset();
+
+	size_t position = 0;
+	while (position < data.length()) {
+		size_t length = partLength == 0 ? data.length() - position : std::min(partLength, data.length() - position);
+		size_t parsed = scanner
+			? httpScanner.execute(parser, settings, data.data() + position, length)
+			: http_parser_execute(&parser, &settings, data.data() + position, length);
+		position += parsed;
+		if (parsed != length || HTTP_PARSER_ERRNO(&parser) != HPE_OK || parser.upgrade)
+			break;
+	}
+	error = HTTP_PARSER_ERRNO(&parser);
+	return position;
+}
+
+// record the callbacks of a parser, an error or the position of an upgrade are part of the log
+static std::string record(bool scanner, std::string const & data, size_t partLength) {
+	Recorder recorder;
+	http_errno error;
+	size_t position = parse(scanner, recordCallbacks, &recorder, data, partLength, error);
+	if (error != HPE_OK)
+		recorder.event(http_errno_name(error));
+	else if (position < data.length())
+		recorder.log += "upgrade at " + std::to_string(position) + '\n';
+	return recorder.log;
+}
+
+// measure a parser, returns bytes per second
+static double measure(bool scanner, std::string const & data, size_t & messages) {
+	using Clock = std::chrono::steady_clock;
+	Clock::time_point start = Clock::now();
+	Clock::duration duration;
+	size_t bytes = 0;
+	messages = 0;
+	http_errno error;
+
+	// repeat for at least one second
+	do {
+		for (int i = 0; i < 100; ++i) {
+			bytes += parse(scanner, countCallbacks, &messages, data, 0, error);
+		}
+		duration = Clock::now() - start;
+	} while (duration < std::chrono::seconds(1));
+	double seconds = std::chrono::duration<double>(duration).count();
+	messages = size_t(messages / seconds);
+	return bytes / seconds;
+}
+
+// print the first line where the logs differ
+static void printDifference(std::string const & a, std::string const & b) {
+	std::istringstream sa(a);
+	std::istringstream sb(b);
+	std::string la;
+	std::string lb;
+	while (true) {
+		bool ha = bool(std::getline(sa, la));
+		bool hb = bool(std::getline(sb, lb));
+		if (!ha && !hb)
+			return;
+		if (!ha || !hb || la != lb) {
+			std::cout << "  http_parser: " << (ha ? la : "(end)") << std::endl;
+			std::cout << "  scanner:     " << (hb ? lb : "(end)") << std::endl;
+			return;
+		}
+	}
+}
+
+// check that the scanner produces the same callbacks as http_parser when it gets the data at once and in small parts
+// like from a slow connection
+static bool check(std::string const & data) {
+	bool same = true;
+	std::string expected = record(false, data, 0);
+	for (size_t partLength : {size_t(0), size_t(1), size_t(7), size_t(64)}) {
+		std::string log = record(true, data, partLength);
+		if (log != expected) {
+			std::cout << "  callbacks differ in parts of " << partLength << " bytes" << std::endl;
+			printDifference(expected, log);
+			same = false;
+		}
+	}
+	return same;
+}
+
+int main(int argc, char const ** argv) {
+	// captures given on the command line or the built-in requests
+	std::vector<std::pair<std::string, std::string>> captures;
+	bool checkOnly = false;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--check") == 0) {
+			checkOnly = true;
+			continue;
+		}
+		std::ifstream file(argv[i], std::ios::binary);
+		if (!file) {
+			std::cerr << "can't read " << argv[i] << std::endl;
+			return 1;
+		}
+		std::ostringstream content;
+		content << file.rdbuf();
+		captures.emplace_back(argv[i], content.str());
+	}
+	if (captures.empty())
+		captures.emplace_back("built-in requests", sampleRequests);
+
+	// malformed requests
+	bool same = true;
+	int differences = 0;
+	for (char const * edgeCase : edgeCases) {
+		if (!check(edgeCase)) {
+			std::cout << "  in " << std::string(edgeCase).substr(0, 60) << std::endl;
+			++differences;
+		}
+	}
+	std::cout << "edge cases (" << sizeof(edgeCases) / sizeof(*edgeCases) << " requests, " << differences
+		<< " differ)" << std::endl;
+	if (differences > 0)
+		same = false;
+
+	for (auto const & capture : captures) {
+		std::string const & data = capture.second;
+		std::cout << capture.first << " (" << data.length() << " bytes)" << std::endl;
+
+		// differential check
+		if (!check(data))
+			same = false;
+		if (checkOnly)
+			continue;
+
+		// throughput
+		size_t parserMessages;
+		size_t scannerMessages;
+		double parserRate = measure(false, data, parserMessages);
+		double scannerRate = measure(true, data, scannerMessages);
+		std::cout << "  http_parser: " << parserRate / 1e6 << " MB/s, " << parserMessages << " requests/s" << std::endl;
+		std::cout << "  scanner:     " << scannerRate / 1e6 << " MB/s, " << scannerMessages << " requests/s ("
+			<< scannerRate / parserRate << "x)" << std::endl;
+	}
+	return same ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+#include "JsonParser.hpp"
+#include "JsonWriter.hpp"
+#include "Query.hpp"
+
+
+static bool isSpace(char ch) {
+	return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+static bool isLiteral(char ch) {
+	return (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || ch == '-' || ch == '+' || ch == '.' || ch == 'E';
+}
+
+
+JsonParser::~JsonParser() {
+}
+
+bool JsonParser::parse(uint8_t const * data, size_t length) {
+	char const * it = (char const *)data;
+	char const * end = it + length;
+	while (it < end) {
+		char ch = *it;
+		switch (this->state) {
+		case STRING: {
+			// copy characters that need no decoding in one go
+			std::string & s = this->inKey ? this->key : this->value;
+			char const * run = it;
+			while (it < end && *it != '"' && *it != '\\' && uint8_t(*it) >= 0x20)
+				++it;
+			if (it > run && this->highSurrogate != 0)
+				return false;
+			s.append(run, it - run);
+			if (s.length() > MAX_LENGTH)
+				return false;
+			if (it == end)
+				break;
+			ch = *it++;
+			if (ch == '\\') {
+				this->state = ESCAPE;
+			} else if (ch == '"') {
+				if (this->highSurrogate != 0 || !endString())
+					return false;
+			} else {
+				// control character
+				return false;
+			}
+			break;
+		}
+		case ESCAPE: {
+			++it;
+			std::string & s = this->inKey ? this->key : this->value;
+			if (this->highSurrogate != 0 && ch != 'u')
+				return false;
+			this->state = STRING;
+			switch (ch) {
+			case '"':
+			case '\\':
+			case '/':
+				s += ch;
+				break;
+			case 'b':
+				s += '\b';
+				break;
+			case 'f':
+				s += '\f';
+				break;
+			case 'n':
+				s += '\n';
+				break;
+			case 'r':
+				s += '\r';
+				break;
+			case 't':
+				s += '\t';
+				break;
+			case 'u':
+				this->state = UNICODE;
+				this->unicodeDigits = 4;
+				this->unicode = 0;
+				break;
+			default:
+				return false;
+			}
+			break;
+		}
+		case UNICODE: {
+			++it;
+			int digit = decodeHex(ch);
+			if (digit < 0)
+				return false;
+			this->unicode = this->unicode << 4 | digit;
+			if (--this->unicodeDigits == 0) {
+				this->state = STRING;
+				if (!appendCodePoint(this->unicode))
+					return false;
+			}
+			break;
+		}
+		case LITERAL:
+			// the literal ends at the first character that does not belong to it, which is then parsed again
+			while (it < end && isLiteral(*it))
+				this->value += *it++;
+			if (this->value.length() > MAX_LENGTH)
+				return false;
+			if (it < end && !endLiteral())
+				return false;
+			break;
+		default:
+			++it;
+			if (isSpace(ch))
+				break;
+			switch (this->state) {
+			case START:
+				if (ch == '[') {
+					this->array = true;
+					this->state = FIRST_RECORD;
+				} else if (ch != '{' || !beginObject()) {
+					return false;
+				}
+				break;
+			case FIRST_RECORD:
+				if (ch == ']')
+					this->state = END;
+				else if (ch != '{' || !beginObject())
+					return false;
+				break;
+			case RECORD:
+				if (ch != '{' || !beginObject())
+					return false;
+				break;
+			case NEXT_RECORD:
+				if (ch == ',')
+					this->state = RECORD;
+				else if (ch == ']')
+					this->state = END;
+				else
+					return false;
+				break;
+			case FIRST_MEMBER:
+			case MEMBER:
+				if (ch == '"') {
+					// key starts after the prefix of the enclosing objects
+					this->key.resize(this->prefixLengths[this->depth - 1]);
+					this->inKey = true;
+					this->state = STRING;
+				} else if (ch != '}' || this->state != FIRST_MEMBER || !endObject()) {
+					return false;
+				}
+				break;
+			case COLON:
+				if (ch != ':')
+					return false;
+				this->state = VALUE;
+				break;
+			case VALUE:
+				this->value.clear();
+				if (ch == '"') {
+					this->inKey = false;
+					this->state = STRING;
+				} else if (ch == '{') {
+					// nested object: its members get the key as prefix
+					if (this->depth >= MAX_DEPTH)
+						return false;
+					this->key += '.';
+					if (!beginObject())
+						return false;
+				} else if (ch == '-' || (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z')) {
+					this->value += ch;
+					this->state = LITERAL;
+				} else {
+					// arrays are not supported
+					return false;
+				}
+				break;
+			case NEXT_MEMBER:
+				if (ch == ',')
+					this->state = MEMBER;
+				else if (ch != '}' || !endObject())
+					return false;
+				break;
+			default:
+				// END
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool JsonParser::finish() {
+	return this->state == END;
+}
+
+bool JsonParser::beginObject() {
+	this->prefixLengths[this->depth] = this->depth == 0 ? 0 : this->key.length();
+	++this->depth;
+	this->state = FIRST_MEMBER;
+	return true;
+}
+
+bool JsonParser::endObject() {
+	if (--this->depth > 0) {
+		this->state = NEXT_MEMBER;
+		return true;
+	}
+	
+	// end of record
+	this->state = this->array ? NEXT_RECORD : END;
+	return this->listener.onRecord();
+}
+
+bool JsonParser::endString() {
+	if (this->inKey) {
+		this->state = COLON;
+		return true;
+	}
+	this->state = NEXT_MEMBER;
+	return this->listener.onField(this->key, this->value);
+}
+
+bool JsonParser::endLiteral() {
+	this->state = NEXT_MEMBER;
+	if (this->value == "true")
+		return this->listener.onField(this->key, "on");
+	if (this->value == "false")
+		return this->listener.onField(this->key, "off");
+	if (this->value == "null")
+		return true;
+	
+	// numbers are passed verbatim
+	return JsonWriter::isNumber(this->value) && this->listener.onField(this->key, this->value);
+}
+
+bool JsonParser::appendCodePoint(uint32_t codePoint) {
+	// surrogate pairs encode code points above 0xffff
+	if (codePoint >= 0xd800 && codePoint < 0xdc00) {
+		if (this->highSurrogate != 0)
+			return false;
+		this->highSurrogate = codePoint;
+		return true;
+	}
+	if (codePoint >= 0xdc00 && codePoint < 0xe000) {
+		if (this->highSurrogate == 0)
+			return false;
+		codePoint = 0x10000 + ((this->highSurrogate - 0xd800) << 10) + (codePoint - 0xdc00);
+		this->highSurrogate = 0;
+	} else if (this->highSurrogate != 0) {
+		return false;
+	}
+	
+	std::string & s = this->inKey ? this->key : this->value;
+	if (codePoint < 0x80) {
+		s += char(codePoint);
+	} else if (codePoint < 0x800) {
+		s += char(0xc0 | codePoint >> 6);
+		s += char(0x80 | (codePoint & 0x3f));
+	} else if (codePoint < 0x10000) {
+		s += char(0xe0 | codePoint >> 12);
+		s += char(0x80 | (codePoint >> 6 & 0x3f));
+		s += char(0x80 | (codePoint & 0x3f));
+	} else {
+		s += char(0xf0 | codePoint >> 18);
+		s += char(0x80 | (codePoint >> 12 & 0x3f));
+		s += char(0x80 | (codePoint >> 6 & 0x3f));
+		s += char(0x80 | (codePoint & 0x3f));
+	}
+	return true;
+}
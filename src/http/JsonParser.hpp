@@ -0,0 +1,106 @@
+#pragma once
+
+#include <string>
+#include "BodyParser.hpp"
+
+
+///
+/// Incremental parser for JSON bodies. The body is an object or an array of objects, each object is a record. Nested
+/// objects are flattened into dotted keys ({"position": {"blinds": 50}} becomes "position.blinds=50"), numbers are
+/// passed verbatim, true and false become "on" and "off" and members that are null are skipped. Arrays inside a record
+/// are not supported
+class JsonParser : public BodyParser {
+public:
+	JsonParser(Listener & listener) : BodyParser(listener) {}
+
+	~JsonParser() override;
+
+	bool parse(uint8_t const * data, size_t length) override;
+	bool finish() override;
+
+protected:
+
+	enum {
+		// maximum nesting of objects in a record
+		MAX_DEPTH = 8
+	};
+
+	enum State {
+		// top level object or array
+		START,
+
+		// first record of top level array or end of array
+		FIRST_RECORD,
+
+		// record after ',' in top level array
+		RECORD,
+
+		// ',' or end of top level array
+		NEXT_RECORD,
+
+		// first member of object or end of object
+		FIRST_MEMBER,
+
+		// member after ','
+		MEMBER,
+
+		// ':' after key
+		COLON,
+
+		// value of member
+		VALUE,
+
+		// ',' or end of object
+		NEXT_MEMBER,
+
+		// key or string value
+		STRING,
+		ESCAPE,
+		UNICODE,
+
+		// number, true, false or null
+		LITERAL,
+
+		// only white space may follow
+		END
+	};
+
+	///
+	/// start of object, either a record or a nested object
+	bool beginObject();
+
+	///
+	/// end of object, ends the record if it is not nested
+	bool endObject();
+
+	///
+	/// end of a string that is a key or a value
+	bool endString();
+
+	///
+	/// end of a number, true, false or null
+	bool endLiteral();
+
+	///
+	/// append a code point of a \u escape sequence as UTF-8
+	bool appendCodePoint(uint32_t codePoint);
+
+	State state = START;
+
+	// top level is an array of records
+	bool array = false;
+
+	// nesting of objects in the current record and length of the key prefix of each level ("position.")
+	int depth = 0;
+	size_t prefixLengths[MAX_DEPTH];
+
+	// current key including prefix, current value
+	std::string key;
+	std::string value;
+	bool inKey = false;
+
+	// \u escape sequence: number of hex digits still expected, value so far and pending high surrogate
+	int unicodeDigits = 0;
+	uint32_t unicode = 0;
+	uint32_t highSurrogate = 0;
+};
@@ -0,0 +1,103 @@
+#include "../cast.hpp"
+#include "JsonWriter.hpp"
+
+
+void JsonWriter::number(int64_t value) {
+	separate();
+	append(this->buffer, value);
+}
+
+void JsonWriter::value(string_view value) {
+	separate();
+	if (value == "on")
+		this->buffer += "true";
+	else if (value == "off")
+		this->buffer += "false";
+	else if (isNumber(value))
+		this->buffer.append(value.data(), value.length());
+	else
+		writeString(value);
+}
+
+void JsonWriter::members(Parameters const & parameters) {
+	for (auto const & p : parameters.parameters) {
+		key(p.first);
+		value(p.second);
+	}
+}
+
+bool JsonWriter::isNumber(string_view s) {
+	char const * it = s.begin();
+	char const * end = s.end();
+	if (it < end && *it == '-')
+		++it;
+	char const * digits = it;
+	while (it < end && *it >= '0' && *it <= '9')
+		++it;
+	if (it == digits)
+		return false;
+	
+	// no leading zeros, e.g. "007" is sent as string
+	if (*digits == '0' && it - digits > 1)
+		return false;
+	if (it < end && *it == '.') {
+		digits = ++it;
+		while (it < end && *it >= '0' && *it <= '9')
+			++it;
+		if (it == digits)
+			return false;
+	}
+	if (it < end && (*it == 'e' || *it == 'E')) {
+		++it;
+		if (it < end && (*it == '+' || *it == '-'))
+			++it;
+		digits = it;
+		while (it < end && *it >= '0' && *it <= '9')
+			++it;
+		if (it == digits)
+			return false;
+	}
+	return it == end;
+}
+
+void JsonWriter::writeString(string_view s) {
+	std::string & b = this->buffer;
+	b += '"';
+	char const * it = s.begin();
+	char const * end = s.end();
+	while (it < end) {
+		// copy characters that need no escaping in one go, UTF-8 is copied as is
+		char const * run = it;
+		while (it < end && *it != '"' && *it != '\\' && uint8_t(*it) >= 0x20)
+			++it;
+		b.append(run, it - run);
+		if (it == end)
+			break;
+		
+		char ch = *it++;
+		b += '\\';
+		switch (ch) {
+		case '"':
+		case '\\':
+			b += ch;
+			break;
+		case '\n':
+			b += 'n';
+			break;
+		case '\r':
+			b += 'r';
+			break;
+		case '\t':
+			b += 't';
+			break;
+		default: {
+			// other control characters
+			static char const hex[] = "0123456789abcdef";
+			b += "u00";
+			b += hex[ch >> 4];
+			b += hex[ch & 15];
+		}
+		}
+	}
+	b += '"';
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "../Parameters.hpp"
+#include "../string_view.hpp"
+
+
+///
+/// Writer for JSON that appends to a string, e.g. a buffer taken from Channel::newBuffer() that then goes into the send
+/// queue. Values are written as they are produced without building a document first, commas are inserted automatically
+class JsonWriter {
+public:
+	JsonWriter(std::string & buffer) : buffer(buffer) {}
+
+	void beginObject() {separate(); this->buffer += '{'; this->comma = false;}
+	void endObject() {this->buffer += '}'; this->comma = true;}
+	void beginArray() {separate(); this->buffer += '['; this->comma = false;}
+	void endArray() {this->buffer += ']'; this->comma = true;}
+
+	///
+	/// write the key of a member, the value follows
+	void key(string_view name) {separate(); writeString(name); this->buffer += ':'; this->comma = false;}
+
+	void string(string_view value) {separate(); writeString(value);}
+	void number(int64_t value);
+	void boolean(bool value) {separate(); this->buffer += value ? "true" : "false";}
+
+	///
+	/// write the value of a parameter: numbers verbatim, "on" and "off" as true and false and others as string. This
+	/// is the inverse of the conversion of JsonParser
+	void value(string_view value);
+
+	///
+	/// write parameters as members of the current object, the keys are the dotted names ("position.blinds")
+	void members(Parameters const & parameters);
+
+	///
+	/// check if a string is a JSON number (optional minus, digits, optional fraction and exponent)
+	static bool isNumber(string_view s);
+
+protected:
+
+	void separate() {
+		if (this->comma)
+			this->buffer += ',';
+		this->comma = true;
+	}
+
+	///
+	/// write a quoted and escaped string
+	void writeString(string_view s);
+
+	std::string & buffer;
+	
+	// a comma is needed before the next key or value
+	bool comma = false;
+};
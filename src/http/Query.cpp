@@ -0,0 +1,83 @@
+#include <algorithm>
+#include "Query.hpp"
+
+
+void decodeQuery(std::string & r, string_view s) {
+	r.reserve(r.length() + s.length());
+	char const * it = s.begin();
+	char const * end = s.end();
+	while (it < end) {
+		// copy characters that need no decoding in one go
+		char const * run = it;
+		while (it < end && *it != '%' && *it != '+')
+			++it;
+		r.append(run, it - run);
+		if (it == end)
+			break;
+		
+		if (*it == '+') {
+			r += ' ';
+			++it;
+		} else {
+			// check if two characters follow
+			if (end - it < 3)
+				break;
+			
+			// convert next two characters to hex, invalid digits count as zero
+			r += char(std::max(decodeHex(it[1]), 0) << 4 | std::max(decodeHex(it[2]), 0));
+			it += 3;
+		}
+	}
+}
+
+void encodeQuery(std::string & r, std::string const & s) {
+	for (unsigned char ch : s) {
+		if (ch == '-' || ch == '.' || ch == '_' || ch == '~'
+				|| (ch >= 'A' && ch <= 'Z')
+				|| (ch >= 'a' && ch <= 'z')
+				|| (ch >= '0' && ch <= '9')) {
+			// not reserved character
+			r += ch;
+		} else if (ch == ' ') {
+			// space
+			r += '+';
+		} else {
+			// hex escape
+			static char const hex[] = "0123456789ABCDEF";
+			r += '%';
+			r += hex[ch >> 4];
+			r += hex[ch & 15];
+		}
+	}
+}
+
+void encodeParameters(std::string & r, Parameters const & parameters) {
+	for (auto const & p : parameters.parameters) {
+		if (!r.empty())
+			r += '&';
+		r += p.first;
+		r += '=';
+		encodeQuery(r, p.second);
+	}
+}
+
+void parseQuery(string_view query, Parameters & parameters) {
+	size_t argStartPos = 0;
+	while (argStartPos < query.length()) {
+		// get an argument
+		size_t argEndPos = query.find('&', argStartPos);
+		if (argEndPos == string_view::npos)
+			argEndPos = query.length();
+
+		// split argument into key and value
+		size_t eqPos = query.find('=', argStartPos);
+		if (eqPos != string_view::npos && eqPos < argEndPos) {
+			// decode directly into the parameter
+			std::string & value = parameters.parameters[query.substr(argStartPos, eqPos - argStartPos).str()];
+			value.clear();
+			decodeQuery(value, query.substr(eqPos + 1, argEndPos - eqPos - 1));
+		}
+		
+		argStartPos = argEndPos + 1;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include "Parameters.hpp"
+#include "string_view.hpp"
+
+
+///
+/// value of a hex digit, e.g. of percent-encoding
+/// @return value or -1 if the character is no hex digit
+inline int decodeHex(char ch) {
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+///
+/// append a decoded part of a query string (percent-encoding and '+' for space) to a string
+/// @param r string to append to
+/// @param s part of query string
+void decodeQuery(std::string & r, string_view s);
+
+///
+/// decode a part of a query string (percent-encoding and '+' for space)
+/// @param s part of query string
+/// @return decoded string
+inline std::string decodeQuery(string_view s) {
+	std::string r;
+	decodeQuery(r, s);
+	return r;
+}
+
+///
+/// append a string to a query string using percent-encoding
+void encodeQuery(std::string & r, std::string const & s);
+
+///
+/// append parameters to a query string, '&' is inserted if r is not empty
+void encodeParameters(std::string & r, Parameters const & parameters);
+
+///
+/// parse query string ("a=1&b=2") into parameters
+void parseQuery(string_view query, Parameters & parameters);
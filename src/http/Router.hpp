@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "HttpChannel.hpp"
+#include "string_view.hpp"
+
+
+///
+/// Path parameters of a matched route, views into the path of the request
+struct RouteParameters {
+	enum {MAX_COUNT = 4};
+	
+	string_view operator [](int index) const {return this->values[index];}
+	
+	string_view values[MAX_COUNT];
+	int count = 0;
+};
+
+///
+/// Routes requests to values (e.g. handlers) by method and path. The patterns are built into a trie of path segments
+/// at startup, a segment starting with ':' matches any segment and gets stored as path parameter (e.g. /node/:id).
+/// Literal segments take precedence over parameters, there is no backtracking. Matching does not allocate memory
+template <typename T>
+class Router {
+public:
+	using Method = HttpChannel::Method;
+
+	Router() : nodes(1) {}
+
+	///
+	/// add a route
+	/// @param method http method
+	/// @param pattern path pattern, e.g. /node/:id
+	/// @param value value to return from find()
+	void add(Method method, char const * pattern, T value) {
+		int index = 0;
+		string_view p(pattern);
+		size_t start = p.empty() || p[0] != '/' ? 0 : 1;
+		while (start < p.length()) {
+			size_t end = std::min(p.find('/', start), p.length());
+			string_view segment = p.substr(start, end - start);
+			if (!segment.empty() && segment[0] == ':') {
+				// parameter segment
+				if (this->nodes[index].parameter < 0) {
+					this->nodes[index].parameter = int(this->nodes.size());
+					this->nodes.emplace_back();
+				}
+				index = this->nodes[index].parameter;
+			} else {
+				// literal segment, children are kept sorted for binary search
+				auto & children = this->nodes[index].children;
+				auto it = lowerBound(children, segment);
+				if (it == children.end() || string_view(it->first) != segment) {
+					it = children.insert(it, {segment.str(), int(this->nodes.size())});
+					this->nodes.emplace_back();
+				}
+				index = it->second;
+			}
+			start = end + 1;
+		}
+		this->nodes[index].values.push_back({method, value});
+	}
+
+	///
+	/// find the value for a request
+	/// @param method http method of request
+	/// @param path path of request
+	/// @param parameters receives the path parameters
+	/// @return value or nullptr if no route matches
+	T const * find(Method method, string_view path, RouteParameters & parameters) const {
+		parameters.count = 0;
+		int index = 0;
+		size_t start = path.empty() || path[0] != '/' ? 0 : 1;
+		while (start < path.length()) {
+			size_t end = std::min(path.find('/', start), path.length());
+			string_view segment = path.substr(start, end - start);
+			Node const & node = this->nodes[index];
+			auto it = lowerBound(node.children, segment);
+			if (it != node.children.end() && string_view(it->first) == segment) {
+				index = it->second;
+			} else if (node.parameter >= 0 && parameters.count < RouteParameters::MAX_COUNT) {
+				parameters.values[parameters.count++] = segment;
+				index = node.parameter;
+			} else {
+				return nullptr;
+			}
+			start = end + 1;
+		}
+		for (auto const & v : this->nodes[index].values) {
+			if (v.first == method)
+				return &v.second;
+		}
+		return nullptr;
+	}
+
+protected:
+
+	using Children = std::vector<std::pair<std::string, int>>;
+
+	struct Node {
+		// literal child segments, sorted
+		Children children;
+		
+		// index of parameter child or -1
+		int parameter = -1;
+		
+		// values by method
+		std::vector<std::pair<Method, T>> values;
+	};
+
+	template <typename C>
+	static auto lowerBound(C & children, string_view segment) -> decltype(children.begin()) {
+		return std::lower_bound(children.begin(), children.end(), segment,
+			[] (std::pair<std::string, int> const & child, string_view segment) {
+				return string_view(child.first) < segment;
+			});
+	}
+
+	std::vector<Node> nodes;
+};
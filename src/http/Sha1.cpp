@@ -0,0 +1,89 @@
+#include <algorithm>
+#include "Sha1.hpp"
+
+
+namespace {
+	inline uint32_t rotate(uint32_t value, int bits) {
+		return (value << bits) | (value >> (32 - bits));
+	}
+}
+
+Sha1::Sha1() : state{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0} {
+}
+
+void Sha1::update(uint8_t const * data, size_t length) {
+	size_t position = this->length % 64;
+	this->length += length;
+	while (length > 0) {
+		size_t count = std::min(length, 64 - position);
+		std::copy(data, data + count, this->buffer + position);
+		data += count;
+		length -= count;
+		position += count;
+		if (position == 64) {
+			transform(this->buffer);
+			position = 0;
+		}
+	}
+}
+
+void Sha1::finish(uint8_t (&digest)[DIGEST_LENGTH]) {
+	uint64_t bitLength = this->length * 8;
+	
+	// padding: 0x80, zeros and length in bits so that the message is a multiple of 64 bytes
+	static uint8_t const padding[64] = {0x80};
+	size_t position = this->length % 64;
+	update(padding, position < 56 ? 56 - position : 120 - position);
+	uint8_t lengthBytes[8];
+	for (int i = 0; i < 8; ++i) {
+		lengthBytes[i] = uint8_t(bitLength >> (56 - i * 8));
+	}
+	update(lengthBytes, 8);
+
+	for (int i = 0; i < DIGEST_LENGTH; ++i) {
+		digest[i] = uint8_t(this->state[i >> 2] >> (24 - (i & 3) * 8));
+	}
+}
+
+void Sha1::transform(uint8_t const * block) {
+	uint32_t w[80];
+	for (int i = 0; i < 16; ++i) {
+		w[i] = (block[i * 4] << 24) | (block[i * 4 + 1] << 16) | (block[i * 4 + 2] << 8) | block[i * 4 + 3];
+	}
+	for (int i = 16; i < 80; ++i) {
+		w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+	}
+
+	uint32_t a = this->state[0];
+	uint32_t b = this->state[1];
+	uint32_t c = this->state[2];
+	uint32_t d = this->state[3];
+	uint32_t e = this->state[4];
+	for (int i = 0; i < 80; ++i) {
+		uint32_t f, k;
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5A827999;
+		} else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ED9EBA1;
+		} else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8F1BBCDC;
+		} else {
+			f = b ^ c ^ d;
+			k = 0xCA62C1D6;
+		}
+		uint32_t t = rotate(a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = rotate(b, 30);
+		b = a;
+		a = t;
+	}
+	this->state[0] += a;
+	this->state[1] += b;
+	this->state[2] += c;
+	this->state[3] += d;
+	this->state[4] += e;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+
+///
+/// SHA-1 hash, used for the WebSocket handshake
+class Sha1 {
+public:
+	enum {DIGEST_LENGTH = 20};
+
+	Sha1();
+
+	///
+	/// add data to the hash
+	void update(uint8_t const * data, size_t length);
+
+	///
+	/// finish the hash and get the digest
+	void finish(uint8_t (&digest)[DIGEST_LENGTH]);
+
+protected:
+
+	void transform(uint8_t const * block);
+
+	uint32_t state[5];
+	uint64_t length = 0;
+	uint8_t buffer[64];
+};
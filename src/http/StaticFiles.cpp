@@ -0,0 +1,226 @@
+#include <fcntl.h> // open
+#include <strings.h> // strncasecmp
+#include <sys/stat.h>
+#include "../cast.hpp"
+#include "Query.hpp"
+#include "StaticFiles.hpp"
+
+
+// file name suffixes and Content-Encoding values, in the order of StaticFiles::Coding
+static char const * const suffixes[] = {".br", ".gz", ""};
+static char const * const encodings[] = {"br", "gzip", nullptr};
+
+// compare case insensitive
+static bool equals(string_view a, char const * b) {
+	size_t length = strlen(b);
+	return a.length() == length && strncasecmp(a.data(), b, length) == 0;
+}
+
+// get content type by file extension
+static char const * getContentType(string_view path) {
+	static char const * const types[][2] = {
+		{"css", "text/css"},
+		{"gif", "image/gif"},
+		{"htm", "text/html; charset=utf-8"},
+		{"html", "text/html; charset=utf-8"},
+		{"ico", "image/x-icon"},
+		{"jpeg", "image/jpeg"},
+		{"jpg", "image/jpeg"},
+		{"js", "text/javascript; charset=utf-8"},
+		{"json", "application/json"},
+		{"map", "application/json"},
+		{"mjs", "text/javascript; charset=utf-8"},
+		{"png", "image/png"},
+		{"svg", "image/svg+xml"},
+		{"txt", "text/plain; charset=utf-8"},
+		{"wasm", "application/wasm"},
+		{"webmanifest", "application/manifest+json"},
+		{"webp", "image/webp"},
+		{"woff", "font/woff"},
+		{"woff2", "font/woff2"},
+		{"xml", "application/xml"}
+	};
+	size_t i = path.length();
+	while (i > 0 && path[i - 1] != '.' && path[i - 1] != '/')
+		--i;
+	if (i > 0 && path[i - 1] == '.') {
+		string_view extension = path.substr(i);
+		for (auto const & type : types) {
+			if (equals(extension, type[0]))
+				return type[1];
+		}
+	}
+	return "application/octet-stream";
+}
+
+// check if a content coding is listed in the Accept-Encoding header and not excluded by "q=0"
+static bool accepts(string_view acceptEncoding, char const * coding) {
+	size_t position = 0;
+	while (position < acceptEncoding.length()) {
+		size_t end = acceptEncoding.find(',', position);
+		if (end == string_view::npos)
+			end = acceptEncoding.length();
+
+		// "gzip", " br;q=0.8" or "*"
+		size_t i = position;
+		while (i < end && acceptEncoding[i] == ' ')
+			++i;
+		size_t j = i;
+		while (j < end && acceptEncoding[j] != ';' && acceptEncoding[j] != ' ')
+			++j;
+		string_view token = acceptEncoding.substr(i, j - i);
+		if (equals(token, coding) || token == "*") {
+			// a weight that consists of zeros only excludes the coding
+			size_t q = j;
+			while (q + 1 < end && !(acceptEncoding[q] == 'q' && acceptEncoding[q + 1] == '='))
+				++q;
+			if (q + 1 >= end)
+				return true;
+			for (q += 2; q < end && acceptEncoding[q] != ' '; ++q) {
+				if (acceptEncoding[q] != '0' && acceptEncoding[q] != '.')
+					return true;
+			}
+			return false;
+		}
+		position = end + 1;
+	}
+	return false;
+}
+
+// decode a url path into a path relative to the root, rejects "." and ".." segments and control characters
+static bool decodePath(string_view path, std::string & r) {
+	if (path.empty() || path[0] != '/')
+		return false;
+	for (size_t i = 1; i < path.length(); ++i) {
+		char ch = path[i];
+		if (ch == '%' && i + 2 < path.length()) {
+			int hi = decodeHex(path[i + 1]);
+			int lo = decodeHex(path[i + 2]);
+			if (hi < 0 || lo < 0)
+				return false;
+			ch = char(hi << 4 | lo);
+			i += 2;
+		} else if (ch == '%') {
+			return false;
+		}
+		if (uint8_t(ch) < 0x20 || ch == 0x7f || ch == '\\')
+			return false;
+		if (ch == '/') {
+			// end of segment
+			if (r.empty() || r.back() == '/')
+				continue;
+			size_t start = r.rfind('/') + 1;
+			if (r.compare(start, std::string::npos, ".") == 0 || r.compare(start, std::string::npos, "..") == 0)
+				return false;
+		}
+		r += ch;
+	}
+	size_t start = r.rfind('/') + 1;
+	return r.compare(start, std::string::npos, ".") != 0 && r.compare(start, std::string::npos, "..") != 0;
+}
+
+
+// Representation
+
+StaticFiles::Representation::~Representation() {
+}
+
+
+// StaticFiles
+
+StaticFiles::StaticFiles(std::string root) : root(std::move(root)) {
+	while (this->root.length() > 1 && this->root.back() == '/')
+		this->root.pop_back();
+}
+
+StaticFiles::~StaticFiles() {
+}
+
+ptr<StaticFiles::Representation> StaticFiles::find(string_view path, string_view acceptEncoding) {
+	// directories are served by their index.html
+	std::string relative;
+	if (!decodePath(path, relative))
+		return nullptr;
+	if (relative.empty() || relative.back() == '/')
+		relative += "index.html";
+
+	std::lock_guard<std::mutex> lock(this->mutex);
+	auto now = std::chrono::steady_clock::now();
+	auto it = this->entries.find(relative);
+	if (it == this->entries.end()) {
+		// also paths that were not found are cached, start over when there are too many
+		if (this->entries.size() >= MAX_ENTRIES)
+			this->entries.clear();
+		it = this->entries.emplace(relative, Entry()).first;
+		load(it->first, it->second);
+	} else if (now - it->second.checked >= std::chrono::milliseconds(CHECK_INTERVAL)) {
+		load(it->first, it->second);
+	}
+
+	// first coding in order of preference that the client accepts
+	Entry & entry = it->second;
+	for (int coding = 0; coding < CODING_COUNT; ++coding) {
+		ptr<Representation> const & representation = entry.representations[coding];
+		if (representation && (coding == IDENTITY || accepts(acceptEncoding, encodings[coding])))
+			return representation;
+	}
+	return nullptr;
+}
+
+void StaticFiles::load(std::string const & path, Entry & entry) {
+	entry.checked = std::chrono::steady_clock::now();
+	std::string base = this->root + '/' + path;
+	for (int coding = 0; coding < CODING_COUNT; ++coding) {
+		std::string name = base + suffixes[coding];
+		struct stat s;
+		Entry::Stat stat = {0, 0, -1};
+		if (::stat(name.c_str(), &s) == 0 && S_ISREG(s.st_mode))
+			stat = {uint64_t(s.st_ino), int64_t(s.st_mtime), int64_t(s.st_size)};
+		Entry::Stat & previous = entry.stats[coding];
+		if (stat.inode == previous.inode && stat.modified == previous.modified && stat.size == previous.size)
+			continue;
+
+		// new, changed or removed file
+		entry.representations[coding] = nullptr;
+		int fd = stat.size >= 0 ? ::open(name.c_str(), O_RDONLY | O_CLOEXEC) : -1;
+		if (fd < 0) {
+			previous = {0, 0, -1};
+			continue;
+		}
+		previous = stat;
+		ptr<Representation> representation = new Representation();
+		representation->file = new File(fd);
+		representation->length = size_t(stat.size);
+
+		// entity tag from modification time and size, with the coding as the representations differ
+		std::string & etag = representation->etag;
+		etag += '"';
+		append(etag, stat.modified);
+		etag += '-';
+		append(etag, stat.size);
+		if (encodings[coding] != nullptr) {
+			etag += '-';
+			etag += encodings[coding];
+		}
+		etag += '"';
+
+		// the client revalidates with If-None-Match before using its cached copy
+		std::string & headers = representation->headers;
+		headers += "ETag: ";
+		headers += etag;
+		headers += "\r\nVary: Accept-Encoding\r\nCache-Control: no-cache\r\n";
+
+		std::string & contentHeaders = representation->contentHeaders;
+		contentHeaders += "Content-Type: ";
+		contentHeaders += getContentType(path);
+		if (encodings[coding] != nullptr) {
+			contentHeaders += "\r\nContent-Encoding: ";
+			contentHeaders += encodings[coding];
+		}
+		contentHeaders += "\r\nContent-Length: ";
+		append(contentHeaders, stat.size);
+		contentHeaders += "\r\n";
+
+		entry.representations[coding] = representation;
+	}
+}
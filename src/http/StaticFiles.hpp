@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include "../File.hpp"
+#include "../ptr.hpp"
+#include "../string_view.hpp"
+
+
+///
+/// Static files of a directory, e.g. a web UI. Files are sent from open file descriptors with sendfile. Precompressed
+/// siblings (index.html.br, index.html.gz) are preferred if the client accepts them. Open files, their metadata and
+/// response headers are cached and checked against the file system at most once per CHECK_INTERVAL, so that a
+/// request typically needs no system call except for sending. Can be used from all event loops
+class StaticFiles : public Object {
+public:
+	///
+	/// Constructor
+	/// @param root directory that contains the files
+	StaticFiles(std::string root);
+
+	~StaticFiles() override;
+
+	///
+	/// Representation of a file in one content coding. Immutable once created, therefore it can be shared with
+	/// channels on other event loops
+	class Representation : public Object {
+	public:
+		~Representation() override;
+
+		ptr<File> file;
+		size_t length;
+
+		// entity tag (including quotes), differs between the content codings of a file
+		std::string etag;
+
+		// ETag, Vary and Cache-Control headers, also sent with 304 Not Modified
+		std::string headers;
+
+		// Content-Type, Content-Encoding and Content-Length headers
+		std::string contentHeaders;
+	};
+
+	///
+	/// find a file
+	/// @param path path of the request, e.g. "/" or "/js/app.js"
+	/// @param acceptEncoding value of the Accept-Encoding header
+	/// @return representation or null if the file does not exist
+	ptr<Representation> find(string_view path, string_view acceptEncoding);
+
+protected:
+
+	enum {
+		// time in milliseconds after which a cached file is checked for changes
+		CHECK_INTERVAL = 2000,
+
+		// maximum number of cached paths including paths that were not found
+		MAX_ENTRIES = 1024
+	};
+
+	// content codings in order of preference
+	enum Coding {
+		BROTLI,
+		GZIP,
+		IDENTITY,
+		CODING_COUNT
+	};
+
+	struct Entry {
+		std::chrono::steady_clock::time_point checked;
+
+		// representations and the metadata they were created from (inode, modification time and size)
+		ptr<Representation> representations[CODING_COUNT];
+		struct Stat {
+			uint64_t inode;
+			int64_t modified;
+			int64_t size;
+		} stats[CODING_COUNT];
+	};
+
+	///
+	/// check the files of an entry and create representations of new or changed files
+	void load(std::string const & path, Entry & entry);
+
+	std::string root;
+	std::mutex mutex;
+	std::map<std::string, Entry> entries;
+};
@@ -374,13 +374,18 @@ enum header_states
   , h_transfer_encoding
   , h_upgrade
 
+  , h_matching_transfer_encoding_token_start
   , h_matching_transfer_encoding_chunked
+  , h_matching_transfer_encoding_token
+
   , h_matching_connection_token_start
   , h_matching_connection_keep_alive
   , h_matching_connection_close
   , h_matching_connection_upgrade
   , h_matching_connection_token
 
+  , h_content_length_num
+  , h_content_length_ws
   , h_transfer_encoding_chunked
   , h_connection_keep_alive
   , h_connection_close
@@ -432,6 +437,10 @@ enum http_host_state
   (IS_ALPHANUM(c) || (c) == '.' || (c) == '-' || (c) == '_')
 #endif
 
+/* A server has to reject whitespace in field names (RFC 7230 3.2.4) */
+#define FIELD_TOKEN(c)                                                         \
+  (parser->type == HTTP_REQUEST ? STRICT_TOKEN(c) : TOKEN(c))
+
 /**
  * Verify that a char is a valid visible (printable) US-ASCII
  * character or %x80-FF
@@ -720,6 +729,7 @@ reexecute:
         if (ch == CR || ch == LF)
           break;
         parser->flags = 0;
+        parser->extra_flags = 0;
         parser->content_length = ULLONG_MAX;
 
         if (ch == 'H') {
@@ -755,6 +765,7 @@ reexecute:
       case s_start_res:
       {
         parser->flags = 0;
+        parser->extra_flags = 0;
         parser->content_length = ULLONG_MAX;
 
         switch (ch) {
@@ -919,6 +930,7 @@ reexecute:
         if (ch == CR || ch == LF)
           break;
         parser->flags = 0;
+        parser->extra_flags = 0;
         parser->content_length = ULLONG_MAX;
 
         if (UNLIKELY(!IS_ALPHA(ch))) {
@@ -1096,22 +1108,34 @@ reexecute:
         break;
 
       case s_req_http_H:
-        STRICT_CHECK(ch != 'T');
+        if (UNLIKELY(ch != 'T')) {
+          SET_ERRNO(HPE_INVALID_CONSTANT);
+          goto error;
+        }
         UPDATE_STATE(s_req_http_HT);
         break;
 
       case s_req_http_HT:
-        STRICT_CHECK(ch != 'T');
+        if (UNLIKELY(ch != 'T')) {
+          SET_ERRNO(HPE_INVALID_CONSTANT);
+          goto error;
+        }
         UPDATE_STATE(s_req_http_HTT);
         break;
 
       case s_req_http_HTT:
-        STRICT_CHECK(ch != 'P');
+        if (UNLIKELY(ch != 'P')) {
+          SET_ERRNO(HPE_INVALID_CONSTANT);
+          goto error;
+        }
         UPDATE_STATE(s_req_http_HTTP);
         break;
 
       case s_req_http_HTTP:
-        STRICT_CHECK(ch != '/');
+        if (UNLIKELY(ch != '/')) {
+          SET_ERRNO(HPE_INVALID_CONSTANT);
+          goto error;
+        }
         UPDATE_STATE(s_req_http_major);
         break;
 
@@ -1189,7 +1213,7 @@ reexecute:
           REEXECUTE();
         }
 
-        c = TOKEN(ch);
+        c = FIELD_TOKEN(ch);
 
         if (UNLIKELY(!c)) {
           SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
@@ -1230,7 +1254,7 @@ reexecute:
         const char* start = p;
         for (; p != data + len; p++) {
           ch = *p;
-          c = TOKEN(ch);
+          c = FIELD_TOKEN(ch);
 
           if (!c)
             break;
@@ -1345,6 +1369,16 @@ reexecute:
         }
 
         if (ch == ':') {
+          if (parser->header_state == h_transfer_encoding) {
+            parser->extra_flags |= F_TRANSFER_ENCODING >> 8;
+
+            /* Multiple `Transfer-Encoding` headers are treated as one with
+             * the values separated by commas (RFC 7230 3.2.2), only the last
+             * coding counts.
+             */
+            parser->flags &= ~F_CHUNKED;
+          }
+
           UPDATE_STATE(s_header_value_discard_ws);
           CALLBACK_DATA(header_field);
           break;
@@ -1371,6 +1405,11 @@ reexecute:
 
       case s_header_value_start:
       {
+        if (!lenient && !IS_HEADER_CHAR(ch)) {
+          SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+          goto error;
+        }
+
         MARK(header_value);
 
         UPDATE_STATE(s_header_value);
@@ -1389,7 +1428,7 @@ reexecute:
             if ('c' == c) {
               parser->header_state = h_matching_transfer_encoding_chunked;
             } else {
-              parser->header_state = h_general;
+              parser->header_state = h_matching_transfer_encoding_token;
             }
             break;
 
@@ -1406,6 +1445,7 @@ reexecute:
 
             parser->flags |= F_CONTENTLENGTH;
             parser->content_length = ch - '0';
+            parser->header_state = h_content_length_num;
             break;
 
           case h_connection:
@@ -1493,10 +1533,18 @@ reexecute:
               break;
 
             case h_content_length:
+              if (ch == ' ') break;
+              h_state = h_content_length_num;
+              /* FALLTHROUGH */
+
+            case h_content_length_num:
             {
               uint64_t t;
 
-              if (ch == ' ') break;
+              if (ch == ' ') {
+                h_state = h_content_length_ws;
+                break;
+              }
 
               if (UNLIKELY(!IS_NUM(ch))) {
                 SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
@@ -1519,12 +1567,39 @@ reexecute:
               break;
             }
 
+            case h_content_length_ws:
+              if (ch == ' ') break;
+              SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              parser->header_state = h_state;
+              goto error;
+
+            /* Transfer-Encoding: gzip, chunked */
+            case h_matching_transfer_encoding_token_start:
+              if ('c' == c) {
+                h_state = h_matching_transfer_encoding_chunked;
+              } else if (c == ' ' || c == '\t') {
+                /* Skip lws */
+              } else {
+                h_state = h_matching_transfer_encoding_token;
+              }
+              break;
+
+            case h_matching_transfer_encoding_token:
+              if (ch == ',') {
+                h_state = h_matching_transfer_encoding_token_start;
+                parser->index = 0;
+              }
+              break;
+
             /* Transfer-Encoding: chunked */
             case h_matching_transfer_encoding_chunked:
               parser->index++;
               if (parser->index > sizeof(CHUNKED)-1
                   || c != CHUNKED[parser->index]) {
-                h_state = h_general;
+                h_state = ch == ','
+                  ? h_matching_transfer_encoding_token_start
+                  : h_matching_transfer_encoding_token;
+                parser->index = 0;
               } else if (parser->index == sizeof(CHUNKED)-2) {
                 h_state = h_transfer_encoding_chunked;
               }
@@ -1588,7 +1663,12 @@ reexecute:
               break;
 
             case h_transfer_encoding_chunked:
-              if (ch != ' ') h_state = h_general;
+              if (ch == ',') {
+                h_state = h_matching_transfer_encoding_token_start;
+                parser->index = 0;
+              } else if (ch != ' ' && ch != '\t') {
+                h_state = h_matching_transfer_encoding_token;
+              }
               break;
 
             case h_connection_keep_alive:
@@ -1638,6 +1718,12 @@ reexecute:
       case s_header_value_lws:
       {
         if (ch == ' ' || ch == '\t') {
+          /* A server has to reject obsolete line folding (RFC 7230 3.2.4) */
+          if (parser->type == HTTP_REQUEST && !lenient) {
+            SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+            goto error;
+          }
+
           UPDATE_STATE(s_header_value_start);
           REEXECUTE();
         }
@@ -1666,7 +1752,10 @@ reexecute:
 
       case s_header_value_discard_ws_almost_done:
       {
-        STRICT_CHECK(ch != LF);
+        if (UNLIKELY(ch != LF)) {
+          SET_ERRNO(HPE_LF_EXPECTED);
+          goto error;
+        }
         UPDATE_STATE(s_header_value_discard_lws);
         break;
       }
@@ -1674,10 +1763,26 @@ reexecute:
       case s_header_value_discard_lws:
       {
         if (ch == ' ' || ch == '\t') {
+          if (parser->type == HTTP_REQUEST && !lenient) {
+            /* report the empty value before rejecting the folded line */
+            if (parser->header_state == h_content_length) {
+              SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              goto error;
+            }
+            MARK(header_value);
+            CALLBACK_DATA_NOADVANCE(header_value);
+            SET_ERRNO(HPE_INVALID_HEADER_TOKEN);
+            goto error;
+          }
+
           UPDATE_STATE(s_header_value_discard_ws);
           break;
         } else {
           switch (parser->header_state) {
+            case h_content_length:
+              /* do not allow empty content length */
+              SET_ERRNO(HPE_INVALID_CONTENT_LENGTH);
+              goto error;
             case h_connection_keep_alive:
               parser->flags |= F_CONNECTION_KEEP_ALIVE;
               break;
@@ -1704,7 +1809,10 @@ reexecute:
 
       case s_headers_almost_done:
       {
-        STRICT_CHECK(ch != LF);
+        if (UNLIKELY(ch != LF)) {
+          SET_ERRNO(HPE_LF_EXPECTED);
+          goto error;
+        }
 
         if (parser->flags & F_TRAILING) {
           /* End of a chunked request */
@@ -1713,14 +1821,27 @@ reexecute:
           REEXECUTE();
         }
 
-        /* Cannot use chunked encoding and a content-length header together
-           per the HTTP specification. */
-        if ((parser->flags & F_CHUNKED) &&
+        /* Cannot use transfer-encoding and a content-length header together
+           per the HTTP specification (RFC 7230 3.3.3) */
+        if ((parser->extra_flags & (F_TRANSFER_ENCODING >> 8)) &&
             (parser->flags & F_CONTENTLENGTH)) {
           SET_ERRNO(HPE_UNEXPECTED_CONTENT_LENGTH);
           goto error;
         }
 
+        /* If a Transfer-Encoding header field is present in a request and the
+         * chunked transfer coding is not the final encoding, the message body
+         * length cannot be determined reliably; the server MUST respond with
+         * the 400 (Bad Request) status code and then close the connection
+         * (RFC 7230 3.3.3).
+         */
+        if ((parser->extra_flags & (F_TRANSFER_ENCODING >> 8)) &&
+            !(parser->flags & F_CHUNKED) && parser->type == HTTP_REQUEST &&
+            !lenient) {
+          SET_ERRNO(HPE_INVALID_TRANSFER_ENCODING);
+          goto error;
+        }
+
         UPDATE_STATE(s_headers_done);
 
         /* Set this here so that on_headers_complete() callbacks can see it */
@@ -1794,6 +1915,13 @@ reexecute:
         } else if (parser->flags & F_CHUNKED) {
           /* chunked encoding - ignore Content-Length header */
           UPDATE_STATE(s_chunk_size_start);
+        } else if (parser->extra_flags & (F_TRANSFER_ENCODING >> 8)) {
+          /* If a Transfer-Encoding header field is present in a response and
+           * the chunked transfer coding is not the final encoding, the message
+           * body length is determined by reading the connection until it is
+           * closed by the server (RFC 7230 3.3.3).
+           */
+          UPDATE_STATE(s_body_identity_eof);
         } else {
           if (parser->content_length == 0) {
             /* Content-Length header given but zero: Content-Length: 0\r\n */
@@ -1930,13 +2058,20 @@ reexecute:
           UPDATE_STATE(s_chunk_size_almost_done);
           break;
         }
+        if (UNLIKELY(ch == LF)) {
+          SET_ERRNO(HPE_INVALID_CHUNK_SIZE);
+          goto error;
+        }
         break;
       }
 
       case s_chunk_size_almost_done:
       {
         assert(parser->flags & F_CHUNKED);
-        STRICT_CHECK(ch != LF);
+        if (UNLIKELY(ch != LF)) {
+          SET_ERRNO(HPE_LF_EXPECTED);
+          goto error;
+        }
 
         parser->nread = 0;
 
@@ -1976,14 +2111,20 @@ reexecute:
       case s_chunk_data_almost_done:
         assert(parser->flags & F_CHUNKED);
         assert(parser->content_length == 0);
-        STRICT_CHECK(ch != CR);
         UPDATE_STATE(s_chunk_data_done);
         CALLBACK_DATA(body);
+        if (UNLIKELY(ch != CR)) {
+          SET_ERRNO(HPE_STRICT);
+          goto error;
+        }
         break;
 
       case s_chunk_data_done:
         assert(parser->flags & F_CHUNKED);
-        STRICT_CHECK(ch != LF);
+        if (UNLIKELY(ch != LF)) {
+          SET_ERRNO(HPE_LF_EXPECTED);
+          goto error;
+        }
         parser->nread = 0;
         UPDATE_STATE(s_chunk_size_start);
         CALLBACK_NOTIFY(chunk_complete);
@@ -1,15 +1,21 @@
 #include <iostream>
+#include <netinet/in.h> // sockaddr_in
+#include <sys/socket.h> // getsockname
+#include <unistd.h> // close, unlink
 #include "zwave/ZWaveNetwork.hpp"
 #include "enocean/EnOceanNetwork.hpp"
 #include "http/HttpChannel.hpp"
+#include "coap/CoapServer.hpp"
 #include "Gateway.hpp"
+#include "Handoff.hpp"
+#include "Webhook.hpp"
 #include "ptr.hpp"
 
 
 class MyZWaveNetwork : public ZWaveNetwork {
 public:
-	MyZWaveNetwork(asio::io_service &service, const std::string &device)
-		: ZWaveNetwork(service, device) {
+	MyZWaveNetwork(asio::io_service &service, const std::string &device, std::string const & state)
+		: ZWaveNetwork(service, device, state) {
 	}
 
 	void onError(error_code error) noexcept override {
@@ -30,7 +36,8 @@ public:
 
 class MyGateway : public Gateway {
 public:
-	MyGateway(asio::io_service & loop, ptr<ZWaveNetwork> network) : Gateway(loop, network) {
+	MyGateway(asio::io_service & loop, ptr<ZWaveNetwork> network, ptr<StateCache> cache, ptr<RateLimiter> limiter)
+			: Gateway(loop, network, cache, limiter) {
 	}
 	
 	void onError(error_code error) noexcept override {
@@ -41,12 +48,20 @@ public:
 // server that accepts connections and creates a MyGateway instance for every incoming connection
 class MyServer : public Server {
 public:
-	MyServer(asio::io_service & loop, const asio::ip::tcp::endpoint &endpoint, ptr<ZWaveNetwork> network)
-			: Server(loop, endpoint), network(network) {
+	MyServer(asio::io_service & loop, asio::generic::stream_protocol::endpoint const & endpoint,
+			ptr<ZWaveNetwork> network, ptr<StateCache> cache, ptr<RateLimiter> limiter, LoopPool * pool)
+			: Server(loop, endpoint, pool), network(network), cache(cache), limiter(limiter) {
+	}
+
+	MyServer(asio::io_service & loop, int socket, ptr<ZWaveNetwork> network, ptr<StateCache> cache,
+			ptr<RateLimiter> limiter, LoopPool * pool)
+			: Server(loop, socket, pool), network(network), cache(cache), limiter(limiter) {
 	}
 	
 	ptr<Channel> createChannel(asio::io_service & loop) noexcept override {
-		return new MyGateway(loop, this->network);
+		ptr<MyGateway> gateway = new MyGateway(loop, this->network, this->cache, this->limiter);
+		gateway->files = this->files;
+		return gateway;
 	}
 
 	virtual void onError(error_code error) noexcept override {
@@ -54,30 +69,344 @@ public:
 	}
 	
 	ptr<ZWaveNetwork> network;
+	ptr<StateCache> cache;
+	ptr<RateLimiter> limiter;
+	ptr<StaticFiles> files;
+};
+
+// CoAP server for constrained clients
+class MyCoapServer : public CoapServer {
+public:
+	MyCoapServer(asio::io_service & loop, asio::ip::udp::endpoint const & endpoint, ptr<ZWaveNetwork> network,
+			ptr<StateCache> cache, ptr<RateLimiter> limiter)
+			: CoapServer(loop, endpoint, network, cache, limiter) {
+	}
+
+	MyCoapServer(asio::io_service & loop, int socket, ptr<ZWaveNetwork> network, ptr<StateCache> cache,
+			ptr<RateLimiter> limiter)
+			: CoapServer(loop, socket, network, cache, limiter) {
+	}
+
+	void onError(error_code error) noexcept override {
+		std::cout << "CoapServer::onError " << error.category().name() << ":" << error.message() << std::endl;
+	}
+};
+
+// hands the listening sockets and the state of the nodes over to a new process
+class MyHandoff : public Handoff {
+public:
+	MyHandoff(asio::io_service & loop, std::string const & path)
+			: Handoff(loop, path), drainTimer(loop) {
+	}
+
+	void onHandoff(std::vector<int> & sockets, std::string & state) override {
+		for (ptr<Server> & server : this->servers) {
+			sockets.push_back(server->getSocket());
+		}
+		if (this->coapServer)
+			sockets.push_back(this->coapServer->getSocket());
+		this->network->save(state);
+	}
+
+	void onHandedOver() override {
+		std::cout << "Handed over to new process, draining connections" << std::endl;
+		
+		// stop accepting connections and release the serial port, long-poll requests, event streams and WebSockets
+		// get finished so that the clients reconnect to the new process
+		for (ptr<Server> & server : this->servers) {
+			server->close();
+		}
+		
+		// CoAP observers get 5.03 so that they register again at the new process
+		if (this->coapServer)
+			this->coapServer->close();
+		this->network->close();
+		
+		// let in-flight requests complete, then exit
+		this->drainStart = std::chrono::steady_clock::now();
+		drain();
+	}
+
+	// close idle connections and exit when all connections are closed or the drain time is over
+	void drain() {
+		int count = 0;
+		for (ptr<Server> & server : this->servers) {
+			server->closeIdle();
+			count += server->getConnectionCount();
+		}
+		if (count == 0 || std::chrono::steady_clock::now() - this->drainStart
+				>= std::chrono::milliseconds(DRAIN_TIME)) {
+			this->network->loop.stop();
+			return;
+		}
+		
+		// connections that are still busy close after their response, check again later
+		this->drainTimer.expires_from_now(std::chrono::milliseconds(DRAIN_INTERVAL));
+		this->drainTimer.async_wait([this] (error_code error) {
+			if (error == asio::error::operation_aborted)
+				return;
+			drain();
+		});
+	}
+
+	void onError(error_code error) noexcept override {
+		std::cout << "Handoff::onError " << error.category().name() << ":" << error.message() << std::endl;
+	}
+
+	// maximum time in milliseconds for draining in-flight requests after the handoff and interval for checking if
+	// all connections are closed
+	enum {DRAIN_TIME = 5000, DRAIN_INTERVAL = 100};
+
+	ptr<ZWaveNetwork> network;
+	std::vector<ptr<Server>> servers;
+	ptr<CoapServer> coapServer;
+	asio::steady_timer drainTimer;
+	std::chrono::steady_clock::time_point drainStart;
 };
 
+// get the port of a listening socket, 0 for a unix domain socket
+static int getPort(int socket) {
+	sockaddr_storage address = {};
+	socklen_t length = sizeof(address);
+	::getsockname(socket, (sockaddr *)&address, &length);
+	if (address.ss_family == AF_INET)
+		return ntohs(((sockaddr_in *)&address)->sin_port);
+	if (address.ss_family == AF_INET6)
+		return ntohs(((sockaddr_in6 *)&address)->sin6_port);
+	return address.ss_family == AF_UNIX ? 0 : -1;
+}
+
+// check if a socket is a datagram socket, e.g. of the CoAP server
+static bool isDatagram(int socket) {
+	int type = 0;
+	socklen_t length = sizeof(type);
+	::getsockopt(socket, SOL_SOCKET, SO_TYPE, &type, &length);
+	return type == SOCK_DGRAM;
+}
+
+// commands per second and burst size for each client
+static double const COMMAND_RATE = 5.0;
+static int const COMMAND_BURST = 20;
+
 int main(int argc, char ** argv) {
-	if (argc < 2) {
+	char const * device = nullptr;
+	int port = 8080;
+	int threadCount = 0;
+	char const * unixPath = nullptr;
+	char const * handoffPath = nullptr;
+	int maxConnections = 0;
+	std::vector<std::string> webhookUrls;
+	int httpsPort = 0;
+#ifdef WITH_TLS
+	char const * certificate = nullptr;
+	char const * privateKey = nullptr;
+#endif
+	char const * staticPath = nullptr;
+	int coapPort = 0;
+	int positional = 0;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+			threadCount = atoi(argv[++i]);
+		} else if ((arg == "-u" || arg == "--unix") && i + 1 < argc) {
+			unixPath = argv[++i];
+		} else if ((arg == "-c" || arg == "--connections") && i + 1 < argc) {
+			maxConnections = atoi(argv[++i]);
+		} else if ((arg == "-r" || arg == "--handoff") && i + 1 < argc) {
+			handoffPath = argv[++i];
+		} else if ((arg == "-w" || arg == "--webhook") && i + 1 < argc) {
+			webhookUrls.push_back(argv[++i]);
+		} else if ((arg == "-s" || arg == "--https") && i + 1 < argc) {
+			httpsPort = atoi(argv[++i]);
+#ifdef WITH_TLS
+		} else if (arg == "--cert" && i + 1 < argc) {
+			certificate = argv[++i];
+		} else if (arg == "--key" && i + 1 < argc) {
+			privateKey = argv[++i];
+#else
+		} else if ((arg == "--cert" || arg == "--key") && i + 1 < argc) {
+			// not supported, --https reports the error
+			++i;
+#endif
+		} else if ((arg == "-d" || arg == "--static") && i + 1 < argc) {
+			staticPath = argv[++i];
+		} else if ((arg == "-o" || arg == "--coap") && i + 1 < argc) {
+			coapPort = atoi(argv[++i]);
+		} else if (positional == 0) {
+			device = argv[i];
+			++positional;
+		} else if (positional == 1) {
+			port = atoi(argv[i]);
+			++positional;
+		}
+	}
+	if (device == nullptr) {
 		std::cout << "HTTP to ZWave gateway" << std::endl;
-		std::cout << "usage: huasi zwave_serial_device [http_server_port]" << std::endl;
+		std::cout << "usage: huasi zwave_serial_device [http_server_port] [options]" << std::endl;
+		std::cout << "  -t, --threads count  number of worker threads for http connections (default: 0)" << std::endl;
+		std::cout << "  -u, --unix path      also listen on a unix domain socket" << std::endl;
+		std::cout << "  -c, --connections n  maximum number of connections, idle ones get closed first" << std::endl;
+		std::cout << "  -r, --handoff path   take over from a running process and hand over to the next one" << std::endl;
+		std::cout << "  -w, --webhook url    post changes of the nodes to the url (can be repeated)" << std::endl;
+		std::cout << "  -d, --static dir     serve static files from the directory (e.g. a web UI)" << std::endl;
+		std::cout << "  -o, --coap port      also listen for CoAP requests on the udp port (e.g. 5683)" << std::endl;
+#ifdef WITH_TLS
+		std::cout << "  -s, --https port     also listen for https connections, requires --cert" << std::endl;
+		std::cout << "  --cert file          PEM file with the certificate chain for https" << std::endl;
+		std::cout << "  --key file           PEM file with the private key for https (default: the --cert file)"
+			<< std::endl;
+#endif
+		return 1;
+	}
+#ifdef WITH_TLS
+	if (httpsPort != 0 && certificate == nullptr) {
+		std::cout << "--https requires --cert" << std::endl;
 		return 1;
 	}
-	char const * device = argv[1];
-	int port = argc <= 2 ? 8080 : atoi(argv[2]);
+#else
+	if (httpsPort != 0) {
+		std::cout << "--https is not supported, built without TLS" << std::endl;
+		return 1;
+	}
+#endif
 	
 	// event loop
 	asio::io_service loop;
 	
-	// ZWave network
-	ptr<ZWaveNetwork> network = new MyZWaveNetwork(loop, device);
+	// worker event loops for http connections
+	LoopPool pool(threadCount);
+	
+	// take over listening sockets and state of the nodes from a running process
+	ptr<MyHandoff> handoff;
+	std::vector<int> sockets;
+	std::string state;
+	if (handoffPath != nullptr) {
+		handoff = new MyHandoff(loop, handoffPath);
+		if (handoff->receive(sockets, state))
+			std::cout << "Took over " << sockets.size() << " sockets from running process" << std::endl;
+	}
+	
+	// assign the sockets that were taken over by their address, sockets that are not used any more are closed
+	int tcpSocket = -1;
+	int unixSocket = -1;
+	int httpsSocket = -1;
+	int coapSocket = -1;
+	for (int socket : sockets) {
+		int p = getPort(socket);
+		if (isDatagram(socket)) {
+			if (coapPort != 0 && p == coapPort && coapSocket == -1)
+				coapSocket = socket;
+			else
+				::close(socket);
+		} else if (p == 0 && unixPath != nullptr && unixSocket == -1)
+			unixSocket = socket;
+		else if (p == port && tcpSocket == -1)
+			tcpSocket = socket;
+		else if (httpsPort != 0 && p == httpsPort && httpsSocket == -1)
+			httpsSocket = socket;
+		else
+			::close(socket);
+	}
+
+	// ZWave network, the serial port is free after the running process has handed over
+	ptr<ZWaveNetwork> network = new MyZWaveNetwork(loop, device, state);
 
 	// EnOcean network
 	//ptr<EnOceanNetwork> network = new MyEnOceanNetwork(loop, device);
 
+	// state of all nodes, shared by all servers
+	ptr<StateCache> cache = new StateCache(network);
+
+	// rate limit for commands of each client, shared by all servers
+	ptr<RateLimiter> limiter = new RateLimiter(COMMAND_RATE, COMMAND_BURST);
+
+	// optional static files, shared by all servers
+	ptr<StaticFiles> files;
+	if (staticPath != nullptr)
+		files = new StaticFiles(staticPath);
+
+	// webhooks that receive the changes of the nodes, on the worker event loops if available
+	std::vector<ptr<Webhook>> webhooks;
+	for (std::string const & url : webhookUrls) {
+		try {
+			webhooks.push_back(new Webhook(threadCount > 0 ? pool.next() : loop, network, url));
+		} catch (std::exception const & e) {
+			std::cout << "Webhook: " << e.what() << std::endl;
+			return 1;
+		}
+	}
+
 	// http server
-	ptr<MyServer> server = new MyServer(loop, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port), network);
+	LoopPool * p = threadCount > 0 ? &pool : nullptr;
+	ptr<MyServer> server = tcpSocket != -1
+			? new MyServer(loop, tcpSocket, network, cache, limiter, p)
+			: new MyServer(loop, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port), network, cache, limiter, p);
+	server->files = files;
+	server->setMaxConnections(maxConnections);
 	server->listen();
+	
+	// optional http server on a unix domain socket for local clients
+	ptr<MyServer> unixServer;
+	if (unixPath != nullptr) {
+		if (unixSocket != -1) {
+			unixServer = new MyServer(loop, unixSocket, network, cache, limiter, p);
+		} else {
+			// remove socket of a previous run
+			::unlink(unixPath);
+			unixServer = new MyServer(loop, asio::local::stream_protocol::endpoint(unixPath), network, cache, limiter,
+					p);
+		}
+		unixServer->files = files;
+		unixServer->setMaxConnections(maxConnections);
+		unixServer->listen();
+	}
+
+	// optional https server
+	ptr<MyServer> httpsServer;
+#ifdef WITH_TLS
+	if (httpsPort != 0) {
+		ptr<TlsContext> tls;
+		try {
+			tls = new TlsContext(certificate, privateKey != nullptr ? privateKey : certificate);
+		} catch (std::exception const & e) {
+			std::cout << "TLS: " << e.what() << std::endl;
+			return 1;
+		}
+		httpsServer = httpsSocket != -1
+				? new MyServer(loop, httpsSocket, network, cache, limiter, p)
+				: new MyServer(loop, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), httpsPort), network, cache,
+					limiter, p);
+		httpsServer->setTls(tls);
+		httpsServer->files = files;
+		httpsServer->setMaxConnections(maxConnections);
+		httpsServer->listen();
+	}
+#endif
+
+	// optional CoAP server, on the event loop of the network
+	ptr<MyCoapServer> coapServer;
+	if (coapPort != 0) {
+		coapServer = coapSocket != -1
+				? new MyCoapServer(loop, coapSocket, network, cache, limiter)
+				: new MyCoapServer(loop, asio::ip::udp::endpoint(asio::ip::udp::v4(), coapPort), network, cache,
+					limiter);
+		coapServer->start();
+	}
+	
+	// wait for the next process to take over
+	if (handoff) {
+		handoff->network = network;
+		handoff->servers.push_back(server);
+		if (unixServer)
+			handoff->servers.push_back(unixServer);
+		if (httpsServer)
+			handoff->servers.push_back(httpsServer);
+		handoff->coapServer = coapServer;
+		handoff->listen();
+	}
 
-	// run event loop
+	// run event loops
+	pool.run();
 	loop.run();
+	pool.stop();
 }
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstring>
+#include <string>
+
+
+///
+/// Non-owning view of a string, the viewed characters have to stay valid while the view is in use
+class string_view {
+public:
+	static constexpr size_t npos = size_t(-1);
+
+	string_view() : d(nullptr), n(0) {}
+	string_view(char const * data, size_t length) : d(data), n(length) {}
+	string_view(char const * s) : d(s), n(strlen(s)) {}
+	string_view(std::string const & s) : d(s.data()), n(s.length()) {}
+
+	char const * data() const {return this->d;}
+	size_t size() const {return this->n;}
+	size_t length() const {return this->n;}
+	bool empty() const {return this->n == 0;}
+
+	char const * begin() const {return this->d;}
+	char const * end() const {return this->d + this->n;}
+	char operator [](size_t index) const {return this->d[index];}
+
+	string_view substr(size_t pos, size_t count = npos) const {
+		if (pos > this->n)
+			pos = this->n;
+		return string_view(this->d + pos, count < this->n - pos ? count : this->n - pos);
+	}
+
+	size_t find(char ch, size_t pos = 0) const {
+		for (size_t i = pos; i < this->n; ++i) {
+			if (this->d[i] == ch)
+				return i;
+		}
+		return npos;
+	}
+
+	int compare(string_view s) const {
+		// an empty view may have no data, memcmp() must not get a null pointer even for length 0
+		size_t n = this->n < s.n ? this->n : s.n;
+		int r = n > 0 ? memcmp(this->d, s.d, n) : 0;
+		return r != 0 ? r : (this->n < s.n ? -1 : (this->n > s.n ? 1 : 0));
+	}
+
+	std::string str() const {return std::string(this->d, this->n);}
+
+protected:
+	char const * d;
+	size_t n;
+};
+
+inline bool operator ==(string_view a, string_view b) {
+	return a.length() == b.length() && (a.length() == 0 || memcmp(a.data(), b.data(), a.length()) == 0);
+}
+inline bool operator !=(string_view a, string_view b) {return !(a == b);}
+inline bool operator <(string_view a, string_view b) {return a.compare(b) < 0;}
@@ -39,14 +39,30 @@ void FibaroFgr222::get(Parameters & parameters) {
 	parameters.setByte("position.slat", this->slat);
 }
 
+bool FibaroFgr222::restore(Parameters const & parameters) {
+	optional<uint8_t> blinds = parameters.getByte("position.blinds");
+	optional<uint8_t> slat = parameters.getByte("position.slat");
+	if (!blinds || !slat)
+		return false;
+	this->blinds = *blinds;
+	this->slat = *slat;
+	return true;
+}
+
 void FibaroFgr222::onCommand(ZWaveNetwork::Node & node, uint8_t const * data, int length, Sender & sender) {
 	// data = MANUFACTURER_PROPRIETARY 01 0f 26 03 flags blinds slat
 	if (length >= 8) {
 		uint8_t flags = data[5];
-		if (flags & 2)
+		Parameters changed;
+		if ((flags & 2) && data[6] != this->blinds) {
 			this->blinds = data[6];
-		if (flags & 1)
+			changed.setByte("position.blinds", this->blinds);
+		}
+		if ((flags & 1) && data[7] != this->slat) {
 			this->slat = data[7];
+			changed.setByte("position.slat", this->slat);
+		}
+		sender.changed(changed);
 		#ifdef DEBUG_NETWORK
 		std::cout << "Node " << node.toString() << ": blinds=" << int(this->blinds) << " slat=" << int(this->slat) << std::endl;
 		#endif
@@ -64,7 +80,12 @@ void FibaroFgr222Config::sendSet(Sender & sender, Parameters const & parameters)
 	
 	if (optional<uint16_t> slatTime = parameters.getWord("config.slatTime")) {
 		// device does not report the new value, therefore set it directly
-		this->slatTime = *slatTime;
+		if (*slatTime != this->slatTime) {
+			this->slatTime = *slatTime;
+			Parameters changed;
+			get(changed);
+			sender.changed(changed);
+		}
 		sendWord(sender, SLAT_TIME, *slatTime);
 	} else if (parameters.contains("config.calibrate")) {
 		sendByte(sender, CALIBRATE, 1);
@@ -80,16 +101,29 @@ void FibaroFgr222Config::get(Parameters & parameters) {
 	parameters.setWord("config.slatTime", this->slatTime);
 }
 
+bool FibaroFgr222Config::restore(Parameters const & parameters) {
+	optional<uint16_t> slatTime = parameters.getWord("config.slatTime");
+	if (!slatTime)
+		return false;
+	this->slatTime = *slatTime;
+	return true;
+}
+
 void FibaroFgr222Config::onByte(ZWaveNetwork::Node & node, uint8_t index, uint8_t value, Sender & sender) {
 }
 
 void FibaroFgr222Config::onWord(ZWaveNetwork::Node & node, uint8_t index, uint16_t value, Sender & sender) {
 	switch (index) {
 	case SLAT_TIME:
-		this->slatTime = value;
 		#ifdef DEBUG_NETWORK
 		std::cout << "Node " << node.toString() << ": slatTime=" << int(value) << std::endl;
 		#endif
+		if (value != this->slatTime) {
+			this->slatTime = value;
+			Parameters changed;
+			get(changed);
+			sender.changed(changed);
+		}
 		break;
 	}
 }
@@ -13,6 +13,7 @@ public:
 	void sendSet(Sender & sender, Parameters const & parameters) override;
 	void sendGet(Sender & sender) override;
 	void get(Parameters & parameters) override;
+	bool restore(Parameters const & parameters) override;
 
 protected:
 	void onCommand(ZWaveNetwork::Node & node, uint8_t const * data, int length, Sender & sender) override;
@@ -32,6 +33,7 @@ public:
 	void sendSet(Sender & sender, Parameters const & parameters) override;
 	void sendGet(Sender & sender) override;
 	void get(Parameters & parameters) override;
+	bool restore(Parameters const & parameters) override;
 
 protected:
 
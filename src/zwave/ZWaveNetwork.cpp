@@ -2,6 +2,7 @@
 #include <iomanip>
 #include "ZWaveNetwork.hpp"
 #include "FibaroFgr222.hpp"
+#include "../http/Query.hpp"
 
 
 // DiscoverNodesRequest
@@ -140,6 +141,10 @@ void ZWaveNetwork::SendCommandRequest::add(uint8_t const * command, int length)
 ZWaveNetwork::Command::~Command() {
 }
 
+bool ZWaveNetwork::Command::restore(Parameters const & parameters) {
+	return true;
+}
+
 
 // BasicCommand
 
@@ -168,11 +173,27 @@ void ZWaveNetwork::BasicCommand::get(Parameters & parameters) {
 		parameters.setByte("dim", this->value);
 }
 
+bool ZWaveNetwork::BasicCommand::restore(Parameters const & parameters) {
+	if (optional<bool> state = parameters.getState("state"))
+		this->value = *state ? 0xff : 0x00;
+	else if (optional<uint8_t> dim = parameters.getByte("dim"))
+		this->value = *dim;
+	else
+		return false;
+	return true;
+}
+
 void ZWaveNetwork::BasicCommand::onCommand(Node & node, uint8_t const * data, int length, Sender & sender) {
 	// data = BASIC REPORT value
 	if (length >= 3 && data[1] == REPORT) {
-		this->value = data[2];
-		std::cout << "BasicCommand::onCommand value: " << int(this->value) << std::endl;
+		uint8_t value = data[2];
+		std::cout << "BasicCommand::onCommand value: " << int(value) << std::endl;
+		if (value != this->value) {
+			this->value = value;
+			Parameters changed;
+			get(changed);
+			sender.changed(changed);
+		}
 	}
 }
 
@@ -263,6 +284,29 @@ void ZWaveNetwork::ManufacturerSpecificCommand::get(Parameters & parameters) {
 	parameters.setWord("device.id", this->id);
 }
 
+bool ZWaveNetwork::ManufacturerSpecificCommand::restore(Parameters const & parameters) {
+	optional<uint16_t> manufacturer = parameters.getWord("device.manufacturer");
+	optional<uint16_t> product = parameters.getWord("device.product");
+	optional<uint16_t> id = parameters.getWord("device.id");
+	if (!manufacturer || !product || !id)
+		return false;
+	this->manufacturer = *manufacturer;
+	this->product = *product;
+	this->id = *id;
+	return true;
+}
+
+void ZWaveNetwork::ManufacturerSpecificCommand::getDeviceCommands(Node & node,
+		std::map<Class, ptr<ZWaveNetwork::Command>> & commands) {
+	// check for specific devices
+	if (this->manufacturer == 271 && this->product == 770) {
+		// Fibaro FGR-222
+		node.deviceName = "Fibaro FGR-222";
+		commands[CONFIGURATION] = new FibaroFgr222Config();
+		commands[MANUFACTURER_PROPRIETARY] = new FibaroFgr222();
+	}
+}
+
 void ZWaveNetwork::ManufacturerSpecificCommand::onCommand(Node & node, uint8_t const * data, int length,
 		Sender & sender) {
 	// data = MANUFACTURER_SPECIFIC REPORT manufacturer[2] product[2] id[2]
@@ -270,20 +314,18 @@ void ZWaveNetwork::ManufacturerSpecificCommand::onCommand(Node & node, uint8_t c
 		this->manufacturer = (data[2] << 8) | data[3];
 		this->product = (data[4] << 8) | data[5];
 		this->id = (data[6] << 8) | data[7];
+		Parameters changed;
+		get(changed);
 		
 		std::map<Class, ptr<ZWaveNetwork::Command>> commands;
-		
-		// check for specific devices
-		if (this->manufacturer == 271 && this->product == 770) {
-			// Fibaro FGR-222
-			node.deviceName = "Fibaro FGR-222";
-			commands[CONFIGURATION] = new FibaroFgr222Config();
-			commands[MANUFACTURER_PROPRIETARY] = new FibaroFgr222();
-		}
+		getDeviceCommands(node, commands);
 		#ifdef DEBUG_NETWORK
 		if (!node.deviceName.empty())
 			std::cout << "Node " << node.name << ": " << node.deviceName << std::endl;
 		#endif
+		if (!node.deviceName.empty())
+			changed.parameters["device.name"] = node.deviceName;
+		sender.changed(changed);
 
 		// get current state for new commands
 		for (std::pair<Class, ptr<ZWaveNetwork::Command>> p : commands) {
@@ -296,10 +338,15 @@ void ZWaveNetwork::ManufacturerSpecificCommand::onCommand(Node & node, uint8_t c
 
 // ZWaveNetwork
 
-ZWaveNetwork::ZWaveNetwork(asio::io_service & service, std::string const & device)
+ZWaveNetwork::ZWaveNetwork(asio::io_service & service, std::string const & device, std::string const & state)
 		: ZWaveProtocol(service, device) {
-	// get list of nodes in the network
-	sendRequest(new DiscoverNodesRequest());
+	if (!state.empty()) {
+		// continue with the nodes of the previous process
+		restore(state);
+	} else {
+		// get list of nodes in the network
+		sendRequest(new DiscoverNodesRequest());
+	}
 }
 
 ZWaveNetwork::~ZWaveNetwork() {
@@ -336,6 +383,101 @@ bool ZWaveNetwork::get(uint32_t nodeId, Parameters & parameters) {
 	return false;
 }
 
+void ZWaveNetwork::getNodeIds(std::vector<uint32_t> & nodeIds) {
+	for (uint32_t nodeId = 0; nodeId < 256; ++nodeId) {
+		if (!this->nodes[nodeId].commands.empty())
+			nodeIds.push_back(nodeId);
+	}
+}
+
+void ZWaveNetwork::save(std::string & state) {
+	for (uint32_t nodeId = 0; nodeId < 256; ++nodeId) {
+		Node & node = this->nodes[nodeId];
+		if (node.commands.empty())
+			continue;
+		
+		// command classes and tracked parameters of the node
+		Parameters parameters;
+		std::string classes;
+		for (std::pair<Command::Class, ptr<Command>> p : node.commands) {
+			if (!classes.empty())
+				classes += ',';
+			append(classes, int(p.first));
+			p.second->get(parameters);
+		}
+		parameters.parameters["classes"] = classes;
+		
+		state += "node=";
+		append(state, nodeId);
+		encodeParameters(state, parameters);
+		state += '\n';
+	}
+}
+
+void ZWaveNetwork::restore(std::string const & state) {
+	size_t start = 0;
+	while (start < state.length()) {
+		size_t end = state.find('\n', start);
+		if (end == std::string::npos)
+			end = state.length();
+		Parameters parameters;
+		parseQuery(string_view(state).substr(start, end - start), parameters);
+		start = end + 1;
+		optional<uint16_t> nodeId = parameters.getWord("node");
+		if (!nodeId || *nodeId >= 256)
+			continue;
+		Node & node = this->nodes[*nodeId];
+		node.name = cast<std::string>(*nodeId);
+		
+		// create the commands of the reported command classes
+		string_view classes = parameters.parameters["classes"];
+		size_t i = 0;
+		while (i < classes.length()) {
+			size_t j = classes.find(',', i);
+			if (j == string_view::npos)
+				j = classes.length();
+			optional<uint8_t> commandClass = cast<uint8_t>(classes.substr(i, j - i));
+			if (commandClass) {
+				if (ptr<Command> command = createCommand(*commandClass))
+					node.commands[Command::Class(*commandClass)] = command;
+			}
+			i = j + 1;
+		}
+		
+		// create the device specific commands, an unknown device gets them when it reports its model
+		auto it = node.commands.find(Command::MANUFACTURER_SPECIFIC);
+		if (it != node.commands.end()) {
+			ptr<ManufacturerSpecificCommand> manufacturerSpecific = cast<ManufacturerSpecificCommand>(it->second);
+			if (manufacturerSpecific->restore(parameters)) {
+				std::map<Command::Class, ptr<Command>> commands;
+				manufacturerSpecific->getDeviceCommands(node, commands);
+				for (std::pair<Command::Class, ptr<Command>> p : commands) {
+					node.commands[p.first] = p.second;
+				}
+			}
+		}
+		
+		// restore the tracked parameters without asking the nodes, ask only for parameters missing in the state
+		Command::Sender sender(this, *nodeId);
+		for (std::pair<Command::Class, ptr<Command>> p : node.commands) {
+			if (!p.second->restore(parameters))
+				p.second->sendGet(sender);
+		}
+	}
+}
+
+ptr<ZWaveNetwork::Command> ZWaveNetwork::createCommand(uint8_t commandClass) {
+	switch (commandClass) {
+	case Command::BASIC:
+		return new BasicCommand();
+	case Command::CONFIGURATION:
+		return new ConfigCommand();
+	case Command::MANUFACTURER_SPECIFIC:
+		return new ManufacturerSpecificCommand();
+	}
+	return nullptr;
+}
+
 void ZWaveNetwork::onRequest(uint8_t const * data, int length) {
 	// check if at least result and nodeId are present
 	if (length >= 3) {
@@ -364,7 +506,7 @@ void ZWaveNetwork::onRequest(uint8_t const * data, int length) {
 					if (data[end] == Command::MARK)
 						break;
 				}
-				updateNode(nodeId, generic, data, end - 7);
+				updateNode(nodeId, generic, data + 7, end - 7);
 			}
 		}
 	}
@@ -391,17 +533,8 @@ void ZWaveNetwork::updateNode(uint8_t nodeId, uint8_t generic, uint8_t const * c
 	std::cout << std::endl;
 
 	for (int i = 0; i < classCount; ++i) {
-		switch (classes[i]) {
-		case Command::BASIC:
-			node.commands[Command::BASIC] = new BasicCommand();
-			break;
-		case Command::CONFIGURATION:
-			node.commands[Command::CONFIGURATION] = new ConfigCommand();
-			break;
-		case Command::MANUFACTURER_SPECIFIC:
-			node.commands[Command::MANUFACTURER_SPECIFIC] = new ManufacturerSpecificCommand();
-			break;
-		}
+		if (ptr<Command> command = createCommand(classes[i]))
+			node.commands[Command::Class(classes[i])] = command;
 	}
 
 	// get current state
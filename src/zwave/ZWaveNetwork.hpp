@@ -141,6 +141,12 @@ public:
 			void send(T (&data)[L]) {
 				this->protocol->sendRequest(new SendDataRequest(this->nodeId, data));
 			}
+			
+			///
+			/// Notify that tracked parameters of the node have changed
+			void changed(Parameters const & parameters) {
+				this->protocol->notifyChanged(this->nodeId, parameters);
+			}
 		protected:
 			ZWaveProtocol * protocol;
 			uint8_t nodeId;
@@ -160,6 +166,13 @@ public:
 		/// Get tracked parameters of node (stored in this object)
 		virtual void get(Parameters & parameters) = 0;
 
+		///
+		/// Restore tracked parameters that were obtained with get(), e.g. when the state of the network is handed over
+		/// from another process. default implementation does nothing
+		/// @return false if a parameter is missing, e.g. in the state of another version, then the field stays unknown
+		/// and the node gets asked with sendGet()
+		virtual bool restore(Parameters const & parameters);
+
 	protected:
 
 		///
@@ -183,6 +196,7 @@ public:
 		void sendSet(Sender & sender, Parameters const & parameters) override;
 		void sendGet(Sender & sender) override;
 		void get(Parameters & parameters) override;
+		bool restore(Parameters const & parameters) override;
 
 	protected:
 		void onCommand(Node & node, uint8_t const * data, int length, Sender & sender) override;
@@ -233,6 +247,11 @@ public:
 		void sendSet(Sender & sender, Parameters const & parameters) override;
 		void sendGet(Sender & sender) override;
 		void get(Parameters & parameters) override;
+		bool restore(Parameters const & parameters) override;
+
+		///
+		/// Set the device name of the node and create the commands that are specific to the device
+		void getDeviceCommands(Node & node, std::map<Class, ptr<ZWaveNetwork::Command>> & commands);
 
 	protected:
 		void onCommand(Node & node, uint8_t const * data, int length, Sender & sender) override;
@@ -282,7 +301,8 @@ public:
 	/// Constructor
 	/// @param loop event loop for asynchronous io
 	/// @param device serial device of the zwave dongle
-	ZWaveNetwork(asio::io_service & service, std::string const & device);
+	/// @param state state of the nodes that was saved by a previous process, the nodes are discovered if empty
+	ZWaveNetwork(asio::io_service & service, std::string const & device, std::string const & state = std::string());
 
 	~ZWaveNetwork() override;
 
@@ -299,12 +319,30 @@ public:
 	/// @param parameters parameters to get
 	/// @return true if node exists in the ZWave network
 	bool get(uint32_t nodeId, Parameters &parameters) override;
+
+	///
+	/// get ids of all nodes in the network
+	/// @param nodeIds ids of nodes in ascending order
+	void getNodeIds(std::vector<uint32_t> & nodeIds) override;
+
+	///
+	/// save the state of all nodes (command classes and tracked parameters), one line per node
+	/// ("node=4&classes=32,112,114&position.blinds=50"), e.g. for handing the network over to a new process
+	void save(std::string & state);
 	
 protected:
 
 	void onRequest(uint8_t const * data, int length) override;
 
 	void updateNode(uint8_t nodeId, uint8_t generic, uint8_t const * classes, int classCount);
+
+	///
+	/// restore the state of all nodes that was saved with save()
+	void restore(std::string const & state);
+
+	///
+	/// create a command for a command class that was reported by a node, returns null for unsupported classes
+	static ptr<Command> createCommand(uint8_t commandClass);
 	
 
 	Node nodes[256];
@@ -88,7 +88,7 @@ ZWaveProtocol::Request::~Request() {
 // ZWaveProtocol
 
 ZWaveProtocol::ZWaveProtocol(asio::io_service &loop, const std::string &device)
-	: tty(loop), txTimer(loop)
+	: Network(loop), tty(loop), txTimer(loop)
 {
 	this->tty.open(device);
 	
@@ -107,6 +107,9 @@ ZWaveProtocol::~ZWaveProtocol() {
 }
 
 void ZWaveProtocol::sendRequest(ptr<Request> request) {
+	// drop requests after the serial port was closed
+	if (!this->tty.is_open())
+		return;
 	this->requests.push_back(request);
 	if (this->requests.size() == 1) {
 		// sent request immediately if request queue was empty
@@ -114,12 +117,29 @@ void ZWaveProtocol::sendRequest(ptr<Request> request) {
 	}
 }
 
+void ZWaveProtocol::close() {
+	if (this->tty.is_open()) {
+		// close serial port (also cancels pending read/write requests)
+		error_code error;
+		this->tty.close(error);
+		this->txTimer.cancel();
+		this->requests.clear();
+		this->txRetryCount = 0;
+		this->rxPosition = 0;
+		if (error)
+			onError(error);
+		
+		notifyClose();
+	}
+}
+
 void ZWaveProtocol::receive() {
 	this->tty.async_read_some(
 			asio::buffer(this->rxBuffer + this->rxPosition, sizeof(this->rxBuffer) - this->rxPosition),
-			[this] (error_code error, size_t readCount) {
+			makeHandler(this->handlerMemory, [this] (error_code error, size_t readCount) {
 				if (error) {
-					onError(error);
+					if (error != asio::error::operation_aborted)
+						onError(error);
 					return;
 				}
 				this->rxPosition += readCount;
@@ -261,7 +281,7 @@ void ZWaveProtocol::receive() {
 		
 				// continue receiving
 				receive();
-			});
+			}));
 }
 
 void ZWaveProtocol::sendRequest() {
@@ -282,12 +302,12 @@ void ZWaveProtocol::sendRequest() {
 	
 	// start timeout timer
 	this->txTimer.expires_from_now(std::chrono::milliseconds(RESPONSE_TIMEOUT));
-	this->txTimer.async_wait([this] (error_code error) {
+	this->txTimer.async_wait(makeHandler(this->handlerMemory, [this] (error_code error) {
 		if (!error) {
 			// timer expired before response (ACK or NACK) was received
 			resendRequest(2);
 		}
-	});
+	}));
 	
 	// send request
 	#ifdef DEBUG_PROTOCOL
@@ -297,13 +317,13 @@ void ZWaveProtocol::sendRequest() {
 	asio::async_write(
 			this->tty,
 			asio::buffer(this->txBuffer, length + 1),
-			[this] (error_code error, size_t writtenCount) {
+			makeHandler(this->handlerMemory, [this] (error_code error, size_t writtenCount) {
 				if (error) {
 					onError(error);
 				} else {
 					// wait for response (ACK or NACK) or timeout
 				}
-			});
+			}));
 }
 
 void ZWaveProtocol::resendRequest(int error) {
@@ -331,11 +351,11 @@ void ZWaveProtocol::sendAck() {
 	asio::async_write(
 			this->tty,
 			asio::buffer(data),
-			[this] (error_code error, size_t writtenCount) {
+			makeHandler(this->handlerMemory, [this] (error_code error, size_t writtenCount) {
 				if (error) {
 					onError(error);
 				}
-			});
+			}));
 }
 
 void ZWaveProtocol::sendNack() {
@@ -346,11 +366,11 @@ void ZWaveProtocol::sendNack() {
 	asio::async_write(
 			this->tty,
 			asio::buffer(data),
-			[this] (error_code error, size_t writtenCount) {
+			makeHandler(this->handlerMemory, [this] (error_code error, size_t writtenCount) {
 				if (error) {
 					onError(error);
 				}
-			});
+			}));
 }
 
 uint8_t ZWaveProtocol::calcChecksum(const uint8_t *data, int length) {
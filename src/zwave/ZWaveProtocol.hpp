@@ -3,6 +3,7 @@
 #include <deque>
 #include <chrono>
 #include "asio.hpp"
+#include "HandlerMemory.hpp"
 #include "Network.hpp"
 #include "ptr.hpp"
 
@@ -121,6 +122,26 @@ public:
 	/// Send a request to the ZWave controller. When the response arrives, request->onResponse() gets called
 	void sendRequest(ptr<Request> request);
 
+	///
+	/// Close the serial port and drop all pending requests, e.g. before the network is handed over to a new process.
+	/// Listeners get notified with onClose()
+	void close();
+
+	///
+	/// Returns true if the serial port is open
+	bool isOpen() const {return this->tty.is_open();}
+
+	enum {
+		// number of queued requests at which new commands from clients should be rejected. The serial link only
+		// handles a few frames per second, therefore a longer queue only increases the latency for everybody
+		MAX_QUEUED_REQUESTS = 32
+	};
+
+	///
+	/// Returns true if so many requests are queued that new commands from clients should be rejected
+	/// @param count number of commands that are about to be sent
+	bool isSaturated(int count = 1) const {return this->requests.size() + count > MAX_QUEUED_REQUESTS;}
+
 protected:
 
 	///
@@ -157,6 +178,9 @@ protected:
 	uint8_t calcChecksum(const uint8_t *data, int length);
 
 	
+	// memory for the asynchronous operations of serial port and timer
+	HandlerMemory handlerMemory;
+
 	// serial connection to zwave dongle
 	asio::serial_port tty;
 	
@@ -0,0 +1,112 @@
+#include <cstring>
+#include <memory>
+#include "http/FormParser.hpp"
+#include "http/JsonParser.hpp"
+#include "check.hpp"
+
+
+// records the fields and records as "key=value" and "record" lines
+class Recorder : public BodyParser::Listener {
+public:
+	bool onField(string_view key, string_view value) override {
+		this->s += key.str();
+		this->s += '=';
+		this->s += value.str();
+		this->s += '\n';
+		return true;
+	}
+
+	bool onRecord() override {
+		this->s += "record\n";
+		return true;
+	}
+
+	std::string s;
+};
+
+// parse a body that is split into parts at the given positions, the log ends with "error" if parsing failed
+template <typename Parser>
+static std::string parse(std::string const & body, std::initializer_list<size_t> splits) {
+	Recorder recorder;
+	Parser parser(recorder);
+	size_t position = 0;
+	for (size_t split : splits) {
+		if (!parser.parse((uint8_t const *)body.data() + position, split - position))
+			return recorder.s + "error\n";
+		position = split;
+	}
+	if (!parser.parse((uint8_t const *)body.data() + position, body.length() - position) || !parser.finish())
+		return recorder.s + "error\n";
+	return recorder.s;
+}
+
+// parse a body in one part, in two parts split at every position and byte by byte, all have to give the expected log
+template <typename Parser>
+static bool check(std::string const & body, std::string const & expected) {
+	bool same = parse<Parser>(body, {}) == expected;
+	for (size_t i = 0; i <= body.length(); ++i) {
+		if (parse<Parser>(body, {i}) != expected) {
+			std::cout << "split at " << i << " differs" << std::endl;
+			same = false;
+		}
+	}
+	Recorder recorder;
+	Parser parser(recorder);
+	bool valid = true;
+	for (size_t i = 0; i < body.length() && valid; ++i) {
+		valid = parser.parse((uint8_t const *)body.data() + i, 1);
+	}
+	if ((valid && parser.finish() ? recorder.s : recorder.s + "error\n") != expected) {
+		std::cout << "parsing byte by byte differs" << std::endl;
+		same = false;
+	}
+	return same;
+}
+
+static bool checkJson(std::string const & body, std::string const & expected) {
+	return check<JsonParser>(body, expected);
+}
+
+static bool checkForm(std::string const & body, std::string const & expected) {
+	return check<FormParser>(body, expected);
+}
+
+int main() {
+	// JSON: nested objects become dotted keys, literals, escapes and surrogate pairs
+	CHECK(checkJson("{\"node\": 4, \"position\": {\"blinds\": 50}, \"on\": true, \"off\": false, \"x\": null,"
+		" \"name\": \"a\\\"b\\\\\\u00e9\\ud83d\\ude00\\n\"}",
+		"node=4\nposition.blinds=50\non=on\noff=off\nname=a\"b\\\xc3\xa9\xf0\x9f\x98\x80\n\nrecord\n"));
+	CHECK(checkJson(" [ {\"node\":4,\"dim\":99} , {\"node\":5,\"a\":{\"b\":{\"c\":-1.5E3}},\"d\":0} ] ",
+		"node=4\ndim=99\nrecord\nnode=5\na.b.c=-1.5E3\nd=0\nrecord\n"));
+	CHECK(checkJson("[]", ""));
+	CHECK(checkJson("{}", "record\n"));
+	
+	// JSON: invalid bodies, the fields before the error are still passed
+	CHECK(checkJson("{\"a\":1,\"b\":[1]}", "a=1\nerror\n"));
+	CHECK(checkJson("{\"a\":01}", "error\n"));
+	CHECK(checkJson("{\"a\":tru}", "error\n"));
+	CHECK(checkJson("{\"a\":1}x", "a=1\nrecord\nerror\n"));
+	CHECK(checkJson("{\"a\":1", "error\n"));
+	CHECK(checkJson("{\"a\":\"b\"", "a=b\nerror\n"));
+	CHECK(checkJson("{\"a\":\"\\ud800\"}", "error\n"));
+	CHECK(checkJson("{\"a\":\"\\ude00\"}", "error\n"));
+	CHECK(checkJson("{\"a\":\"\\x\"}", "error\n"));
+	CHECK(checkJson("{\"a\":\"b\nc\"}", "error\n"));
+	CHECK(checkJson("[{\"a\":1},]", "a=1\nrecord\nerror\n"));
+	CHECK(checkJson("{\"a\":{\"b\":{\"c\":{\"d\":{\"e\":{\"f\":{\"g\":{\"h\":{\"i\":1}}}}}}}}}", "error\n"));
+	CHECK(checkJson("{\"a\":\"" + std::string(BodyParser::MAX_LENGTH + 1, 'x') + "\"}", "error\n"));
+	
+	// form: one record per line, percent-encoding and '+'
+	CHECK(checkForm("node=4&position.blinds=50\nnode=5&name=a+b%20c%3d\n",
+		"node=4\nposition.blinds=50\nrecord\nnode=5\nname=a b c=\nrecord\n"));
+	CHECK(checkForm("a=1\r\nb=x=y&flag&=z", "a=1\nrecord\nb=x=y\nrecord\n"));
+	CHECK(checkForm("", ""));
+	CHECK(checkForm("\n\n", ""));
+	
+	// form: invalid bodies
+	CHECK(checkForm("a=%4", "error\n"));
+	CHECK(checkForm("a=1&b=%zz", "a=1\nerror\n"));
+	CHECK(checkForm(std::string(BodyParser::MAX_LENGTH + 1, 'x') + "=1", "error\n"));
+	
+	return testResult();
+}
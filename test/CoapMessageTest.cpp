@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <vector>
+#include "coap/CoapMessage.hpp"
+#include "check.hpp"
+
+
+static bool parse(CoapMessage & message, std::string const & datagram) {
+	return message.parse((uint8_t const *)datagram.data(), datagram.length());
+}
+
+int main() {
+	// build a request with options of all lengths of delta and length extensions, note the positions where an
+	// option ends
+	std::string datagram;
+	CoapWriter writer(datagram, CoapMessage::CONFIRMABLE, CoapMessage::GET, 0x1234, string_view("\xab\xcd", 2));
+	std::vector<size_t> ends = {datagram.length()};
+	writer.option(CoapMessage::OBSERVE, uint32_t(0));
+	ends.push_back(datagram.length());
+	writer.option(CoapMessage::URI_PATH, "node");
+	ends.push_back(datagram.length());
+	writer.option(CoapMessage::URI_PATH, "4");
+	ends.push_back(datagram.length());
+	writer.option(CoapMessage::URI_QUERY, "position.blinds=50");
+	ends.push_back(datagram.length());
+	writer.option(CoapMessage::ACCEPT, uint32_t(CoapMessage::JSON));
+	ends.push_back(datagram.length());
+	writer.option(1000, std::string(300, 'x'));
+	ends.push_back(datagram.length());
+	writer.payload() += "hello";
+	
+	CoapMessage message;
+	CHECK(parse(message, datagram));
+	CHECK(message.type == CoapMessage::CONFIRMABLE);
+	CHECK(message.code == CoapMessage::GET);
+	CHECK(message.messageId == 0x1234);
+	CHECK(message.token == string_view("\xab\xcd", 2));
+	CHECK(message.isPath("node", "4"));
+	CHECK(message.query.parameters["position.blinds"] == "50");
+	CHECK(message.observe && *message.observe == 0);
+	CHECK(message.accept && *message.accept == CoapMessage::JSON);
+	CHECK(!message.contentFormat);
+	CHECK(!message.unknownCritical);
+	CHECK(message.payload == "hello");
+	
+	// truncated datagrams are only valid if they end behind an option or inside the payload
+	size_t payloadStart = ends.back() + 1;
+	for (size_t length = 0; length < datagram.length(); ++length) {
+		bool valid = std::find(ends.begin(), ends.end(), length) != ends.end() || length > payloadStart;
+		std::string truncated = datagram.substr(0, length);
+		bool result = parse(message, truncated);
+		if (!CHECK(result == valid))
+			std::cout << "  truncated to " << length << " bytes" << std::endl;
+		if (result && length > payloadStart)
+			CHECK(message.payload == string_view("hello", length - payloadStart));
+	}
+	
+	// header: version, token length, empty message
+	CHECK(!parse(message, std::string("\x80\x01\x00\x01", 4)));
+	CHECK(!parse(message, std::string("\x49\x01\x00\x01" "123456789", 13)));
+	CHECK(parse(message, std::string("\x40\x00\x00\x01", 4)));
+	CHECK(message.code == CoapMessage::EMPTY);
+	CHECK(!parse(message, std::string("\x41\x00\x00\x01" "1", 5)));
+	
+	// reserved nibble 15 in delta or length, payload marker without payload
+	CHECK(!parse(message, std::string("\x40\x01\x00\x01\xf0", 5)));
+	CHECK(!parse(message, std::string("\x40\x01\x00\x01\xbf", 5)));
+	CHECK(!parse(message, std::string("\x40\x01\x00\x01\xff", 5)));
+	
+	// unknown critical option, too many path segments, integer option longer than 4 bytes
+	CHECK(parse(message, std::string("\x40\x01\x00\x01\x90", 5)));
+	CHECK(message.unknownCritical);
+	CHECK(parse(message, std::string("\x40\x01\x00\x01\xb1" "a\x01" "b\x01" "c\x01" "d\x01" "e", 14)));
+	CHECK(message.pathCount > CoapMessage::MAX_PATH_SEGMENTS);
+	CHECK(!message.isPath("a", "b"));
+	CHECK(parse(message, std::string("\x40\x01\x00\x01\x65" "12345", 10)));
+	CHECK(!message.observe);
+	
+	return testResult();
+}
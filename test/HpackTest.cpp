@@ -0,0 +1,180 @@
+#include "http/Hpack.hpp"
+#include "check.hpp"
+
+
+// collects the decoded header fields as "name: value" lines
+class Fields : public Hpack::Listener {
+public:
+	void onHeaderField(string_view name, string_view value) override {
+		this->s += name.str();
+		this->s += ": ";
+		this->s += value.str();
+		this->s += '\n';
+	}
+
+	std::string s;
+};
+
+// decode a header block given in hex, returns the fields or the error
+static std::string decode(Hpack & hpack, char const * hex) {
+	std::string block = fromHex(hex);
+	Fields fields;
+	Hpack::Result result = hpack.decode((uint8_t const *)block.data(), block.length(), fields);
+	if (result == Hpack::INVALID)
+		return "<invalid>";
+	if (result == Hpack::TOO_LARGE)
+		return "<too large>";
+	return fields.s;
+}
+
+// encode header fields given as name/value pairs into a new header block
+static std::string encode(Hpack & hpack, std::initializer_list<std::pair<char const *, char const *>> fields) {
+	std::string block;
+	hpack.begin(block);
+	for (auto const & field : fields) {
+		hpack.encode(block, field.first, field.second);
+	}
+	return toHex((uint8_t const *)block.data(), block.length());
+}
+
+int main() {
+	// RFC 7541 C.2: header field representations
+	{
+		Hpack hpack;
+		CHECK(decode(hpack, "400a 6375 7374 6f6d 2d6b 6579 0d63 7573 746f 6d2d 6865 6164 6572")
+			== "custom-key: custom-header\n");
+		CHECK(decode(hpack, "040c 2f73 616d 706c 652f 7061 7468") == ":path: /sample/path\n");
+		CHECK(decode(hpack, "1008 7061 7373 776f 7264 0673 6563 7265 74") == "password: secret\n");
+		CHECK(decode(hpack, "82") == ":method: GET\n");
+		
+		// only the field with incremental indexing was added to the dynamic table
+		CHECK(decode(hpack, "be") == "custom-key: custom-header\n");
+		CHECK(decode(hpack, "bf") == "<invalid>");
+	}
+	
+	// RFC 7541 C.3: requests without Huffman coding
+	{
+		Hpack hpack;
+		CHECK(decode(hpack, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d")
+			== ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n");
+		CHECK(decode(hpack, "8286 84be 5808 6e6f 2d63 6163 6865")
+			== ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n");
+		CHECK(decode(hpack, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65")
+			== ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\n"
+				"custom-key: custom-value\n");
+	}
+	
+	// RFC 7541 C.4: requests with Huffman coding, the encoder produces the same blocks
+	{
+		char const * const blocks[] = {
+			"828684418cf1e3c2e5f23a6ba0ab90f4ff",
+			"828684be5886a8eb10649cbf",
+			"828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf"
+		};
+		Hpack decoder;
+		CHECK(decode(decoder, blocks[0])
+			== ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n");
+		CHECK(decode(decoder, blocks[1])
+			== ":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n");
+		CHECK(decode(decoder, blocks[2])
+			== ":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\n"
+				"custom-key: custom-value\n");
+		
+		Hpack encoder;
+		CHECK(encode(encoder, {{":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+			{":authority", "www.example.com"}}) == blocks[0]);
+		CHECK(encode(encoder, {{":method", "GET"}, {":scheme", "http"}, {":path", "/"},
+			{":authority", "www.example.com"}, {"cache-control", "no-cache"}}) == blocks[1]);
+		CHECK(encode(encoder, {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"},
+			{":authority", "www.example.com"}, {"custom-key", "custom-value"}}) == blocks[2]);
+	}
+	
+	// RFC 7541 C.5: responses without Huffman coding and a dynamic table of 256 bytes that evicts entries, the size
+	// is set with a dynamic table size update
+	{
+		Hpack hpack;
+		CHECK(decode(hpack, "3fe1 01"
+			"4803 3330 3258 0770 7269 7661 7465 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32"
+			"3120 474d 546e 1768 7474 7073 3a2f 2f77 7777 2e65 7861 6d70 6c65 2e63 6f6d")
+			== ":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\n"
+				"location: https://www.example.com\n");
+		CHECK(decode(hpack, "4803 3330 37c1 c0bf")
+			== ":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\n"
+				"location: https://www.example.com\n");
+		CHECK(decode(hpack, "88c1 611d 4d6f 6e2c 2032 3120 4f63 7420 3230 3133 2032 303a 3133 3a32 3220 474d"
+			"54c0 5a04 677a 6970 7738 666f 6f3d 4153 444a 4b48 514b 425a 584f 5157 454f 5049 5541 5851 5745 4f49"
+			"553b 206d 6178 2d61 6765 3d33 3630 303b 2076 6572 7369 6f6e 3d31")
+			== ":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\n"
+				"location: https://www.example.com\ncontent-encoding: gzip\n"
+				"set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n");
+		
+		// the dynamic table holds the three entries of the last block, indexed fields are not added again
+		CHECK(decode(hpack, "be") == "set-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n");
+		CHECK(decode(hpack, "bf") == "content-encoding: gzip\n");
+		CHECK(decode(hpack, "c0") == "date: Mon, 21 Oct 2013 20:13:22 GMT\n");
+		CHECK(decode(hpack, "c1") == "<invalid>");
+	}
+	
+	// round trip of responses through encoder and decoder, also after the peer has reduced the table size
+	{
+		Hpack encoder;
+		Hpack decoder;
+		for (int i = 0; i < 20; ++i) {
+			if (i == 10)
+				encoder.setEncoderTableSize(100);
+			std::string block;
+			encoder.begin(block);
+			std::string length = std::to_string(i * 37);
+			std::string etag = "\"" + std::to_string(i % 3) + "-abcdef\"";
+			encoder.encode(block, ":status", i % 2 ? "200" : "304");
+			encoder.encode(block, "server", "huasi");
+			encoder.encode(block, "content-type", "application/json");
+			encoder.encode(block, "etag", etag);
+			encoder.encode(block, "content-length", length, false);
+			encoder.encode(block, "x-binary", std::string("\0\x01\xff~", 4));
+			Fields fields;
+			CHECK(decoder.decode((uint8_t const *)block.data(), block.length(), fields) == Hpack::OK);
+			CHECK(fields.s == std::string(":status: ") + (i % 2 ? "200" : "304") + "\nserver: huasi\n"
+				"content-type: application/json\netag: " + etag + "\ncontent-length: " + length + "\nx-binary: "
+				+ std::string("\0\x01\xff~", 4) + '\n');
+		}
+	}
+	
+	// invalid blocks
+	{
+		Hpack hpack;
+		
+		// index 0 and index beyond the tables
+		CHECK(decode(hpack, "80") == "<invalid>");
+		CHECK(decode(hpack, "ff00") == "<invalid>");
+		
+		// truncated integer, name and value
+		CHECK(decode(hpack, "7f") == "<invalid>");
+		CHECK(decode(hpack, "400a 6375 7374") == "<invalid>");
+		CHECK(decode(hpack, "4001 6105 61") == "<invalid>");
+		
+		// integer overflow
+		CHECK(decode(hpack, "ffff ffff ffff 7f") == "<invalid>");
+		
+		// Huffman padding longer than 7 bits or not all ones
+		CHECK(decode(hpack, "4001 6182 1fff") == "<invalid>");
+		CHECK(decode(hpack, "4001 6181 00") == "<invalid>");
+		
+		// table size update after a field and above our setting
+		CHECK(decode(hpack, "823f e101") == "<invalid>");
+		CHECK(decode(hpack, "3fe2 1f") == "<invalid>");
+		
+		// header list larger than the limit, made of references to a large table entry
+		Hpack large;
+		std::string block = fromHex("4001 61");
+		Hpack::encodeInteger(block, 0x00, 7, 3000);
+		block.append(3000, 'x');
+		for (int i = 0; i < 5; ++i) {
+			block += char(0xbe);
+		}
+		Fields fields;
+		CHECK(large.decode((uint8_t const *)block.data(), block.length(), fields) == Hpack::TOO_LARGE);
+	}
+	
+	return testResult();
+}
@@ -0,0 +1,42 @@
+#include <chrono>
+#include <thread>
+#include "RateLimiter.hpp"
+#include "ptr.hpp"
+#include "check.hpp"
+
+
+int main() {
+	int retryAfter = 0;
+	
+	// a new client starts with a full bucket
+	ptr<RateLimiter> limiter = new RateLimiter(1.0, 10);
+	CHECK(limiter->acquire("a", 7, retryAfter));
+	CHECK(limiter->acquire("a", 3, retryAfter));
+	
+	// empty bucket: the retry time covers the missing tokens
+	CHECK(!limiter->acquire("a", 3, retryAfter));
+	CHECK(retryAfter == 3);
+	CHECK(!limiter->acquire("a", 1, retryAfter));
+	CHECK(retryAfter == 1);
+	
+	// clients have separate buckets
+	CHECK(limiter->acquire("b", 10, retryAfter));
+	
+	// more than the burst size never succeeds
+	CHECK(!limiter->acquire("c", 11, retryAfter));
+	CHECK(retryAfter == 1);
+	CHECK(limiter->acquire("c", 10, retryAfter));
+	
+	// refill at 100 tokens per second up to the burst size
+	ptr<RateLimiter> fast = new RateLimiter(100.0, 5);
+	CHECK(fast->acquire("a", 5, retryAfter));
+	CHECK(!fast->acquire("a", 5, retryAfter));
+	std::this_thread::sleep_for(std::chrono::milliseconds(30));
+	CHECK(fast->acquire("a", 2, retryAfter));
+	CHECK(!fast->acquire("a", 5, retryAfter));
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	CHECK(fast->acquire("a", 5, retryAfter));
+	CHECK(!fast->acquire("a", 1, retryAfter));
+	
+	return testResult();
+}
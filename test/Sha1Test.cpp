@@ -0,0 +1,73 @@
+#include <cstring>
+#include "http/Base64.hpp"
+#include "http/Sha1.hpp"
+#include "check.hpp"
+
+
+// SHA-1 of the data, added in two parts split at the given position
+static std::string sha1(std::string const & data, size_t split) {
+	Sha1 sha1;
+	sha1.update((uint8_t const *)data.data(), split);
+	sha1.update((uint8_t const *)data.data() + split, data.length() - split);
+	uint8_t digest[Sha1::DIGEST_LENGTH];
+	sha1.finish(digest);
+	return toHex(digest, sizeof(digest));
+}
+
+static std::string encode(std::string const & data) {
+	std::string s;
+	encodeBase64(s, (uint8_t const *)data.data(), data.length());
+	return s;
+}
+
+static std::string decode(char const * s) {
+	std::string r;
+	if (!decodeBase64(r, s, strlen(s)))
+		return "<invalid>";
+	return r;
+}
+
+int main() {
+	// FIPS 180 examples, also split at every position (crossing the 64 byte blocks)
+	std::string const abc = "abc";
+	std::string const twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+	CHECK(sha1("", 0) == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+	for (size_t i = 0; i <= abc.length(); ++i) {
+		CHECK(sha1(abc, i) == "a9993e364706816aba3e25717850c26c9cd0d89d");
+	}
+	for (size_t i = 0; i <= twoBlocks.length(); ++i) {
+		CHECK(sha1(twoBlocks, i) == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+	}
+	CHECK(sha1(std::string(1000000, 'a'), 500001) == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+	
+	// RFC 4648 examples
+	CHECK(encode("") == "");
+	CHECK(encode("f") == "Zg==");
+	CHECK(encode("fo") == "Zm8=");
+	CHECK(encode("foo") == "Zm9v");
+	CHECK(encode("foob") == "Zm9vYg==");
+	CHECK(encode("fooba") == "Zm9vYmE=");
+	CHECK(encode("foobar") == "Zm9vYmFy");
+	CHECK(decode("Zm9vYg==") == "foob");
+	CHECK(decode("Zm9vYmE=") == "fooba");
+	CHECK(decode("Zm9vYmFy") == "foobar");
+	
+	// padding is optional, base64url as used by the HTTP2-Settings header
+	CHECK(decode("Zm9vYg") == "foob");
+	CHECK(decode("-_8") == "\xfb\xff");
+	CHECK(decode("+/8=") == "\xfb\xff");
+	CHECK(decode("Zm9v YmFy") == "<invalid>");
+	
+	// RFC 6455 example of the Sec-WebSocket-Accept value
+	std::string key = "dGhlIHNhbXBsZSBub25jZQ==";
+	key += "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+	Sha1 hash;
+	hash.update((uint8_t const *)key.data(), key.length());
+	uint8_t digest[Sha1::DIGEST_LENGTH];
+	hash.finish(digest);
+	std::string accept;
+	encodeBase64(accept, digest, sizeof(digest));
+	CHECK(accept == "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=");
+	
+	return testResult();
+}
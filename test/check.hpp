@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+
+///
+/// check a condition, a failed condition is printed with its location and makes the test fail
+#define CHECK(condition) checkCondition(condition, #condition, __FILE__, __LINE__)
+
+///
+/// number of failed checks
+inline int & failureCount() {
+	static int count = 0;
+	return count;
+}
+
+inline bool checkCondition(bool condition, char const * text, char const * file, int line) {
+	if (!condition) {
+		std::cout << file << ':' << line << ": check failed: " << text << std::endl;
+		++failureCount();
+	}
+	return condition;
+}
+
+///
+/// exit code of the test, 0 if all checks passed
+inline int testResult() {
+	return failureCount() == 0 ? 0 : 1;
+}
+
+///
+/// convert data to lower case hex digits
+inline std::string toHex(uint8_t const * data, size_t length) {
+	static char const hex[] = "0123456789abcdef";
+	std::string s;
+	for (size_t i = 0; i < length; ++i) {
+		s += hex[data[i] >> 4];
+		s += hex[data[i] & 15];
+	}
+	return s;
+}
+
+///
+/// convert hex digits to data, spaces are ignored
+inline std::string fromHex(char const * hex) {
+	std::string s;
+	int digits = 0;
+	int value = 0;
+	for (; *hex != 0; ++hex) {
+		char ch = *hex;
+		if (ch == ' ')
+			continue;
+		value = (value << 4) | (ch <= '9' ? ch - '0' : (ch | 0x20) - 'a' + 10);
+		if (++digits == 2) {
+			s += char(value);
+			digits = 0;
+			value = 0;
+		}
+	}
+	return s;
+}